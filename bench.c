@@ -0,0 +1,524 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include "protocol.h"
+#include "frame.h"
+#include "event_loop.h"
+#include "histogram.h"
+
+// ---- Headless load generator ----
+// Runs many simulated players in one process on a few epoll threads. Each bot
+// authenticates with "code|nickname", listens to its room's multicast group,
+// answers every question after a random think time and sends keepalives, using
+// the same framing code as the interactive client.
+
+#define SERVER_IP "192.3.1.1"
+#define SERVER_PORT 8889
+#define BENCH_MAX_THREADS 64
+#define BENCH_MAX_ROOMS 1024        // Rooms the server may report (MAX_ROOMS in room.h)
+#define KEEPALIVE_INTERVAL_MS 10000
+
+// ---- Bot lifecycle ----
+enum {
+    BOT_WAITING,                    // Not connected yet (ramp-up delay)
+    BOT_CONNECTING,                 // Non-blocking connect in progress
+    BOT_AUTH_WAIT,                  // Connected, waiting for TRV_AUTH_CODE / TRV_AUTH_OK
+    BOT_PLAYING,                    // Authenticated, answering questions
+    BOT_DONE                        // Game over or failed; socket closed
+};
+
+// ---- Think-time distributions ----
+enum { THINK_FIXED, THINK_UNIFORM, THINK_EXP };
+
+struct BenchThread;
+
+// ---- One simulated player ----
+typedef struct Bot {
+    EventHandler ev;                // TCP socket registration (must be first)
+    int sock;
+    int state;                      // BOT_* state
+    int id;
+    struct BenchThread* thread;     // Thread that owns the bot
+    int wire;                       // TRV_WIRE_V1, or TRV_WIRE_V2 once the server agreed
+    FrameRing in;                   // Received TCP bytes
+    uint64_t t_start;               // connect() issued (us)
+    uint64_t t_connected;           // Connection established (us)
+    int room;                       // Room from TRV_AUTH_OK, -1 before
+    struct Bot* next_in_room;       // Other bots of this thread in the same room
+    uint32_t next_question;         // Next question id expected (sequence number)
+    int pending_question;           // Question the think timer will answer, -1 if none
+    uint64_t t_question;            // When pending_question arrived (us)
+    Timer think;                    // Ramp-up delay, then think time before answering
+    Timer keepalive;
+} Bot;
+
+// ---- Multicast group of one room, shared by the thread's bots in it ----
+typedef struct {
+    EventHandler ev;                // Must be first
+    int sock;                       // -1 if the group could not be joined
+    Bot* bots;                      // Linked through next_in_room
+} RoomGroup;
+
+// ---- Per-thread state: no locks, merged once the threads exit ----
+typedef struct BenchThread {
+    EventLoop loop;
+    Bot* bots;
+    int num_bots;
+    int live;                       // Bots not yet BOT_DONE
+    unsigned seed;                  // rand_r() state for think times and answers
+    Timer deadline;                 // Stops the thread after -T seconds
+    Histogram connect;              // connect() -> established
+    Histogram auth;                 // Established -> TRV_AUTH_OK
+    Histogram answer;               // Question received -> answer sent
+    uint64_t questions_mcast;       // Questions first seen via multicast
+    uint64_t questions_tcp;         // Questions first seen over TCP (delivery or repair)
+    uint64_t duplicates;            // Copies of questions already seen
+    uint64_t nacks;
+    uint64_t answers;
+    uint64_t failed;                // Bots that never got to play or lost the connection
+    uint64_t finished;              // Bots that got TRV_WINNER
+    RoomGroup* groups[BENCH_MAX_ROOMS];
+} BenchThread;
+
+// ---- Configuration (set once in main) ----
+struct sockaddr_in server_addr;
+int num_bots = 100;
+int num_threads = 1;
+int connect_rate = 1000;            // New connections per second
+int think_kind = THINK_UNIFORM;
+int think_a = 1000;                 // fixed: delay; uniform: min; exp: mean (ms)
+int think_b = 5000;                 // uniform: max (ms)
+int keepalive_ms = KEEPALIVE_INTERVAL_MS;
+int max_seconds = 0;                // 0 = run until every bot is done
+int mcast_warned = 0;
+int tcp_questions = 0;              // 1: bots ask for questions over TCP (-m)
+int wire_v2 = 0;                    // 1: bots ask for wire format v2 (-2)
+
+BenchThread threads[BENCH_MAX_THREADS];
+
+// ---- Function declarations ----
+void bot_connect(Bot* b);
+void bot_on_event(EventHandler* h, uint32_t events);
+void bot_on_timer(void* arg);
+void bot_on_keepalive(void* arg);
+void bot_process(Bot* b, TrvMessage* msg, uint32_t qid);
+void bot_on_question(Bot* b, uint32_t qid, int via_mcast);
+void bot_join_group(Bot* b, const char* ip, int port);
+void bot_done(Bot* b, int failed);
+void group_on_event(EventHandler* h, uint32_t events);
+void thread_on_deadline(void* arg);
+int parse_think(const char* spec);
+void print_report(double seconds);
+
+// Wall-clock-independent microseconds
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Send one frame, best effort (frames are tiny; a full socket buffer is a lost frame)
+static void bot_send(Bot* b, uint8_t type, uint8_t qid, const char* payload) {
+    TrvMessage msg;
+    build_message(&msg, type, qid, payload);
+    send(b->sock, &msg, FRAME_HEADER_LEN + msg.payload_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+// Send a payload-less frame in the bot's wire format. arg is the answer
+// choice: the v2 header's arg byte, or the ASCII payload in v1.
+static void bot_send_op(Bot* b, uint8_t type, uint32_t qid, int arg) {
+    if (b->wire == TRV_WIRE_V2) {
+        uint8_t frame[TRV_V2_HEADER_LEN];
+        build_header_v2(frame, type, (uint8_t)arg, qid, 0);
+        send(b->sock, frame, sizeof(frame), MSG_NOSIGNAL | MSG_DONTWAIT);
+        return;
+    }
+    char payload[2] = { (char)('0' + arg), '\0' };
+    bot_send(b, type, (uint8_t)qid, type == TRV_ANSWER ? payload : "");
+}
+
+// Next think time in ms from the configured distribution
+static int think_time(BenchThread* t) {
+    double u = rand_r(&t->seed) / ((double)RAND_MAX + 1);
+    if (think_kind == THINK_UNIFORM) return think_a + (int)(u * (think_b - think_a + 1));
+    if (think_kind == THINK_EXP) return (int)(-think_a * log(1 - u));
+    return think_a;
+}
+
+int main(int argc, char* argv[]) {
+    const char* server_ip = SERVER_IP;
+    int port = SERVER_PORT;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:t:s:p:r:d:k:T:m2")) != -1) {
+        switch (opt) {
+            case 'n': num_bots = atoi(optarg); break;
+            case 't': num_threads = atoi(optarg); break;
+            case 's': server_ip = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'r': connect_rate = atoi(optarg); break;
+            case 'd':
+                if (parse_think(optarg) < 0) {
+                    fprintf(stderr, "Bad think time '%s' (fixed:MS, uniform:MIN:MAX or exp:MEAN)\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'k': keepalive_ms = atoi(optarg); break;
+            case 'T': max_seconds = atoi(optarg); break;
+            case 'm': tcp_questions = 1; break;
+            case '2': wire_v2 = 1; break;
+            default:
+                fprintf(stderr, "Usage: %s [-n bots] [-t threads] [-s server_ip] [-p port] [-r connects/s] "
+                                "[-d fixed:MS|uniform:MIN:MAX|exp:MEAN] [-k keepalive_ms] [-T max_seconds] [-m] [-2]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (num_bots < 1) num_bots = 1;
+    if (num_threads < 1) num_threads = 1;
+    if (num_threads > BENCH_MAX_THREADS) num_threads = BENCH_MAX_THREADS;
+    if (connect_rate < 1) connect_rate = 1;
+    if (keepalive_ms < 1) keepalive_ms = KEEPALIVE_INTERVAL_MS;
+
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, server_ip, &server_addr.sin_addr) != 1) {
+        fprintf(stderr, "Bad server address '%s'\n", server_ip);
+        return 1;
+    }
+
+    // One socket per bot plus the multicast groups
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    // Bot i runs on thread i % num_threads and connects at i / connect_rate seconds
+    for (int t = 0; t < num_threads; t++) {
+        BenchThread* th = &threads[t];
+        if (event_loop_init(&th->loop, t) < 0) return 1;
+        th->num_bots = (num_bots - t + num_threads - 1) / num_threads;
+        th->bots = calloc(th->num_bots, sizeof(Bot));
+        if (!th->bots) {
+            perror("calloc failed");
+            return 1;
+        }
+        th->live = th->num_bots;
+        th->seed = (unsigned)(now_us() ^ (t * 2654435761u));
+        hist_init(&th->connect);
+        hist_init(&th->auth);
+        hist_init(&th->answer);
+        for (int j = 0; j < th->num_bots; j++) {
+            Bot* b = &th->bots[j];
+            b->id = j * num_threads + t;
+            b->sock = -1;
+            b->state = BOT_WAITING;
+            b->thread = th;
+            b->room = -1;
+            b->wire = TRV_WIRE_V1;
+            b->pending_question = -1;
+            b->ev.on_event = bot_on_event;
+            timer_init(&b->think, bot_on_timer, b);
+            timer_init(&b->keepalive, bot_on_keepalive, b);
+            event_loop_timer(&th->loop, &b->think, (uint64_t)b->id * 1000 / connect_rate);
+        }
+        if (max_seconds > 0) {
+            timer_init(&th->deadline, thread_on_deadline, th);
+            event_loop_timer(&th->loop, &th->deadline, (uint64_t)max_seconds * 1000);
+        }
+    }
+
+    printf("Starting %d bots on %d thread(s) against %s:%d...\n", num_bots, num_threads, server_ip, port);
+    uint64_t start = now_us();
+    for (int t = 0; t < num_threads; t++) {
+        if (event_loop_start(&threads[t].loop) != 0) {
+            perror("pthread_create failed");
+            return 1;
+        }
+    }
+    for (int t = 0; t < num_threads; t++) pthread_join(threads[t].loop.thread, NULL);
+
+    print_report((now_us() - start) / 1e6);
+    return 0;
+}
+
+// ---- Parse the -d think-time spec ----
+int parse_think(const char* spec) {
+    if (sscanf(spec, "uniform:%d:%d", &think_a, &think_b) == 2 && think_a >= 0 && think_b >= think_a) {
+        think_kind = THINK_UNIFORM;
+    } else if (sscanf(spec, "exp:%d", &think_a) == 1 && think_a >= 0) {
+        think_kind = THINK_EXP;
+    } else if (sscanf(spec, "fixed:%d", &think_a) == 1 && think_a >= 0) {
+        think_kind = THINK_FIXED;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// ---- Start a non-blocking connect ----
+void bot_connect(Bot* b) {
+    BenchThread* t = b->thread;
+    b->sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (b->sock < 0) {
+        perror("socket failed");
+        bot_done(b, 1);
+        return;
+    }
+    frame_ring_init(&b->in);
+    b->t_start = now_us();
+    if (connect(b->sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0 && errno != EINPROGRESS) {
+        bot_done(b, 1);
+        return;
+    }
+    b->state = BOT_CONNECTING;
+    if (event_loop_add(&t->loop, b->sock, &b->ev, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET) < 0) {
+        perror("epoll_ctl failed");
+        bot_done(b, 1);
+    }
+}
+
+// ---- TCP socket readiness ----
+void bot_on_event(EventHandler* h, uint32_t events) {
+    Bot* b = (Bot*)h;
+    BenchThread* t = b->thread;
+
+    if (b->state == BOT_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(b->sock, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0 || (events & (EPOLLERR | EPOLLHUP))) {
+            bot_done(b, 1);
+            return;
+        }
+        if (!(events & EPOLLOUT)) return;
+        b->t_connected = now_us();
+        hist_record(&t->connect, b->t_connected - b->t_start);
+        b->state = BOT_AUTH_WAIT;
+        event_loop_mod(&t->loop, b->sock, &b->ev, EPOLLIN | EPOLLRDHUP | EPOLLET);
+    }
+
+    // Edge-triggered: drain the socket, then every complete frame
+    while (b->state != BOT_DONE) {
+        int n = frame_ring_fill(&b->in, b->sock);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            bot_done(b, b->state != BOT_DONE);
+            return;
+        }
+        TrvMessage msg;
+        int res = 0;
+        uint32_t id;
+        uint8_t arg;
+        while (b->state != BOT_DONE) {
+            if (b->wire == TRV_WIRE_V2) res = frame_next_v2(&b->in, &msg, &id, &arg);
+            else if ((res = frame_next(&b->in, &msg)) > 0) id = msg.question_id;
+            if (res != 1) break;
+            bot_process(b, &msg, id);
+        }
+        if (b->state != BOT_DONE && res < 0) {
+            bot_done(b, 1);         // Corrupt stream
+            return;
+        }
+        if (n < 0) return;          // EAGAIN: wait for the next edge
+    }
+}
+
+// ---- One frame from the server ----
+void bot_process(Bot* b, TrvMessage* msg, uint32_t qid) {
+    BenchThread* t = b->thread;
+
+    if (msg->type == TRV_AUTH_CODE) {
+        char reply[64];
+        snprintf(reply, sizeof(reply), "%.16s|bot%d%s%s", msg->payload, b->id,
+                 tcp_questions ? "|tcp" : "", wire_v2 ? "|v2" : "");
+        bot_send(b, TRV_AUTH_REPLY, 0, reply);
+    } else if (msg->type == TRV_AUTH_FAIL) {
+        bot_done(b, 1);
+    } else if (msg->type == TRV_AUTH_OK) {
+        hist_record(&t->auth, now_us() - b->t_connected);
+        b->state = BOT_PLAYING;
+        if (strstr(msg->payload, "\nv2 game ")) b->wire = TRV_WIRE_V2;
+
+        // The welcome ends with "Room <n>, multicast <ip>:<port>"
+        char ip[INET_ADDRSTRLEN];
+        int port;
+        char* room = strstr(msg->payload, "Room ");
+        if (room && sscanf(room, "Room %d, multicast %15[0-9.]:%d", &b->room, ip, &port) == 3 &&
+            b->room >= 0 && b->room < BENCH_MAX_ROOMS) {
+            bot_join_group(b, ip, port);
+        } else {
+            b->room = -1;           // TCP delivery ("Room <n>, tcp"), or rely on TCP repairs
+        }
+        event_loop_timer(&t->loop, &b->keepalive, keepalive_ms);
+    } else if (msg->type == TRV_QUESTION) {
+        bot_on_question(b, qid, 0);
+    } else if (msg->type == TRV_WINNER) {
+        t->finished++;
+        bot_done(b, 0);
+    }
+}
+
+// ---- A question arrived (multicast or TCP repair): ACK, fill gaps, think ----
+void bot_on_question(Bot* b, uint32_t qid, int via_mcast) {
+    BenchThread* t = b->thread;
+    if (b->state != BOT_PLAYING) return;
+
+    bot_send_op(b, TRV_ACK, qid, 0);
+    if (qid < b->next_question) {
+        t->duplicates++;
+        return;
+    }
+    for (uint32_t q = b->next_question; q < qid; q++) {
+        bot_send_op(b, TRV_NACK, q, 0);
+        t->nacks++;
+    }
+    b->next_question = qid + 1;
+    if (via_mcast) t->questions_mcast++;
+    else t->questions_tcp++;
+
+    // A newer question replaces one still being thought about
+    b->pending_question = (int)qid;
+    b->t_question = now_us();
+    event_loop_timer(&t->loop, &b->think, think_time(t));
+}
+
+// ---- Think timer: connect (before the game) or send the pending answer ----
+void bot_on_timer(void* arg) {
+    Bot* b = (Bot*)arg;
+    BenchThread* t = b->thread;
+    if (b->state == BOT_WAITING) {
+        bot_connect(b);
+        return;
+    }
+    if (b->state != BOT_PLAYING || b->pending_question < 0) return;
+
+    bot_send_op(b, TRV_ANSWER, b->pending_question, 1 + rand_r(&t->seed) % 4);
+    hist_record(&t->answer, now_us() - b->t_question);
+    t->answers++;
+    b->pending_question = -1;
+}
+
+void bot_on_keepalive(void* arg) {
+    Bot* b = (Bot*)arg;
+    if (b->state != BOT_PLAYING) return;
+    bot_send_op(b, TRV_KEEPALIVE, 0, 0);
+    event_loop_timer(&b->thread->loop, &b->keepalive, keepalive_ms);
+}
+
+// ---- Listen to the room's group (one socket per room and thread) ----
+void bot_join_group(Bot* b, const char* ip, int port) {
+    BenchThread* t = b->thread;
+    RoomGroup* g = t->groups[b->room];
+    if (!g) {
+        g = calloc(1, sizeof(RoomGroup));
+        if (!g) return;
+        g->ev.on_event = group_on_event;
+        g->sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+        int reuse = 1;
+        setsockopt(g->sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+        int mcast_all = 0;
+        setsockopt(g->sock, IPPROTO_IP, IP_MULTICAST_ALL, &mcast_all, sizeof(mcast_all));
+        struct ip_mreq mreq;
+        mreq.imr_multiaddr.s_addr = inet_addr(ip);
+        mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+
+        if (g->sock < 0 || bind(g->sock, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+            setsockopt(g->sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0 ||
+            event_loop_add(&t->loop, g->sock, &g->ev, EPOLLIN | EPOLLET) < 0) {
+            if (!__atomic_exchange_n(&mcast_warned, 1, __ATOMIC_RELAXED)) {
+                perror("⚠️  Multicast join failed, relying on TCP repairs");
+            }
+            if (g->sock >= 0) close(g->sock);
+            g->sock = -1;
+        }
+        t->groups[b->room] = g;
+    }
+    b->next_in_room = g->bots;
+    g->bots = b;
+}
+
+// ---- Multicast datagrams: hand each question to every bot in the room ----
+void group_on_event(EventHandler* h, uint32_t events) {
+    RoomGroup* g = (RoomGroup*)h;
+    char datagram[sizeof(TrvMessage)];
+    TrvMessage msg;
+    int n;
+    (void)events;
+    while ((n = recvfrom(g->sock, datagram, sizeof(datagram), 0, NULL, NULL)) >= 0) {
+        if (frame_decode(datagram, n, &msg) < 0 || msg.type != TRV_QUESTION) continue;
+        for (Bot* b = g->bots; b; b = b->next_in_room) bot_on_question(b, msg.question_id, 1);
+    }
+}
+
+// ---- Close a bot and stop the thread after its last one ----
+void bot_done(Bot* b, int failed) {
+    BenchThread* t = b->thread;
+    if (b->state == BOT_DONE) return;
+    timer_cancel(&b->think);
+    timer_cancel(&b->keepalive);
+    if (b->room >= 0 && t->groups[b->room]) {
+        Bot** link = &t->groups[b->room]->bots;
+        while (*link && *link != b) link = &(*link)->next_in_room;
+        if (*link) *link = b->next_in_room;
+    }
+    if (b->sock >= 0) {
+        event_loop_del(&t->loop, b->sock);
+        close(b->sock);
+        b->sock = -1;
+    }
+    b->state = BOT_DONE;
+    if (failed) t->failed++;
+    if (--t->live == 0) event_loop_stop(&t->loop);
+}
+
+void thread_on_deadline(void* arg) {
+    event_loop_stop(&((BenchThread*)arg)->loop);
+}
+
+// ---- Merge the per-thread results and print them ----
+void print_report(double seconds) {
+    Histogram connect, auth, answer;
+    hist_init(&connect);
+    hist_init(&auth);
+    hist_init(&answer);
+    uint64_t mcast = 0, tcp = 0, dups = 0, nacks = 0, answers = 0, failed = 0, finished = 0;
+    for (int t = 0; t < num_threads; t++) {
+        BenchThread* th = &threads[t];
+        hist_merge(&connect, &th->connect);
+        hist_merge(&auth, &th->auth);
+        hist_merge(&answer, &th->answer);
+        mcast += th->questions_mcast;
+        tcp += th->questions_tcp;
+        dups += th->duplicates;
+        nacks += th->nacks;
+        answers += th->answers;
+        failed += th->failed;
+        finished += th->finished;
+    }
+
+    printf("\n=== %d bots, %.1f s ===\n", num_bots, seconds);
+    printf("Finished games: %llu, failed: %llu, unfinished: %llu\n", (unsigned long long)finished,
+           (unsigned long long)failed, (unsigned long long)(num_bots - finished - failed));
+    printf("Questions: %llu via multicast, %llu via TCP, %llu duplicates, %llu NACKs\n",
+           (unsigned long long)mcast, (unsigned long long)tcp, (unsigned long long)dups,
+           (unsigned long long)nacks);
+    printf("Answers sent: %llu\n\n", (unsigned long long)answers);
+    hist_print(&connect, "connect");
+    hist_print(&auth, "auth");
+    hist_print(&answer, "question->answer");
+}
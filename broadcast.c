@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "broadcast.h"
+#include "conn_pool.h"
+#include "uring.h"
+
+// ---- Fan-out of one Bcast to the players of one loop ----
+typedef struct {
+    LoopTask task;                  // Posted to the owning loop
+    Timer pace;                     // Next batch of a BCAST_PACED fan-out
+    Bcast* msg;                     // Holds one reference
+    int flags;                      // BCAST_* flags
+    int next;                       // First connection not sent to yet
+    int count;
+    ConnHandle conns[];
+} BcastJob;
+
+// ---- Sends of one fan-out batched on a loop's send-only ring (no -u) ----
+typedef struct {
+    ConnHandle h;
+    Bcast* msg;                     // Held by the running job until the batch is submitted
+} BatchSend;
+
+typedef struct {
+    Uring* ring;
+    int count;
+    BatchSend sends[URING_ENTRIES];
+} SendBatch;
+
+static int mcast_socks[MAX_LOOPS];  // One UDP socket per event loop, kept for the server's lifetime
+static SendBatch* batches[MAX_LOOPS];  // NULL with -u or without io_uring
+static int batching[MAX_LOOPS];     // 1 while a fan-out runs on the loop
+static int jobs_pending = 0;        // Fan-outs not finished yet (atomic)
+
+// ---- Open the multicast sockets (after the loops exist) ----
+int broadcast_init(void) {
+    struct in_addr local_if;
+    local_if.s_addr = inet_addr(MULTICAST_IF);
+    unsigned char ttl = 10;
+    for (int i = 0; i < num_loops; i++) {
+        int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            perror("Multicast socket failed");
+            return -1;
+        }
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, (char *)&local_if, sizeof(local_if));
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+        mcast_socks[i] = fd;
+
+        if (use_uring) continue;
+        SendBatch* batch = malloc(sizeof(SendBatch));
+        if (batch && (batch->ring = uring_batch_create())) {
+            batch->count = 0;
+            batches[i] = batch;
+        } else {
+            free(batch);  // No io_uring: fan-outs send directly
+        }
+    }
+    return 0;
+}
+
+int broadcast_mcast_socket(EventLoop* loop) {
+    return mcast_socks[loop->index];
+}
+
+Bcast* bcast_alloc(int len) {
+    Bcast* b = malloc(sizeof(Bcast) + len);
+    if (!b) return NULL;
+    b->refs = 1;
+    b->v2 = NULL;
+    b->len = len;
+    return b;
+}
+
+Bcast* bcast_new(const TrvMessage* msg) {
+    Bcast* b = bcast_alloc(4 + msg->payload_len);
+    if (b) memcpy(b->data, msg, b->len);
+    return b;
+}
+
+Bcast* bcast_new_v2(uint8_t type, uint8_t arg, uint32_t id, const void* payload, int len) {
+    Bcast* b = bcast_alloc(TRV_V2_HEADER_LEN + len);
+    if (!b) return NULL;
+    build_header_v2(b->data, type, arg, id, (uint16_t)len);
+    memcpy(b->data + TRV_V2_HEADER_LEN, payload, len);
+    return b;
+}
+
+void bcast_unref(Bcast* b) {
+    if (__atomic_sub_fetch(&b->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        if (b->v2) bcast_unref(b->v2);
+        free(b);
+    }
+}
+
+// ---- Batch completion: queue what each socket did not take ----
+static void batch_done(int entry, int res, void* arg) {
+    BatchSend* s = &((SendBatch*)arg)->sends[entry];
+    Client* c = conn_get(s->h);
+    if (!c || c->state == CONN_CLOSED) return;
+    if (conn_send_rest(c, s->msg->data, s->msg->len, res) < 0) return;
+    if (c->shutdown_pending && sendq_used(&c->out) == 0) shutdown(c->socket, SHUT_RDWR);
+}
+
+static void batch_submit(SendBatch* batch) {
+    uring_batch_submit(batch->ring, batch_done, batch);
+    batch->count = 0;
+}
+
+int bcast_batch_add(Client* c, Bcast* b) {
+    int index = c->ev.loop->index;
+    SendBatch* batch = batches[index];
+    if (!batch || !batching[index]) return -1;
+    if (batch->count == URING_ENTRIES) batch_submit(batch);
+    int entry = uring_batch_add(batch->ring, c->socket, b->data, b->len);
+    if (entry < 0) return -1;
+    batch->sends[entry].h = c->handle;
+    batch->sends[entry].msg = b;
+    batch->count++;
+    return 0;
+}
+
+// ---- On the owning loop: send to every connection that is still there ----
+// A paced job sends BCAST_PACE_BATCH connections per millisecond tick.
+static void bcast_run(void* arg) {
+    BcastJob* job = (BcastJob*)arg;
+    Bcast* b = job->msg;
+    EventLoop* loop = event_loop_current();
+    SendBatch* batch = batches[loop->index];
+
+    int end = job->count;
+    if ((job->flags & BCAST_PACED) && end - job->next > BCAST_PACE_BATCH) end = job->next + BCAST_PACE_BATCH;
+    batching[loop->index] = 1;
+    for (; job->next < end; job->next++) {
+        Client* c = conn_get(job->conns[job->next]);
+        if (!c || c->state == CONN_CLOSED) continue;  // Left since the fan-out was queued
+        conn_send_bcast(c, b, job->flags | BCAST_BATCH);
+    }
+    batching[loop->index] = 0;
+    if (batch) batch_submit(batch);
+    if (loop->uring) uring_flush(loop->uring);
+    if (job->next < job->count) {
+        event_loop_timer(loop, &job->pace, 1);
+        return;
+    }
+
+    bcast_unref(b);
+    free(job);
+    __atomic_sub_fetch(&jobs_pending, 1, __ATOMIC_RELAXED);
+}
+
+int bcast_fanout(Bcast* b, EventLoop* loop, Client* const* conns, int count, int flags) {
+    if (count == 0) return 0;
+    BcastJob* job = malloc(sizeof(BcastJob) + count * sizeof(ConnHandle));
+    if (!job) return -1;
+    bcast_ref(b);
+    job->msg = b;
+    job->flags = flags;
+    job->next = 0;
+    job->count = count;
+    for (int i = 0; i < count; i++) job->conns[i] = conns[i]->handle;
+    loop_task_init(&job->task, bcast_run, job);
+    timer_init(&job->pace, bcast_run, job);
+    __atomic_add_fetch(&jobs_pending, 1, __ATOMIC_RELAXED);
+    event_loop_post(loop, &job->task);
+    return 0;
+}
+
+int bcast_jobs_pending(void) {
+    return __atomic_load_n(&jobs_pending, __ATOMIC_RELAXED);
+}
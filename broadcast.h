@@ -0,0 +1,62 @@
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#include "server.h"
+
+// ---- Broadcast of one message to many players ----
+// A message is encoded once into a reference-counted Bcast. Fan-out to TCP
+// players is handed to the loop that owns each connection, which sends the
+// shared bytes to all of its players in one batch: one io_uring submission per
+// URING_ENTRIES sends. Without -u the batch goes through a send-only ring per
+// loop and whatever a socket does not take goes to its send queue; without
+// io_uring at all it is one non-blocking send per player. Multicast goes out
+// on long-lived per-loop UDP sockets.
+
+#define BCAST_SHUTDOWN 1            // Shut each socket down after the message
+#define BCAST_BULK 2                // Droppable under the slow-consumer policy
+#define BCAST_PACED 4               // Spread over ticks, BCAST_PACE_BATCH sends per ms
+#define BCAST_BATCH 8               // Set by the fan-out: may go out in the loop's batch
+
+#define BCAST_PACE_BATCH 256        // Sends per loop per millisecond when paced
+
+typedef struct Bcast {
+    int refs;                       // Owners: the encoder plus every queued send (atomic)
+    struct Bcast* v2;               // Same message in wire format v2, or NULL (owned)
+    int len;                        // Bytes in data
+    char data[];                    // Encoded frame
+} Bcast;
+
+// Open one multicast socket per event loop. Returns 0 or -1.
+int broadcast_init(void);
+
+// Multicast socket of a loop (for sends from that loop's thread)
+int broadcast_mcast_socket(EventLoop* loop);
+
+// Encode msg once. The caller holds the first reference.
+Bcast* bcast_new(const TrvMessage* msg);
+
+// Encode a v2 frame once (attach it to the v1 encoding as its v2 member)
+Bcast* bcast_new_v2(uint8_t type, uint8_t arg, uint32_t id, const void* payload, int len);
+
+// Buffer for len bytes for the caller to fill in, with the first reference
+Bcast* bcast_alloc(int len);
+
+static inline void bcast_ref(Bcast* b) {
+    __atomic_add_fetch(&b->refs, 1, __ATOMIC_RELAXED);
+}
+
+void bcast_unref(Bcast* b);
+
+// Send b to the given clients of loop, later on loop's thread. Only their
+// handles are kept, so clients that leave in between are skipped. Takes its
+// own reference; flags are BCAST_* flags. Returns 0, or -1 if out of memory.
+int bcast_fanout(Bcast* b, EventLoop* loop, Client* const* conns, int count, int flags);
+
+// Queue b for c in its loop's batch (inside a fan-out, c's send queue empty).
+// Returns 0, or -1 to send directly instead.
+int bcast_batch_add(Client* c, Bcast* b);
+
+// Fan-outs queued or still being paced out (atomic read)
+int bcast_jobs_pending(void);
+
+#endif // BROADCAST_H
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include "capture.h"
+
+// ---- Single-producer / single-consumer byte ring of one thread ----
+// Records are variable length and may wrap around the end of the ring; head
+// and tail count bytes and sit on their own cache lines, as in trace.c.
+typedef struct {
+    uint64_t head __attribute__((aligned(64)));  // Next byte to write
+    uint64_t dropped;                             // Records lost while the ring was full
+    uint64_t tail __attribute__((aligned(64)));  // Next byte to drain
+    uint8_t data[CAPTURE_RING_BYTES] __attribute__((aligned(64)));
+} CaptureRing;
+
+int capture_enabled = 0;
+
+static CaptureRing* capture_rings[CAPTURE_MAX_THREADS];
+static int capture_ring_count = 0;
+static FILE* capture_file;          // NULL once closed
+static pthread_t capture_thread;
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;  // Drainer against capture_close()
+static uint64_t reported_drops[CAPTURE_MAX_THREADS];
+static sigset_t stop_signals;       // SIGINT and SIGTERM, taken by the drainer
+static __thread CaptureRing* my_ring = NULL;
+
+static uint64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// ---- First record from a thread: give it a ring ----
+static CaptureRing* capture_register(void) {
+    int i = __atomic_fetch_add(&capture_ring_count, 1, __ATOMIC_RELAXED);
+    if (i >= CAPTURE_MAX_THREADS) return NULL;
+    CaptureRing* ring = aligned_alloc(64, sizeof(CaptureRing));
+    if (!ring) return NULL;
+    memset(ring, 0, sizeof(*ring));
+    __atomic_store_n(&capture_rings[i], ring, __ATOMIC_RELEASE);
+    return ring;
+}
+
+// Copy len bytes to ring position pos, wrapping at the end
+static void ring_put(CaptureRing* ring, uint64_t pos, const void* src, uint32_t len) {
+    uint32_t at = pos & (CAPTURE_RING_BYTES - 1);
+    uint32_t first = len < CAPTURE_RING_BYTES - at ? len : CAPTURE_RING_BYTES - at;
+    memcpy(ring->data + at, src, first);
+    memcpy(ring->data, (const uint8_t*)src + first, len - first);
+}
+
+void capture_write(uint8_t kind, uint32_t conn, uint8_t wire, const void* head, uint32_t head_len,
+                   const void* tail, uint32_t tail_len) {
+    CaptureRing* ring = my_ring;
+    if (!ring && !(ring = my_ring = capture_register())) return;
+
+    uint32_t len = head_len + tail_len;
+    if (len > UINT16_MAX) return;
+    uint32_t size = sizeof(CaptureRecord) + CAPTURE_ALIGN(len);
+    uint64_t pos = ring->head;
+    if (pos + size - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > CAPTURE_RING_BYTES) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    CaptureRecord rec = { clock_ns(CLOCK_MONOTONIC), conn, kind, wire, (uint16_t)len };
+    static const uint8_t zeros[8];
+    ring_put(ring, pos, &rec, sizeof(rec));
+    ring_put(ring, pos + sizeof(rec), head, head_len);
+    ring_put(ring, pos + sizeof(rec) + head_len, tail, tail_len);
+    ring_put(ring, pos + sizeof(rec) + len, zeros, CAPTURE_ALIGN(len) - len);
+    __atomic_store_n(&ring->head, pos + size, __ATOMIC_RELEASE);
+}
+
+// ---- Drainer: copy every ring to the file ----
+// Records of one thread stay in order; ./replay orders the threads' records by time.
+static void capture_drain(void) {
+    int count = __atomic_load_n(&capture_ring_count, __ATOMIC_RELAXED);
+    if (count > CAPTURE_MAX_THREADS) count = CAPTURE_MAX_THREADS;
+    for (int i = 0; i < count; i++) {
+        CaptureRing* ring = __atomic_load_n(&capture_rings[i], __ATOMIC_ACQUIRE);
+        if (!ring) continue;  // Still being registered
+
+        uint64_t tail = ring->tail;
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        while (tail != head) {
+            // Write the contiguous run up to the end of the ring in one go
+            uint64_t pos = tail & (CAPTURE_RING_BYTES - 1);
+            uint64_t n = head - tail;
+            if (n > CAPTURE_RING_BYTES - pos) n = CAPTURE_RING_BYTES - pos;
+            fwrite(ring->data + pos, 1, n, capture_file);
+            tail += n;
+            __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+        }
+
+        uint64_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+        if (dropped != reported_drops[i]) {
+            CaptureRecord rec = { clock_ns(CLOCK_MONOTONIC), (uint32_t)(dropped - reported_drops[i]),
+                                  CAPTURE_DROPPED, 0, 0 };
+            fwrite(&rec, sizeof(rec), 1, capture_file);
+            reported_drops[i] = dropped;
+        }
+    }
+    fflush(capture_file);
+}
+
+// Wakes every CAPTURE_DRAIN_MS. SIGINT and SIGTERM are blocked in every
+// other thread and taken here, so the capture is complete when the server is
+// stopped: the rings are written out before the signal is raised again.
+static void* capture_drainer(void* arg) {
+    struct timespec period = { 0, CAPTURE_DRAIN_MS * 1000000L };
+    (void)arg;
+    while (1) {
+        int sig = sigtimedwait(&stop_signals, NULL, &period);
+        if (sig > 0) {
+            capture_close();
+            signal(sig, SIG_DFL);
+            pthread_sigmask(SIG_UNBLOCK, &stop_signals, NULL);
+            kill(getpid(), sig);    // Every other thread blocks it: delivered here
+            return NULL;
+        }
+        pthread_mutex_lock(&drain_lock);
+        if (capture_file) capture_drain();
+        pthread_mutex_unlock(&drain_lock);
+    }
+    return NULL;
+}
+
+void capture_close(void) {
+    pthread_mutex_lock(&drain_lock);
+    if (capture_file) {
+        capture_enabled = 0;
+        capture_drain();
+        fclose(capture_file);
+        capture_file = NULL;
+    }
+    pthread_mutex_unlock(&drain_lock);
+}
+
+// ---- Open the file and start draining ----
+int capture_open(const char* path) {
+    capture_file = fopen(path, "wb");
+    if (!capture_file) {
+        perror("Capture file open failed");
+        return -1;
+    }
+
+    CaptureFileHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CAPTURE_MAGIC, 4);
+    hdr.version = CAPTURE_VERSION;
+    hdr.start_mono_ns = clock_ns(CLOCK_MONOTONIC);
+    hdr.start_real_ns = clock_ns(CLOCK_REALTIME);
+    fwrite(&hdr, sizeof(hdr), 1, capture_file);
+    fflush(capture_file);
+
+    // Threads created from here on inherit the blocked signals
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+    if (pthread_create(&capture_thread, NULL, capture_drainer, NULL) != 0) {
+        perror("Capture thread failed");
+        pthread_sigmask(SIG_UNBLOCK, &stop_signals, NULL);
+        fclose(capture_file);
+        capture_file = NULL;
+        return -1;
+    }
+    pthread_detach(capture_thread);
+    atexit(capture_close);          // exit() after a hot restart hand-over
+    capture_enabled = 1;
+    return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+
+// ---- Traffic capture ----
+// With -r file the server records every frame it receives or sends, per
+// connection, with its CLOCK_MONOTONIC time. Room multicasts are recorded too.
+// Frames are stored as they are on the wire, so ./replay can send a capture
+// to another server build. Like the trace log, each thread appends to its own
+// lock-free ring, and a background thread drains the rings into the file.
+// When a ring is full the record is dropped and counted, never blocking.
+// On exit, SIGINT or SIGTERM the rings are drained one last time, so the end
+// of the last game is in the file.
+
+#define CAPTURE_MAGIC "TRVC"
+#define CAPTURE_VERSION 1
+#define CAPTURE_RING_BYTES (1 << 20)    // Per thread (power of two)
+#define CAPTURE_MAX_THREADS 64
+#define CAPTURE_DRAIN_MS 50             // Drainer wakeup period
+
+// ---- Record kinds ----
+enum {
+    CAPTURE_OPEN = 1,               // Connection accepted (conn = handle); frame = sockaddr_in
+    CAPTURE_IN,                     // Frame received from the client
+    CAPTURE_OUT,                    // Frame(s) queued to the client
+    CAPTURE_MCAST,                  // Frame multicast to a room (conn = room id)
+    CAPTURE_CLOSE,                  // Connection closed by the server
+    CAPTURE_DROPPED                 // Written by the drainer: conn = records lost to full rings
+};
+
+// ---- One record: this header, then len bytes, padded to a multiple of 8 ----
+typedef struct {
+    uint64_t ts_ns;                 // CLOCK_MONOTONIC
+    uint32_t conn;                  // ConnHandle (unique within a capture), or room id
+    uint8_t kind;                   // CAPTURE_* kind
+    uint8_t wire;                   // TRV_WIRE_V1 or TRV_WIRE_V2 framing of the bytes
+    uint16_t len;
+} CaptureRecord;
+
+#define CAPTURE_ALIGN(n) (((n) + 7) & ~7u)
+
+// ---- File header, followed by records ----
+typedef struct {
+    char magic[4];                  // CAPTURE_MAGIC
+    uint32_t version;               // CAPTURE_VERSION
+    uint64_t start_mono_ns;         // CLOCK_MONOTONIC and CLOCK_REALTIME at the same instant
+    uint64_t start_real_ns;
+} CaptureFileHeader;
+
+extern int capture_enabled;
+
+// Create the capture file and start the drainer thread. Returns 0 or -1.
+// Call it before starting other threads: it blocks SIGINT and SIGTERM for
+// them so that the drainer can take the signals and close the file first.
+int capture_open(const char* path);
+
+// Write out everything captured so far and close the file (idempotent)
+void capture_close(void);
+
+// Append a record of head followed by tail (either may be empty) from the calling thread
+void capture_write(uint8_t kind, uint32_t conn, uint8_t wire, const void* head, uint32_t head_len,
+                   const void* tail, uint32_t tail_len);
+
+// Record frame bytes; a single predictable branch when capture is off
+static inline void capture_event(uint8_t kind, uint32_t conn, uint8_t wire, const void* buf, uint32_t len) {
+    if (capture_enabled) capture_write(kind, conn, wire, buf, len, NULL, 0);
+}
+
+#endif // CAPTURE_H
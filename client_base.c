@@ -2,21 +2,51 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
-#include <pthread.h>
+#include <time.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
-#include <sys/time.h>
 #include <sys/types.h>
-#include <sys/select.h>
 #include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 #include "protocol.h"
+#include "frame.h"
 
 // Server and multicast configuration constants
 #define SERVER_IP "192.3.1.1"
 #define SERVER_PORT 8889
 #define MULTICAST_IP "224.1.1.1"
 #define MULTICAST_PORT 12345
+#define KEEPALIVE_INTERVAL_MS 10000 // Longest silence before a keepalive is sent
+#define ACK_FLUSH_MS 50             // An ACK waits this long for the answer (server repairs after 250 ms)
+#define ANSWER_WAIT_MS 30000        // Time the player gets to answer
+
+// ---- One player's game, driven by a single poll() loop ----
+// The TCP socket, the multicast socket, stdin and the timers below are all
+// handled on one thread, so frames are never interleaved and nothing blocks
+// while the player thinks. All state lives here, so a test harness can run
+// many players side by side.
+//
+// Outbound frames are batched into one send(): Nagle is off, so small frames
+// are held in out_buf instead and go out together, an ACK with the answer
+// typed right after it, NACKs with their ACK. Any frame counts as a
+// keepalive, so a keepalive only goes out after KEEPALIVE_INTERVAL_MS
+// without anything else.
+typedef struct {
+    int tcp_sock;
+    int udp_sock;                   // -1 when questions come over TCP only
+    FrameRing tcp_ring;             // Received TCP bytes
+    char out_buf[1024];             // Frames not sent yet
+    int out_len;
+    uint64_t last_send_ms;          // When the last batch went out
+    uint64_t flush_at_ms;           // Send out_buf by then (pending ACK), 0 = nothing pending
+    int next_question;              // question_id doubles as the question sequence number
+    int pending_question;           // Question on screen waiting for an answer, -1 if none
+    uint64_t answer_by_ms;          // Deadline of pending_question
+    int game_over;
+} Player;
 
 // Utility function: Clear input buffer (flush stdin)
 void clear_stdin() {
@@ -24,30 +54,61 @@ void clear_stdin() {
     while ((c = getchar()) != '\n' && c != EOF) {}
 }
 
-// TCP socket and server address (global, used by threads)
-int tcp_sock;
-struct sockaddr_in server_addr;
-int auth_successful = 0; // Authentication status flag
-
-// Thread function declarations
-void* udp_listener_thread(void* arg);         // Receives questions via UDP multicast
-void* keep_alive_thread(void* arg);           // Sends periodic keepalive messages over TCP
-void* tcp_winner_listener_thread(void* arg);  // Listens for game result messages (e.g. winner)
-
-// Helper function: Receive 'length' bytes from a TCP socket (handling partial reads)
-int recv_full(int sock, void* buf, int length) {
-    int received = 0;
-    while (received < length) {
-        int n = recv(sock, (char*)buf + received, length - received, 0);
-        if (n <= 0) return n;
-        received += n;
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Function declarations
+int join_multicast(const char* ip, int port);
+void player_run(Player* p);
+void player_on_frame(Player* p, TrvMessage* msg);
+void player_on_question(Player* p, TrvMessage* msg);
+void player_on_stdin(Player* p);
+void player_on_timers(Player* p);
+
+// Send everything queued (the socket blocks, so only a signal cuts a send short).
+// On an error the connection is lost and the game ends.
+void out_flush(Player* p) {
+    if (p->out_len == 0) return;
+    int sent = 0;
+    while (sent < p->out_len) {
+        int n = send(p->tcp_sock, p->out_buf + sent, p->out_len - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (!p->game_over) printf("\nConnection to the server lost.\n");
+            p->game_over = 1;
+            break;
+        }
+        sent += n;
     }
-    return received;
+    p->out_len = 0;
+    p->flush_at_ms = 0;
+    p->last_send_ms = now_ms();
 }
 
-int main() {
+// Queue one frame; with flush, send it now together with anything pending
+void out_queue(Player* p, uint8_t type, uint8_t question_id, const char* payload, int flush) {
+    TrvMessage msg;
+    build_message(&msg, type, question_id, payload);
+    int len = 4 + msg.payload_len;
+    if (p->out_len + len > (int)sizeof(p->out_buf)) out_flush(p);
+    memcpy(p->out_buf + p->out_len, &msg, len);
+    p->out_len += len;
+    if (flush) out_flush(p);
+}
+
+int main(int argc, char* argv[]) {
     char buffer[1024];
-    pthread_t udp_thread, keepalive_thread, tcp_winner_thread;
+    int tcp_questions = 0;   // 1: questions come over TCP only (-t, or the server has no multicast)
+    char mcast_ip[INET_ADDRSTRLEN] = MULTICAST_IP; // Multicast group of our room (from TRV_AUTH_OK)
+    int mcast_port = MULTICAST_PORT;
+    static Player player;
+    Player* p = &player;
+
+    // -t asks the server for questions over TCP (networks that drop multicast)
+    if (argc > 1 && strcmp(argv[1], "-t") == 0) tcp_questions = 1;
 
     // Prompt user to join the game
     printf("Do you want to join the game? (y/n): ");
@@ -64,44 +125,39 @@ int main() {
     nickname[strcspn(nickname, "\n")] = '\0';
 
     // --- TCP Connection Setup ---
-    tcp_sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in server_addr;
+    p->tcp_sock = socket(AF_INET, SOCK_STREAM, 0);
     server_addr.sin_family = AF_INET;
     server_addr.sin_port = htons(SERVER_PORT);
     inet_pton(AF_INET, SERVER_IP, &server_addr.sin_addr);
     memset(&(server_addr.sin_zero), 0, 8);
 
     // Connect to the server
-    if (connect(tcp_sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+    if (connect(p->tcp_sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
         perror("TCP connection failed");
         return 1;
     }
 
+    // Frames are batched (out_queue), so Nagle would only add delay
+    int nodelay = 1;
+    setsockopt(p->tcp_sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
     // --- Authentication Protocol ---
 
-    // Wait for authentication code from the server (first message, header)
+    // Wait for authentication code from the server (first message)
     TrvMessage msg;
-    int n = recv_full(tcp_sock, &msg, 4);
+    frame_ring_init(&p->tcp_ring);
+    int n = frame_recv(&p->tcp_ring, p->tcp_sock, &msg); // Payload comes back NUL-terminated
     if (n <= 0) {
         printf("Server closed connection unexpectedly.\n");
-        close(tcp_sock);
+        close(p->tcp_sock);
         return 1;
     }
-
-    // Receive full payload if there is one
-    if (msg.payload_len > 0) {
-        n = recv_full(tcp_sock, msg.payload, msg.payload_len);
-        if (n <= 0) {
-            printf("Server closed connection during payload.\n");
-            close(tcp_sock);
-            return 1;
-        }
-    }
-    msg.payload[msg.payload_len] = '\0'; // Null-terminate payload for safe printing
     printf("Server: %s\n", msg.payload);
 
     // If server sends an AUTH_FAIL, exit
     if (msg.type == TRV_AUTH_FAIL) {
-        close(tcp_sock);
+        close(p->tcp_sock);
         return 1;
     }
 
@@ -110,68 +166,51 @@ int main() {
     fgets(buffer, sizeof(buffer), stdin);
     buffer[strcspn(buffer, "\n")] = '\0';
 
-    // Prepare authentication reply message (format: code|nickname)
+    // Prepare authentication reply message (format: code|nickname, plus |tcp with -t)
     char combined[128];
-    snprintf(combined, sizeof(combined), "%s|%s", buffer, nickname);
-    build_message(&msg, TRV_AUTH_REPLY, 0, combined);
-    send(tcp_sock, &msg, 4 + msg.payload_len, 0);
+    snprintf(combined, sizeof(combined), "%s|%s%s", buffer, nickname, tcp_questions ? "|tcp" : "");
+    out_queue(p, TRV_AUTH_REPLY, 0, combined, 1);
 
     // Wait for authentication result from server
-    n = recv_full(tcp_sock, &msg, 4);
+    n = frame_recv(&p->tcp_ring, p->tcp_sock, &msg);
     if (n <= 0) {
         printf("Server closed connection during verification.\n");
-        close(tcp_sock);
+        close(p->tcp_sock);
         return 1;
     }
-    if (msg.payload_len > 0) {
-        n = recv_full(tcp_sock, msg.payload, msg.payload_len);
-        if (n <= 0) {
-            printf("Server closed connection during payload.\n");
-            close(tcp_sock);
-            return 1;
-        }
-    }
-    msg.payload[msg.payload_len] = '\0';
     printf("Server: %s\n", msg.payload);
 
     // Exit if authentication failed
     if (msg.type != TRV_AUTH_OK) {
-        close(tcp_sock);
+        close(p->tcp_sock);
         return 1;
     }
 
-    // --- Main Game Logic Starts Here (threads for game flow) ---
-
-    auth_successful = 1; // Mark as authenticated
-
-    // Start UDP multicast listener (questions)
-    pthread_create(&udp_thread, NULL, udp_listener_thread, NULL);
+    // The welcome message ends with our room's group: "multicast <ip>:<port>",
+    // or "tcp" when questions will come over this connection instead
+    char* group = strstr(msg.payload, "multicast ");
+    if (group) sscanf(group, "multicast %15[0-9.]:%d", mcast_ip, &mcast_port);
+    else tcp_questions = 1;
 
-    // Start keep-alive sender (TCP)
-    pthread_create(&keepalive_thread, NULL, keep_alive_thread, NULL);
+    // --- Main Game Logic Starts Here (one loop until the results arrive) ---
+    p->udp_sock = tcp_questions ? -1 : join_multicast(mcast_ip, mcast_port);
+    p->pending_question = -1;
+    player_run(p);
 
-    // Start winner-listener thread (TCP)
-    pthread_create(&tcp_winner_thread, NULL, tcp_winner_listener_thread, NULL);
-
-    // Main thread waits for game to finish
-    pthread_join(udp_thread, NULL);          // Wait for questions to finish
-    pthread_join(tcp_winner_thread, NULL);   // Wait for winner announcement
-
-    pthread_cancel(keepalive_thread);        // Stop keepalive when game is over
-    close(tcp_sock);                         // Clean up TCP socket
+    if (p->udp_sock >= 0) close(p->udp_sock);
+    close(p->tcp_sock);                      // Clean up TCP socket
     return 0;
 }
 
-// --- Thread: Receives multicast UDP messages (questions from server) ---
-void* udp_listener_thread(void* arg) {
+// ---- Open a UDP socket on our room's multicast group ----
+int join_multicast(const char* ip, int port) {
     int udp_sock;
     struct sockaddr_in mcast_addr;
     struct ip_mreq mreq;
-    char buffer[1024];
 
     udp_sock = socket(AF_INET, SOCK_DGRAM, 0);
     mcast_addr.sin_family = AF_INET;
-    mcast_addr.sin_port = htons(MULTICAST_PORT);
+    mcast_addr.sin_port = htons(port);
     mcast_addr.sin_addr.s_addr = htonl(INADDR_ANY);
 
     // Allow multiple sockets to bind to the same port (for multicast)
@@ -179,93 +218,116 @@ void* udp_listener_thread(void* arg) {
     setsockopt(udp_sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
     bind(udp_sock, (struct sockaddr*)&mcast_addr, sizeof(mcast_addr));
 
+    // Only deliver our own room's group, not every group joined on this host
+    int mcast_all = 0;
+    setsockopt(udp_sock, IPPROTO_IP, IP_MULTICAST_ALL, &mcast_all, sizeof(mcast_all));
+
     // Join the multicast group
-    mreq.imr_multiaddr.s_addr = inet_addr(MULTICAST_IP);
+    mreq.imr_multiaddr.s_addr = inet_addr(ip);
     mreq.imr_interface.s_addr = htonl(INADDR_ANY);
     setsockopt(udp_sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+    return udp_sock;
+}
 
-    // Listen loop: receive trivia questions and handle answers
-    while (1) {
-        TrvMessage msg;
-        int n = recvfrom(udp_sock, &msg, sizeof(msg), 0, NULL, NULL);
-        if (n <= 0) continue;
-
-        msg.payload[msg.payload_len] = '\0';
-
-        if (msg.type == TRV_QUESTION) {
-            // Display question
-            printf("\n📨 Question received:\n%s\n", msg.payload);
-            fflush(stdout);
-
-            // Immediately send ACK over TCP
-            TrvMessage mACK;
-            build_message(&mACK, TRV_ACK, 0, "");
-            send(tcp_sock, &mACK, 4 + mACK.payload_len, 0);
-
-            // Prompt user for answer with a timeout (30 seconds)
-            printf("Your answer (1/2/3/4), 30 sec timeout: ");
-            fflush(stdout);
-
-            fd_set readfds;
-            FD_ZERO(&readfds);
-            FD_SET(STDIN_FILENO, &readfds);
-            struct timeval timeout;
-            timeout.tv_sec = 30;
-            timeout.tv_usec = 0;
-
-            TrvMessage answer;
-            int ret = select(STDIN_FILENO + 1, &readfds, NULL, NULL, &timeout);
-            if (ret > 0) {
-                // User provided input in time
-                fgets(buffer, sizeof(buffer), stdin);
-                buffer[strcspn(buffer, "\n")] = '\0';
-                build_message(&answer, TRV_ANSWER, msg.question_id, buffer);
-                send(tcp_sock, &answer, 4 + answer.payload_len, 0);
-            } else {
-                // Timeout expired; send default answer ("0" = no answer)
-                printf("\n⏰ Time expired. No answer sent.\n");
-                build_message(&answer, TRV_ANSWER, msg.question_id, "0");
-                send(tcp_sock, &answer, 4 + answer.payload_len, 0);
+// ---- The game loop: TCP, multicast and stdin, with the nearest timer as timeout ----
+void player_run(Player* p) {
+    struct pollfd pfds[3];
+    pfds[0].fd = p->tcp_sock;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = p->udp_sock;       // poll() skips a negative fd
+    pfds[1].events = POLLIN;
+    pfds[2].events = POLLIN;
+
+    while (!p->game_over) {
+        // Nearest of: pending ACK flush, answer deadline, keepalive
+        uint64_t now = now_ms();
+        uint64_t due = p->last_send_ms + KEEPALIVE_INTERVAL_MS;
+        if (p->flush_at_ms && p->flush_at_ms < due) due = p->flush_at_ms;
+        if (p->pending_question >= 0 && p->answer_by_ms < due) due = p->answer_by_ms;
+        int timeout = due > now ? (int)(due - now) : 0;
+
+        // stdin is only read while a question waits for its answer
+        pfds[2].fd = p->pending_question >= 0 ? STDIN_FILENO : -1;
+        if (poll(pfds, 3, timeout) < 0) continue;
+
+        if (pfds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            int n = frame_ring_fill(&p->tcp_ring, p->tcp_sock);
+            if (n <= 0) {
+                printf("\nServer closed the connection.\n");
+                return;
             }
+            TrvMessage msg;
+            int res;
+            while (!p->game_over && (res = frame_next(&p->tcp_ring, &msg)) == 1) player_on_frame(p, &msg);
+            if (res < 0) return;    // Corrupt stream
         }
+        if (pfds[1].revents & POLLIN) {
+            char datagram[sizeof(TrvMessage)];
+            TrvMessage msg;
+            int n = recvfrom(p->udp_sock, datagram, sizeof(datagram), 0, NULL, NULL);
+            if (n > 0 && frame_decode(datagram, n, &msg) == 1) player_on_frame(p, &msg);
+        }
+        if (pfds[2].revents & (POLLIN | POLLHUP)) player_on_stdin(p);
+        player_on_timers(p);
     }
-
-    close(udp_sock);
-    return NULL;
 }
 
-// --- Thread: Listens for winner/game over announcement via TCP ---
-void* tcp_winner_listener_thread(void* arg) {
-    TrvMessage msg;
-    while (1) {
-        int n = recv_full(tcp_sock, &msg, 4); // Get header
-        if (n <= 0) break;
-
-        if (msg.payload_len > 0) {
-            n = recv_full(tcp_sock, msg.payload, msg.payload_len); // Get payload
-            if (n <= 0) break;
-        }
+// ---- A frame from the server (TCP) or a multicast question ----
+void player_on_frame(Player* p, TrvMessage* msg) {
+    if (msg->type == TRV_WINNER) {
+        out_flush(p);
+        printf("\n🎉 GAME OVER!\n%s\n", msg->payload);
+        fflush(stdout);
+        p->game_over = 1;
+    } else if (msg->type == TRV_QUESTION) {
+        // Multicast, TCP delivery, or the multicast copy was lost and the server resent it
+        player_on_question(p, msg);
+    }
+}
 
-        msg.payload[msg.payload_len] = '\0';
+void player_on_question(Player* p, TrvMessage* msg) {
+    // ACK every copy so the server stops repairing it. A duplicate's ACK goes
+    // at once; a new question's ACK waits up to ACK_FLUSH_MS for the answer.
+    int duplicate = msg->question_id < p->next_question;
+    out_queue(p, TRV_ACK, msg->question_id, "", duplicate);
+    if (duplicate) return;  // Already shown (multicast and repair both arrived)
+    if (!p->flush_at_ms) p->flush_at_ms = now_ms() + ACK_FLUSH_MS;
+
+    // Gap in the sequence: ask for the questions we never received
+    // (sent right away, together with the ACK)
+    for (int q = p->next_question; q < msg->question_id; q++) {
+        out_queue(p, TRV_NACK, q, "", q == msg->question_id - 1);
+    }
+    p->next_question = msg->question_id + 1;
+
+    // A newer question replaces one still waiting for its answer
+    printf("\n📨 Question #%d received:\n%s\n", msg->question_id + 1, msg->payload);
+    printf("Your answer (1/2/3/4), 30 sec timeout: ");
+    fflush(stdout);
+    p->pending_question = msg->question_id;
+    p->answer_by_ms = now_ms() + ANSWER_WAIT_MS;
+}
 
-        if (msg.type == TRV_WINNER) {
-            printf("\n🎉 GAME OVER!\n%s\n", msg.payload);
-            fflush(stdout);
-            break; // Exit thread after game over
-        }
+// ---- The player typed an answer ----
+void player_on_stdin(Player* p) {
+    char buffer[1024];
+    if (!fgets(buffer, sizeof(buffer), stdin)) {
+        buffer[0] = '\0';   // EOF: no more answers will come
     }
-    return NULL;
+    buffer[strcspn(buffer, "\n")] = '\0';
+    out_queue(p, TRV_ANSWER, p->pending_question, buffer[0] ? buffer : "0", 1);
+    p->pending_question = -1;
 }
 
-// --- Thread: Periodically sends keepalive messages via TCP ---
-void* keep_alive_thread(void* arg) {
-    TrvMessage ka;
-    while (1) {
-        sleep(10); // Send every 10 seconds
-        if (auth_successful) {
-            build_message(&ka, TRV_KEEPALIVE, 0, "");
-            send(tcp_sock, &ka, 4 + ka.payload_len, 0);
-        }
+// ---- Deadlines: ACK flush, unanswered question, keepalive ----
+void player_on_timers(Player* p) {
+    uint64_t now = now_ms();
+    if (p->flush_at_ms && now >= p->flush_at_ms) out_flush(p);
+    if (p->pending_question >= 0 && now >= p->answer_by_ms) {
+        // Timeout expired; send default answer ("0" = no answer)
+        printf("\n⏰ Time expired. No answer sent.\n");
+        out_queue(p, TRV_ANSWER, p->pending_question, "0", 1);
+        p->pending_question = -1;
     }
-    return NULL;
+    if (now - p->last_send_ms >= KEEPALIVE_INTERVAL_MS) out_queue(p, TRV_KEEPALIVE, 0, "", 1);
 }
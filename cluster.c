@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "cluster.h"
+#include "room.h"
+
+int cluster_mode = 0;
+
+// ---- Control connection to the coordinator (loop 0 only) ----
+static struct {
+    EventHandler ev;                // Must be first
+    int sock;
+    FrameRing in;
+} coord;
+
+static void cluster_on_event(EventHandler* h, uint32_t events);
+
+int cluster_connect(const char* addr, int player_port) {
+    char host[64];
+    int port = CLUSTER_PORT;
+    if (sscanf(addr, "%63[^:]:%d", host, &port) < 1) {
+        fprintf(stderr, "Bad coordinator address '%s'\n", addr);
+        return -1;
+    }
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &sa.sin_addr) != 1) {
+        fprintf(stderr, "Bad coordinator address '%s'\n", addr);
+        return -1;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&sa, sizeof(sa)) < 0) {
+        perror("Coordinator connect failed");
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    if (cluster_adopt(fd, NULL, 0) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    char hello[16];
+    snprintf(hello, sizeof(hello), "%d", player_port);
+    cluster_send(TRV_CLUSTER_HELLO, 0, hello);
+    return 0;
+}
+
+int cluster_handover(void* pending, uint32_t* len) {
+    if (!cluster_mode) return -1;
+    *len = frame_ring_peek(&coord.in, pending);
+    return coord.sock;
+}
+
+int cluster_adopt(int fd, const void* pending, uint32_t len) {
+    coord.sock = fd;
+    frame_ring_init(&coord.in);
+    if (len) frame_ring_write(&coord.in, pending, len);
+    coord.ev.on_event = cluster_on_event;
+    if (event_loop_add(&loops[0], fd, &coord.ev, EPOLLIN | EPOLLRDHUP | EPOLLET) < 0) {
+        perror("epoll_ctl failed");
+        return -1;
+    }
+    cluster_mode = 1;
+    return 0;
+}
+
+// Control frames are small and rare, so they are sent directly
+void cluster_send(uint8_t type, uint32_t id, const char* payload) {
+    char frame[TRV_V2_HEADER_LEN + TRV_MAX_PAYLOAD];
+    int len = build_message_v2(frame, type, id, payload);
+    if (send(coord.sock, frame, len, MSG_NOSIGNAL) != len) perror("send failed");
+}
+
+// ---- Coordinator frames: each one moves the cluster room a step ----
+static void cluster_on_event(EventHandler* h, uint32_t events) {
+    (void)h;
+    (void)events;
+    while (1) {
+        int n = frame_ring_fill(&coord.in, coord.sock);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            fprintf(stderr, "Lost the coordinator; no more games on this node.\n");
+            event_loop_del(&loops[0], coord.sock);
+            close(coord.sock);
+            room_cluster_lost();
+            return;
+        }
+        TrvMessage msg;
+        uint32_t id;
+        uint8_t arg;
+        while (frame_next_v2(&coord.in, &msg, &id, &arg) == 1) {
+            if (msg.type == TRV_CLUSTER_OPEN) room_cluster_open((uint32_t)strtoul(msg.payload, NULL, 10));
+            else if (msg.type == TRV_CLUSTER_BEGIN) room_cluster_begin((unsigned)strtoul(msg.payload, NULL, 10));
+            else if (msg.type == TRV_CLUSTER_QUESTION) room_cluster_question(id);
+            else if (msg.type == TRV_CLUSTER_END) room_cluster_end();
+            else if (msg.type == TRV_CLUSTER_RESULT) room_cluster_result(msg.payload);
+        }
+        if (n < 0) return;          // EAGAIN: wait for the next edge
+    }
+}
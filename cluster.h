@@ -0,0 +1,38 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include "server.h"
+#include "scoreboard.h"
+
+// ---- Cluster node: one logical game spread over several server processes ----
+// With -k host:port the server joins a coordinator (coordinator.c) instead of
+// scheduling its own games. It then hosts one room, its partition of the
+// coordinator's game: the coordinator opens and closes the lobby and runs the
+// question clock, and merges every node's local top K into the results that
+// each node sends to its own players. The control connection and the cluster
+// room are both driven by loop 0.
+
+#define CLUSTER_PORT 8890           // Default coordinator port
+#define CLUSTER_MAX_NODES 16        // One scoreboard shard per node at the coordinator
+
+_Static_assert(CLUSTER_MAX_NODES <= SCOREBOARD_SHARDS, "the coordinator merges one shard per node");
+
+extern int cluster_mode;            // 1 with -k
+
+// Connect to the coordinator at "host[:port]" and register the connection
+// with loop 0 (before the loops run). Returns 0 or -1.
+int cluster_connect(const char* addr, int player_port);
+
+// Send a control frame (v2 header, id = question id or 0) to the coordinator (loop 0 only)
+void cluster_send(uint8_t type, uint32_t id, const char* payload);
+
+// Hot restart: the coordinator connection's socket, with its unparsed bytes
+// copied to pending (FRAME_RING_SIZE bytes). Returns the socket, or -1 if this
+// server is not a cluster node.
+int cluster_handover(void* pending, uint32_t* len);
+
+// Hot restart: carry on with the old server's coordinator connection
+// (before the loops run). Returns 0 or -1.
+int cluster_adopt(int fd, const void* pending, uint32_t len);
+
+#endif // CLUSTER_H
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "conn_pool.h"
+
+static Client* slabs[CONN_SLABS];          // Mapped on first use
+static int slots_mapped = 0;               // Slots in mapped slabs
+static uint32_t free_list[MAX_CLIENTS];    // Stack of free slot numbers
+static int num_free = 0;
+static int live = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline Client* slot(uint32_t i) {
+    return &slabs[i >> CONN_SLAB_BITS][i & (CONN_SLAB_CLIENTS - 1)];
+}
+
+// ---- Map the next slab and put its slots on the free list (pool_lock held) ----
+static int grow(void) {
+    if (slots_mapped == MAX_CLIENTS) return -1;
+    Client* slab = mmap(NULL, CONN_SLAB_CLIENTS * sizeof(Client), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (slab == MAP_FAILED) {
+        perror("mmap connection slab failed");
+        return -1;
+    }
+    slabs[slots_mapped >> CONN_SLAB_BITS] = slab;
+
+    // Generation starts at 1 so that handle 0 is never valid
+    for (int i = CONN_SLAB_CLIENTS - 1; i >= 0; i--) {
+        uint32_t n = slots_mapped + i;
+        slab[i].handle = (1u << CONN_INDEX_BITS) | n;
+        slab[i].state = CONN_CLOSED;
+        free_list[num_free++] = n;
+    }
+    __atomic_store_n(&slots_mapped, slots_mapped + CONN_SLAB_CLIENTS, __ATOMIC_RELEASE);  // Publish to conn_get()
+    return 0;
+}
+
+Client* conn_alloc(void) {
+    pthread_mutex_lock(&pool_lock);
+    if (num_free == 0 && grow() < 0) {
+        pthread_mutex_unlock(&pool_lock);
+        return NULL;
+    }
+    Client* c = slot(free_list[--num_free]);
+    live++;
+    pthread_mutex_unlock(&pool_lock);
+
+    ConnHandle h = c->handle;
+    memset(c, 0, sizeof(*c));
+    c->handle = h;
+    return c;
+}
+
+void conn_free(Client* c) {
+    // Bump the generation first so stale handles stop resolving before reuse
+    uint32_t next = (c->handle >> CONN_INDEX_BITS) + 1;
+    if ((next & ((1u << (32 - CONN_INDEX_BITS)) - 1)) == 0) next = 1;
+    c->state = CONN_CLOSED;
+    __atomic_store_n(&c->handle, (next << CONN_INDEX_BITS) | conn_index(c->handle), __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&pool_lock);
+    free_list[num_free++] = conn_index(c->handle);
+    live--;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+Client* conn_get(ConnHandle h) {
+    uint32_t i = conn_index(h);
+    if (i >= (uint32_t)__atomic_load_n(&slots_mapped, __ATOMIC_ACQUIRE)) return NULL;
+    Client* c = slot(i);
+    return __atomic_load_n(&c->handle, __ATOMIC_ACQUIRE) == h ? c : NULL;
+}
+
+Client* conn_slot(uint32_t i) {
+    if (i >= (uint32_t)__atomic_load_n(&slots_mapped, __ATOMIC_ACQUIRE)) return NULL;
+    Client* c = slot(i);
+    return c->state == CONN_CLOSED ? NULL : c;
+}
+
+int conn_count(void) {
+    pthread_mutex_lock(&pool_lock);
+    int n = live;
+    pthread_mutex_unlock(&pool_lock);
+    return n;
+}
@@ -0,0 +1,43 @@
+#ifndef CONN_POOL_H
+#define CONN_POOL_H
+
+#include "server.h"
+
+// ---- Slab pool of connection objects ----
+// A Client carries its receive ring, so one allocation covers all per-connection
+// state. Slabs of CONN_SLAB_CLIENTS are mapped the first time the number of
+// live connections needs them and are never returned; after that, connects and
+// disconnects only push and pop a free list. Memory tracks the peak number of
+// connections, not the number of connections ever made.
+
+#define CONN_SLAB_BITS 10
+#define CONN_SLAB_CLIENTS (1 << CONN_SLAB_BITS)
+#define CONN_SLABS (MAX_CLIENTS / CONN_SLAB_CLIENTS)
+
+_Static_assert(MAX_CLIENTS % CONN_SLAB_CLIENTS == 0, "MAX_CLIENTS must be a whole number of slabs");
+_Static_assert(MAX_CLIENTS <= (1 << CONN_INDEX_BITS), "slot numbers must fit in a handle");
+_Static_assert(MAX_CLIENTS <= SENDQ_MAX_BUFFERS, "every connection must be able to get a send buffer");
+
+// Slot number of a handle (stable for the life of the connection)
+static inline uint32_t conn_index(ConnHandle h) {
+    return h & ((1u << CONN_INDEX_BITS) - 1);
+}
+
+// Take a free, zeroed Client with a fresh handle, or NULL if MAX_CLIENTS are in use
+Client* conn_alloc(void);
+
+// Return a closed Client to the pool. Its handle goes stale immediately.
+void conn_free(Client* c);
+
+// Client a handle refers to, or NULL if that connection has been freed since
+// (even if the slot now holds a different connection)
+Client* conn_get(ConnHandle h);
+
+// Live connection in slot i, or NULL. For walking every connection while
+// nothing else runs (hot restart).
+Client* conn_slot(uint32_t i);
+
+// Connections currently allocated
+int conn_count(void);
+
+#endif // CONN_POOL_H
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <sys/random.h>
+#include "cookie.h"
+
+static uint64_t master[2];          // Written by cookie_init() (or a hot restart), read-only after
+
+#define ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+#define SIPROUND do {                                                        \
+        v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32);            \
+        v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2;                               \
+        v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0;                               \
+        v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32);            \
+    } while (0)
+
+// ---- SipHash-2-4 of one 64-bit word under key k ----
+// Every input here fits in 8 bytes, so this is the reference algorithm with
+// one message block followed by the length block.
+static uint64_t siphash_u64(const uint64_t k[2], uint64_t m) {
+    uint64_t v0 = k[0] ^ 0x736f6d6570736575ULL;
+    uint64_t v1 = k[1] ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = k[0] ^ 0x6c7967656e657261ULL;
+    uint64_t v3 = k[1] ^ 0x7465646279746573ULL;
+    uint64_t b = (uint64_t)8 << 56;  // Message length, no tail bytes
+
+    v3 ^= m;
+    SIPROUND; SIPROUND;
+    v0 ^= m;
+    v3 ^= b;
+    SIPROUND; SIPROUND;
+    v0 ^= b;
+    v2 ^= 0xff;
+    SIPROUND; SIPROUND; SIPROUND; SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+int cookie_init(void) {
+    if (getrandom(master, sizeof(master), 0) != sizeof(master)) {
+        perror("getrandom failed");
+        return -1;
+    }
+    return 0;
+}
+
+void cookie_export(uint64_t key[2]) {
+    key[0] = master[0];
+    key[1] = master[1];
+}
+
+void cookie_import(const uint64_t key[2]) {
+    master[0] = key[0];
+    master[1] = key[1];
+}
+
+// Code of a peer in one epoch, under that epoch's key
+static uint32_t cookie_at(const struct sockaddr_in* peer, uint64_t epoch) {
+    uint64_t key[2] = { siphash_u64(master, epoch << 1), siphash_u64(master, epoch << 1 | 1) };
+    uint64_t who = (uint64_t)peer->sin_addr.s_addr << 16 | peer->sin_port;
+    return (uint32_t)(siphash_u64(key, who) % COOKIE_MODULUS);
+}
+
+uint32_t cookie_make(const struct sockaddr_in* peer, uint64_t now) {
+    return cookie_at(peer, now / COOKIE_EPOCH_MS);
+}
+
+int cookie_check(const struct sockaddr_in* peer, uint32_t code, uint64_t now) {
+    uint64_t epoch = now / COOKIE_EPOCH_MS;
+    if (code == cookie_at(peer, epoch)) return 1;
+    return epoch > 0 && code == cookie_at(peer, epoch - 1);
+}
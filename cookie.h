@@ -0,0 +1,32 @@
+#ifndef COOKIE_H
+#define COOKIE_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+// ---- Stateless auth cookies ----
+// The TRV_AUTH_CODE challenge is a SipHash-2-4 MAC of the peer's address and
+// port, keyed by a secret that changes every COOKIE_EPOCH_MS (derived from a
+// random master key and the epoch number). Nothing is stored per connection:
+// a reply is checked by recomputing the MAC for the current and the previous
+// epoch, so a code stays valid for one to two epochs. Codes are decimal so
+// players can type them.
+
+#define COOKIE_EPOCH_MS 60000
+#define COOKIE_MODULUS 1000000      // Six-digit codes
+
+// Pick the random master key (before any loop runs). Returns 0 or -1.
+int cookie_init(void);
+
+// Code for a peer at monotonic time now (ms); any thread
+uint32_t cookie_make(const struct sockaddr_in* peer, uint64_t now);
+
+// 1 if code is the peer's code for this or the previous epoch, else 0
+int cookie_check(const struct sockaddr_in* peer, uint32_t code, uint64_t now);
+
+// Hot restart: copy the master key out, or adopt the old server's key
+// (before any loop runs), so codes already handed out stay valid
+void cookie_export(uint64_t key[2]);
+void cookie_import(const uint64_t key[2]);
+
+#endif // COOKIE_H
@@ -0,0 +1,318 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "protocol.h"
+#include "frame.h"
+#include "event_loop.h"
+#include "scoreboard.h"
+#include "cluster.h"
+
+// ---- Cluster coordinator ----
+// Runs one logical game across several server nodes (server -k). Once -n
+// nodes have joined it plays games back to back: open every node's lobby,
+// close them together, run the question clock, then merge the nodes' local
+// top K into one set of results for all of them. A question closes early
+// once every node reports that all of its players answered. Nodes are plain
+// TCP peers, so a whole cluster can run as local processes on loopback.
+
+#define SCORES_TIMEOUT_MS 2000      // Longest wait for the nodes' scores
+
+// ---- Coordinator phases ----
+enum {
+    CO_WAITING,                     // Fewer than -n nodes so far
+    CO_LOBBY,                       // Lobbies open on every node
+    CO_STARTING,                    // Lobbies closed, first question due
+    CO_QUESTION,                    // question is open
+    CO_SCORES                       // Game over, collecting scores
+};
+
+// ---- One server node ----
+typedef struct {
+    EventHandler ev;                // Must be first
+    int sock;                       // -1 if the slot is free
+    FrameRing in;
+    int port;                       // Node's player port (from TRV_CLUSTER_HELLO)
+    int in_game;                    // 1 if its lobby opened with the current game
+    int done;                       // Question + 1 the node reported all answered
+    int reported;                   // 1 once its scores arrived for this game
+} Node;
+
+EventLoop loop;
+EventHandler listener;
+int listen_sock;
+Node nodes[CLUSTER_MAX_NODES];
+int live_nodes = 0;
+int expected_nodes = 1;             // -n
+int max_games = 0;                  // -g, 0 = run forever
+int games_played = 0;
+
+int phase = CO_WAITING;
+int question;                       // Open question while CO_QUESTION
+uint32_t game_id = 0;
+Timer phase_timer;
+Scoreboard merged;                  // One shard per node
+int total_players;
+
+// ---- Function declarations ----
+void accept_nodes(EventHandler* h, uint32_t events);
+void node_on_event(EventHandler* h, uint32_t events);
+void node_on_frame(Node* n, TrvMessage* msg, uint32_t qid);
+void node_gone(Node* n);
+void question_check(void);
+void scores_check(void);
+void send_all(uint8_t type, uint32_t id, const char* payload);
+void game_open(void);
+void game_step(void* arg);
+void game_next_question(void);
+void game_publish(void);
+
+int main(int argc, char* argv[]) {
+    int port = CLUSTER_PORT;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:p:g:")) != -1) {
+        switch (opt) {
+            case 'n': expected_nodes = atoi(optarg); break;
+            case 'p': port = atoi(optarg); break;
+            case 'g': max_games = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-n nodes] [-p port] [-g games]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (expected_nodes < 1) expected_nodes = 1;
+    if (expected_nodes > CLUSTER_MAX_NODES) expected_nodes = CLUSTER_MAX_NODES;
+    for (int i = 0; i < CLUSTER_MAX_NODES; i++) nodes[i].sock = -1;
+
+    listen_sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int reuse = 1;
+    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    setsockopt(listen_sock, IPPROTO_TCP, TCP_NODELAY, &reuse, sizeof(reuse));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = INADDR_ANY;
+    if (bind(listen_sock, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_sock, 64) < 0) {
+        perror("Failed to open coordinator socket");
+        return 1;
+    }
+
+    if (event_loop_init(&loop, 0) < 0) return 1;
+    listener.on_event = accept_nodes;
+    event_loop_add(&loop, listen_sock, &listener, EPOLLIN | EPOLLET);
+    timer_init(&phase_timer, game_step, NULL);
+
+    printf("Coordinator on port %d, waiting for %d node(s)...\n", port, expected_nodes);
+    event_loop_run(&loop);
+    return 0;
+}
+
+// ---- A node connects: take a free slot ----
+void accept_nodes(EventHandler* h, uint32_t events) {
+    (void)h;
+    (void)events;
+    while (1) {
+        int fd = accept4(listen_sock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept failed");
+            return;
+        }
+        Node* n = NULL;
+        for (int i = 0; i < CLUSTER_MAX_NODES && !n; i++) {
+            if (nodes[i].sock < 0) n = &nodes[i];
+        }
+        if (!n) {
+            fprintf(stderr, "Too many nodes (max %d)\n", CLUSTER_MAX_NODES);
+            close(fd);
+            continue;
+        }
+        memset(n, 0, sizeof(*n));
+        n->sock = fd;
+        n->ev.on_event = node_on_event;
+        frame_ring_init(&n->in);
+        if (event_loop_add(&loop, fd, &n->ev, EPOLLIN | EPOLLRDHUP | EPOLLET) < 0) {
+            perror("epoll_ctl failed");
+            close(fd);
+            n->sock = -1;
+            continue;
+        }
+        live_nodes++;
+    }
+}
+
+// ---- Node socket readable: handle every complete frame ----
+void node_on_event(EventHandler* h, uint32_t events) {
+    Node* n = (Node*)h;
+    (void)events;
+    while (n->sock >= 0) {
+        int res = frame_ring_fill(&n->in, n->sock);
+        if (res == 0 || (res < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            node_gone(n);
+            return;
+        }
+        TrvMessage msg;
+        uint32_t id;
+        uint8_t arg;
+        while (n->sock >= 0 && frame_next_v2(&n->in, &msg, &id, &arg) == 1) node_on_frame(n, &msg, id);
+        if (res < 0) return;        // EAGAIN: wait for the next edge
+    }
+}
+
+void node_on_frame(Node* n, TrvMessage* msg, uint32_t qid) {
+    int idx = (int)(n - nodes);
+    if (msg->type == TRV_CLUSTER_HELLO) {
+        n->port = atoi(msg->payload);
+        printf("🔗 Node %d joined (players on port %d), %d/%d node(s).\n", idx, n->port, live_nodes, expected_nodes);
+        if (phase == CO_WAITING && live_nodes >= expected_nodes) game_open();
+    } else if (msg->type == TRV_CLUSTER_DONE && phase == CO_QUESTION && qid == (uint32_t)question) {
+        n->done = question + 1;
+        question_check();
+    } else if (msg->type == TRV_CLUSTER_SCORES && phase == CO_SCORES && !n->reported) {
+        // "players\nscore nickname\n..."; player ids only need to be unique per shard
+        n->reported = 1;
+        char* saveptr;
+        char* line = strtok_r(msg->payload, "\n", &saveptr);
+        if (line) total_players += atoi(line);
+        uint32_t id = 0;
+        while ((line = strtok_r(NULL, "\n", &saveptr)) != NULL) {
+            int score;
+            char nickname[32];
+            if (sscanf(line, "%d %31[^\n]", &score, nickname) == 2) {
+                scoreboard_update(&merged, idx, id++, nickname, score);
+            }
+        }
+        scores_check();
+    }
+}
+
+// ---- Close the question early once every node's players answered ----
+// Nodes that joined after the lobby opened have no players in this game.
+void question_check(void) {
+    for (int i = 0; i < CLUSTER_MAX_NODES; i++) {
+        if (nodes[i].sock >= 0 && nodes[i].in_game && nodes[i].done != question + 1) return;
+    }
+    printf("⏩ Every node's players answered question %d.\n", question + 1);
+    timer_cancel(&phase_timer);
+    game_next_question();
+}
+
+// ---- Publish the results once every node reported its scores ----
+void scores_check(void) {
+    for (int i = 0; i < CLUSTER_MAX_NODES; i++) {
+        if (nodes[i].sock >= 0 && nodes[i].in_game && !nodes[i].reported) return;
+    }
+    timer_cancel(&phase_timer);
+    game_publish();
+}
+
+// ---- A node disconnected: the game goes on without it ----
+// It may have been the last one the open question or the scores waited for.
+void node_gone(Node* n) {
+    printf("🔌 Node %d left.\n", (int)(n - nodes));
+    event_loop_del(&loop, n->sock);
+    close(n->sock);
+    n->sock = -1;
+    live_nodes--;
+    if (live_nodes == 0) {
+        timer_cancel(&phase_timer);
+        phase = CO_WAITING;
+        printf("No nodes left, waiting for %d node(s)...\n", expected_nodes);
+    } else if (phase == CO_QUESTION) {
+        question_check();
+    } else if (phase == CO_SCORES) {
+        scores_check();
+    }
+}
+
+// Control frames are small and rare, so they are sent directly. A node whose
+// socket does not take a whole frame has fallen hopelessly behind, and half a
+// frame would break its stream: it is shut down, and the loop then reports
+// it gone (never from inside a send_all caller).
+void send_all(uint8_t type, uint32_t id, const char* payload) {
+    char frame[TRV_V2_HEADER_LEN + TRV_MAX_PAYLOAD];
+    int len = build_message_v2(frame, type, id, payload);
+    for (int i = 0; i < CLUSTER_MAX_NODES; i++) {
+        if (nodes[i].sock < 0) continue;
+        if (send(nodes[i].sock, frame, len, MSG_NOSIGNAL) != len) {
+            fprintf(stderr, "Node %d is not keeping up, dropping it\n", i);
+            shutdown(nodes[i].sock, SHUT_RDWR);
+        }
+    }
+}
+
+// ---- Open the next game's lobby on every node ----
+void game_open(void) {
+    for (int i = 0; i < CLUSTER_MAX_NODES; i++) {
+        nodes[i].in_game = nodes[i].sock >= 0;
+        nodes[i].done = 0;
+    }
+    char payload[16];
+    snprintf(payload, sizeof(payload), "%u", ++game_id);
+    send_all(TRV_CLUSTER_OPEN, 0, payload);
+    phase = CO_LOBBY;
+    event_loop_timer(&loop, &phase_timer, GAME_LOBBY_TIME * 1000);
+    printf("🚪 Game %u: lobbies open on %d node(s) for %d seconds...\n", game_id, live_nodes, GAME_LOBBY_TIME);
+}
+
+// ---- Phase timer: the question clock of the whole cluster ----
+void game_step(void* arg) {
+    (void)arg;
+    if (phase == CO_LOBBY) {
+        // One seed for every node, so they all pick the same questions
+        char payload[16];
+        snprintf(payload, sizeof(payload), "%u", (unsigned)now_ms() ^ (game_id * 2654435761u));
+        send_all(TRV_CLUSTER_BEGIN, 0, payload);
+        phase = CO_STARTING;
+        event_loop_timer(&loop, &phase_timer, 2000);  // Same 2 s head start as a standalone room
+        printf("Game %u: lobbies closed. Starting game!\n", game_id);
+    } else if (phase == CO_STARTING) {
+        question = -1;
+        game_next_question();
+    } else if (phase == CO_QUESTION) {
+        game_next_question();
+    } else if (phase == CO_SCORES) {
+        game_publish();             // Some node never answered; go with what arrived
+    }
+}
+
+// ---- Open the next question, or end the game after the last one ----
+void game_next_question(void) {
+    if (question + 1 < QUESTIONS_PER_GAME) {
+        question++;
+        phase = CO_QUESTION;
+        send_all(TRV_CLUSTER_QUESTION, (uint32_t)question, "");
+        event_loop_timer(&loop, &phase_timer, ANSWER_TIMEOUT * 1000);
+        printf("📨 Game %u: question %d.\n", game_id, question + 1);
+        return;
+    }
+    scoreboard_reset(&merged);
+    total_players = 0;
+    for (int i = 0; i < CLUSTER_MAX_NODES; i++) nodes[i].reported = 0;
+    phase = CO_SCORES;
+    send_all(TRV_CLUSTER_END, 0, "");
+    event_loop_timer(&loop, &phase_timer, SCORES_TIMEOUT_MS);
+}
+
+// ---- Merge the nodes' top K and send everyone the same results ----
+void game_publish(void) {
+    ScoreEntry top[LEADERBOARD_K];
+    int n = scoreboard_top(&merged, CLUSTER_MAX_NODES, top, LEADERBOARD_K);
+    char message[TRV_MAX_PAYLOAD];
+    scoreboard_format(top, n, total_players, message, sizeof(message));
+    send_all(TRV_CLUSTER_RESULT, 0, message);
+    printf("Game %u:%s\nGame %u over.\n", game_id, message, game_id);
+
+    if (max_games > 0 && ++games_played >= max_games) {
+        event_loop_stop(&loop);
+        return;
+    }
+    game_open();
+}
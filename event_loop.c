@@ -0,0 +1,148 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "event_loop.h"
+
+// Longest epoll_wait() so event_loop_stop() is noticed even with no timers
+#define EVENT_LOOP_MAX_WAIT_MS 1000
+
+static __thread EventLoop* current_loop = NULL;
+
+static void event_loop_on_wake(EventHandler* h, uint32_t events);
+
+// ---- Create the epoll instance ----
+int event_loop_init(EventLoop* loop, int index) {
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd < 0) {
+        perror("epoll_create1 failed");
+        return -1;
+    }
+    loop->index = index;
+    loop->cpu = -1;
+    loop->running = 0;
+    timer_wheel_init(&loop->timers, now_ms());
+
+    loop->tasks = NULL;
+    loop->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    loop->wake.on_event = event_loop_on_wake;
+    if (loop->wakefd < 0 || event_loop_add(loop, loop->wakefd, &loop->wake, EPOLLIN | EPOLLET) < 0) {
+        perror("eventfd failed");
+        return -1;
+    }
+    return 0;
+}
+
+// ---- Register / modify / remove file descriptors ----
+int event_loop_add(EventLoop* loop, int fd, EventHandler* h, uint32_t events) {
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = h;
+    h->loop = loop;
+    return epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+int event_loop_mod(EventLoop* loop, int fd, EventHandler* h, uint32_t events) {
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = h;
+    return epoll_ctl(loop->epfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+int event_loop_del(EventLoop* loop, int fd) {
+    return epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+// ---- Main dispatch loop ----
+// Sleeps until the next fd event or the next timer, whichever comes first.
+void event_loop_run(EventLoop* loop) {
+    struct epoll_event events[EVENT_LOOP_BATCH];
+    current_loop = loop;
+    if (loop->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(loop->cpu, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err) fprintf(stderr, "Pinning loop %d to CPU %d failed: %s\n", loop->index, loop->cpu, strerror(err));
+    }
+    loop->running = 1;
+    while (loop->running) {
+        int64_t timeout = timer_wheel_timeout(&loop->timers, now_ms());
+        if (timeout < 0 || timeout > EVENT_LOOP_MAX_WAIT_MS) timeout = EVENT_LOOP_MAX_WAIT_MS;
+
+        int n = epoll_wait(loop->epfd, events, EVENT_LOOP_BATCH, (int)timeout);
+        if (n < 0) {
+            if (errno != EINTR) {
+                perror("epoll_wait failed");
+                break;
+            }
+            n = 0;
+        }
+        for (int i = 0; i < n; i++) {
+            EventHandler* h = (EventHandler*)events[i].data.ptr;
+            h->on_event(h, events[i].events);
+        }
+        timer_wheel_advance(&loop->timers, now_ms());
+    }
+}
+
+// ---- Cross-thread tasks ----
+// Producers push onto a lock-free stack; only the push that finds it empty
+// needs to write the eventfd, since the loop drains the whole stack at once.
+void event_loop_post(EventLoop* loop, LoopTask* task) {
+    if (__atomic_exchange_n(&task->queued, 1, __ATOMIC_ACQ_REL)) return;  // Already pending
+
+    LoopTask* head = __atomic_load_n(&loop->tasks, __ATOMIC_RELAXED);
+    do {
+        task->next = head;
+    } while (!__atomic_compare_exchange_n(&loop->tasks, &head, task, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    if (!head) {
+        uint64_t one = 1;
+        if (write(loop->wakefd, &one, sizeof(one)) < 0 && errno != EAGAIN) perror("eventfd write failed");
+    }
+}
+
+static void event_loop_on_wake(EventHandler* h, uint32_t events) {
+    EventLoop* loop = (EventLoop*)((char*)h - offsetof(EventLoop, wake));
+    uint64_t count;
+    (void)events;
+    while (read(loop->wakefd, &count, sizeof(count)) > 0) {}
+
+    // Take the whole stack, then run it oldest first
+    LoopTask* list = __atomic_exchange_n(&loop->tasks, NULL, __ATOMIC_ACQUIRE);
+    LoopTask* fifo = NULL;
+    while (list) {
+        LoopTask* next = list->next;
+        list->next = fifo;
+        fifo = list;
+        list = next;
+    }
+    while (fifo) {
+        LoopTask* t = fifo;
+        fifo = t->next;
+        __atomic_store_n(&t->queued, 0, __ATOMIC_RELEASE);  // May be posted again from run()
+        t->run(t->arg);
+    }
+}
+
+static void* event_loop_thread(void* arg) {
+    event_loop_run((EventLoop*)arg);
+    return NULL;
+}
+
+int event_loop_start(EventLoop* loop) {
+    return pthread_create(&loop->thread, NULL, event_loop_thread, loop);
+}
+
+void event_loop_stop(EventLoop* loop) {
+    loop->running = 0;
+}
+
+EventLoop* event_loop_current(void) {
+    return current_loop;
+}
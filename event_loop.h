@@ -0,0 +1,86 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include "timer_wheel.h"
+
+// Max events returned by a single epoll_wait() call
+#define EVENT_LOOP_BATCH 256
+
+struct EventLoop;
+
+// ---- Work handed to a loop from another thread ----
+// Embed one in the object the work is about; posting it again while it is still
+// queued is a no-op, so a burst of requests runs the callback once.
+typedef struct LoopTask {
+    struct LoopTask* next;          // Next task in the loop's queue
+    void (*run)(void* arg);         // Called on the loop thread
+    void* arg;
+    int queued;                     // 1 while on a queue (atomic)
+} LoopTask;
+
+// Anything registered with a loop embeds an EventHandler.
+// The handler pointer is stored in epoll_data, so the callback receives it back
+// and can recover the enclosing object (e.g. a Client) from it.
+typedef struct EventHandler {
+    void (*on_event)(struct EventHandler* h, uint32_t events); // Called from the loop thread
+    struct EventLoop* loop;                                     // Loop the fd is registered with
+} EventHandler;
+
+// One epoll instance and its timers, driven by one thread
+typedef struct EventLoop {
+    int epfd;                 // epoll file descriptor
+    int index;                // Position of this loop in the server's loop array
+    int cpu;                  // CPU the loop's thread pins itself to, or -1
+    pthread_t thread;         // Thread running event_loop_run()
+    volatile int running;     // Cleared by event_loop_stop()
+    TimerWheel timers;        // Timers of this loop (only touched from its thread)
+    int wakefd;               // eventfd that wakes the loop when tasks are posted
+    EventHandler wake;        // Registration of wakefd
+    LoopTask* tasks;          // Posted tasks, newest first (atomic)
+    struct Uring* uring;      // io_uring backend of this loop, or NULL (-u)
+} EventLoop;
+
+// Create the epoll instance. Returns 0 on success, -1 on error.
+int event_loop_init(EventLoop* loop, int index);
+
+// Register fd with the loop. events is usually EPOLLIN | EPOLLET (edge-triggered).
+int event_loop_add(EventLoop* loop, int fd, EventHandler* h, uint32_t events);
+
+// Change the event mask of an fd already registered with the loop
+int event_loop_mod(EventLoop* loop, int fd, EventHandler* h, uint32_t events);
+
+// Remove fd from the loop (must be called before close() if the fd may be reused)
+int event_loop_del(EventLoop* loop, int fd);
+
+// Run the loop in the calling thread until event_loop_stop()
+void event_loop_run(EventLoop* loop);
+
+// Run the loop in a new thread
+int event_loop_start(EventLoop* loop);
+
+// Ask the loop to exit after its current iteration
+void event_loop_stop(EventLoop* loop);
+
+// Loop running on the calling thread, or NULL if the thread runs no loop
+EventLoop* event_loop_current(void);
+
+// Prepare a task with its callback (not queued)
+static inline void loop_task_init(LoopTask* t, void (*run)(void* arg), void* arg) {
+    t->next = NULL;
+    t->run = run;
+    t->arg = arg;
+    t->queued = 0;
+}
+
+// Run task on the loop's thread soon (any thread; lock-free)
+void event_loop_post(EventLoop* loop, LoopTask* task);
+
+// Arm t on the loop's timer wheel to fire in delay_ms (loop thread only)
+static inline void event_loop_timer(EventLoop* loop, Timer* t, uint64_t delay_ms) {
+    timer_add(&loop->timers, t, now_ms() + delay_ms);
+}
+
+#endif // EVENT_LOOP_H
@@ -0,0 +1,110 @@
+#include <errno.h>
+#include <sys/uio.h>
+#include "frame.h"
+
+// ---- Copy len bytes starting at ring position pos (handles wrap-around) ----
+static void ring_copy(const FrameRing* r, uint32_t pos, void* dst, uint32_t len) {
+    uint32_t off = pos & (FRAME_RING_SIZE - 1);
+    uint32_t first = FRAME_RING_SIZE - off;
+    if (first > len) first = len;
+    memcpy(dst, r->data + off, first);
+    memcpy((char*)dst + first, r->data, len - first);
+}
+
+// ---- Fill the free part of the ring (one or two segments) in one syscall ----
+int frame_ring_fill(FrameRing* r, int sock) {
+    uint32_t space = frame_ring_space(r);
+    if (space == 0) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    uint32_t off = r->tail & (FRAME_RING_SIZE - 1);
+    uint32_t first = FRAME_RING_SIZE - off;
+    if (first > space) first = space;
+
+    struct iovec iov[2];
+    iov[0].iov_base = r->data + off;
+    iov[0].iov_len = first;
+    iov[1].iov_base = r->data;
+    iov[1].iov_len = space - first;
+
+    ssize_t n = readv(sock, iov, iov[1].iov_len ? 2 : 1);
+    if (n > 0) r->tail += (uint32_t)n;
+    return (int)n;
+}
+
+// ---- Copy bytes into the free part of the ring (handles wrap-around) ----
+int frame_ring_write(FrameRing* r, const void* buf, uint32_t len) {
+    if (len > frame_ring_space(r)) return -1;
+    uint32_t off = r->tail & (FRAME_RING_SIZE - 1);
+    uint32_t first = FRAME_RING_SIZE - off;
+    if (first > len) first = len;
+    memcpy(r->data + off, buf, first);
+    memcpy(r->data, (const char*)buf + first, len - first);
+    r->tail += len;
+    return 0;
+}
+
+uint32_t frame_ring_peek(const FrameRing* r, void* dst) {
+    ring_copy(r, r->head, dst, frame_ring_used(r));
+    return frame_ring_used(r);
+}
+
+// ---- Parse one frame out of the ring ----
+int frame_next(FrameRing* r, TrvMessage* out) {
+    uint32_t used = frame_ring_used(r);
+    if (used < FRAME_HEADER_LEN) return 0;
+
+    ring_copy(r, r->head, out, FRAME_HEADER_LEN);
+    if (out->payload_len >= TRV_MAX_PAYLOAD) return -1;  // No room for the payload + NUL
+    if (used < FRAME_HEADER_LEN + (uint32_t)out->payload_len) return 0;
+
+    ring_copy(r, r->head + FRAME_HEADER_LEN, out->payload, out->payload_len);
+    out->payload[out->payload_len] = '\0';
+    r->head += FRAME_HEADER_LEN + out->payload_len;
+    return 1;
+}
+
+// ---- Parse one v2 frame out of the ring ----
+int frame_next_v2(FrameRing* r, TrvMessage* out, uint32_t* id, uint8_t* arg) {
+    uint32_t used = frame_ring_used(r);
+    if (used < TRV_V2_HEADER_LEN) return 0;
+
+    uint8_t h[TRV_V2_HEADER_LEN];
+    ring_copy(r, r->head, h, TRV_V2_HEADER_LEN);
+    uint16_t len = trv_get16(h + 2);
+    if (len >= TRV_MAX_PAYLOAD) return -1;
+    if (used < TRV_V2_HEADER_LEN + (uint32_t)len) return 0;
+
+    *id = trv_get32(h + 4);
+    *arg = h[1];
+    out->type = h[0];
+    out->question_id = 0;           // Does not fit: the id is only in *id
+    out->payload_len = len;
+    ring_copy(r, r->head + TRV_V2_HEADER_LEN, out->payload, len);
+    out->payload[len] = '\0';
+    r->head += TRV_V2_HEADER_LEN + len;
+    return 1;
+}
+
+// ---- Blocking receive of one frame ----
+int frame_recv(FrameRing* r, int sock, TrvMessage* out) {
+    while (1) {
+        int res = frame_next(r, out);
+        if (res != 0) return res;
+        int n = frame_ring_fill(r, sock);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return n;
+    }
+}
+
+// ---- Datagram decode (UDP multicast) ----
+int frame_decode(const void* buf, int len, TrvMessage* out) {
+    if (len < FRAME_HEADER_LEN) return -1;
+    memcpy(out, buf, FRAME_HEADER_LEN);
+    if (out->payload_len >= TRV_MAX_PAYLOAD || out->payload_len > len - FRAME_HEADER_LEN) return -1;
+    memcpy(out->payload, (const char*)buf + FRAME_HEADER_LEN, out->payload_len);
+    out->payload[out->payload_len] = '\0';
+    return 1;
+}
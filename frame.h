@@ -0,0 +1,58 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+#include "protocol.h"
+
+// Size of a per-connection receive ring (must be a power of two and hold
+// at least one maximum-size frame)
+#define FRAME_RING_SIZE 2048
+#define FRAME_HEADER_LEN 4
+
+// Receive ring buffer for one stream socket.
+// head and tail only ever grow; positions are taken modulo FRAME_RING_SIZE.
+typedef struct {
+    uint32_t head;                  // Next byte to parse
+    uint32_t tail;                  // Next byte to fill from the socket
+    char data[FRAME_RING_SIZE];     // Buffered stream bytes
+} FrameRing;
+
+// Reset a ring to empty
+static inline void frame_ring_init(FrameRing* r) {
+    r->head = r->tail = 0;
+}
+
+// Bytes currently buffered / free
+static inline uint32_t frame_ring_used(const FrameRing* r) { return r->tail - r->head; }
+static inline uint32_t frame_ring_space(const FrameRing* r) { return FRAME_RING_SIZE - (r->tail - r->head); }
+
+// Read as many bytes as fit into the ring with a single readv() call.
+// Returns bytes read, 0 on EOF, or -1 on error (errno set; EAGAIN on an empty
+// non-blocking socket). A full ring returns -1 with errno ENOBUFS.
+int frame_ring_fill(FrameRing* r, int sock);
+
+// Append len bytes that were read elsewhere (e.g. an io_uring buffer).
+// Returns 0, or -1 if they don't fit in the free space.
+int frame_ring_write(FrameRing* r, const void* buf, uint32_t len);
+
+// Copy the unparsed bytes to dst without consuming them. Returns how many.
+uint32_t frame_ring_peek(const FrameRing* r, void* dst);
+
+// Pop the next complete frame from the ring into out (payload NUL-terminated).
+// Returns 1 if a frame was produced, 0 if more bytes are needed, or -1 if the
+// stream is corrupt (payload_len does not fit in TRV_MAX_PAYLOAD).
+int frame_next(FrameRing* r, TrvMessage* out);
+
+// Same for a v2 stream. The header's 32-bit id goes to *id and its arg byte
+// to *arg; out->question_id is left 0.
+int frame_next_v2(FrameRing* r, TrvMessage* out, uint32_t* id, uint8_t* arg);
+
+// Blocking helper: return the next frame, reading from sock as needed.
+// Returns 1 on a frame, 0 on EOF, -1 on error or corrupt stream.
+int frame_recv(FrameRing* r, int sock, TrvMessage* out);
+
+// Decode one frame from a datagram of len bytes.
+// Returns 1 on success, -1 if the datagram is truncated or oversized.
+int frame_decode(const void* buf, int len, TrvMessage* out);
+
+#endif // FRAME_H
@@ -0,0 +1,194 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "handover.h"
+
+// ---- Unix socket a successor connects to (loop 0 only) ----
+static struct {
+    EventHandler ev;                // Must be first
+    int sock;
+    void (*give)(int sock);
+} rendezvous;
+
+// ---- Loops parked by handover_pause() ----
+static LoopTask park_tasks[MAX_LOOPS];
+static pthread_mutex_t park_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t park_cond = PTHREAD_COND_INITIALIZER;
+static int paused = 0;              // 1 while loops must stay parked
+static int parked = 0;              // Loops waiting in park()
+
+static void handover_on_connect(EventHandler* h, uint32_t events);
+
+static int unix_addr(const char* path, struct sockaddr_un* sa) {
+    memset(sa, 0, sizeof(*sa));
+    sa->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(sa->sun_path)) {
+        fprintf(stderr, "Handover socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(sa->sun_path, path);
+    return 0;
+}
+
+// Both ends block, but never for longer than HANDOVER_TIMEOUT_MS per record.
+// A record is one datagram, so the buffers must hold the largest one: a client
+// with a full send queue and receive ring. The kernel caps them at
+// net.core.wmem_max / rmem_max.
+static void set_options(int sock) {
+    struct timeval tv = { HANDOVER_TIMEOUT_MS / 1000, (HANDOVER_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    int size = 2 * HANDOVER_MAX_RECORD;  // Room for the kernel's per-message overhead
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    int got = 0;
+    socklen_t len = sizeof(got);
+    if (getsockopt(sock, SOL_SOCKET, SO_SNDBUF, &got, &len) == 0 && got < size) {
+        fprintf(stderr, "⚠️  Handover send buffer is %d bytes, %d wanted; raise net.core.wmem_max\n",
+                got, size);
+    }
+}
+
+int handover_connect(const char* path) {
+    struct sockaddr_un sa;
+    if (unix_addr(path, &sa) < 0) return -1;
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&sa, sizeof(sa)) < 0) {
+        if (errno != ENOENT && errno != ECONNREFUSED) perror("Handover connect failed");
+        close(fd);
+        return -1;
+    }
+    set_options(fd);
+    return fd;
+}
+
+int handover_listen(const char* path, void (*give)(int sock)) {
+    struct sockaddr_un sa;
+    if (unix_addr(path, &sa) < 0) return -1;
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unlink(path);                   // Left by a server that is gone, or by the one we replaced
+    if (fd < 0 || bind(fd, (struct sockaddr*)&sa, sizeof(sa)) < 0 || listen(fd, 1) < 0) {
+        perror("Failed to open handover socket");
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    rendezvous.sock = fd;
+    rendezvous.give = give;
+    rendezvous.ev.on_event = handover_on_connect;
+    return event_loop_add(&loops[0], fd, &rendezvous.ev, EPOLLIN | EPOLLET);
+}
+
+static void handover_on_connect(EventHandler* h, uint32_t events) {
+    (void)h;
+    (void)events;
+    while (1) {
+        int fd = accept4(rendezvous.sock, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("Handover accept failed");
+            return;
+        }
+        set_options(fd);
+        rendezvous.give(fd);
+    }
+}
+
+int handover_send(int sock, uint32_t type, const struct iovec* parts, int count, int fd) {
+    struct iovec iov[4];
+    if (count > 3) return -1;
+    iov[0].iov_base = &type;
+    iov[0].iov_len = sizeof(type);
+    memcpy(iov + 1, parts, count * sizeof(*parts));
+
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = iov;
+    mh.msg_iovlen = count + 1;
+    if (fd >= 0) {
+        mh.msg_control = control.buf;
+        mh.msg_controllen = sizeof(control.buf);
+        struct cmsghdr* cm = CMSG_FIRSTHDR(&mh);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cm), &fd, sizeof(int));
+    }
+    while (sendmsg(sock, &mh, MSG_NOSIGNAL) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    return 0;
+}
+
+int handover_recv(int sock, uint32_t* type, void* buf, int size, int* fd) {
+    struct iovec iov[2];
+    iov[0].iov_base = type;
+    iov[0].iov_len = sizeof(*type);
+    iov[1].iov_base = buf;
+    iov[1].iov_len = size;
+
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = iov;
+    mh.msg_iovlen = 2;
+    mh.msg_control = control.buf;
+    mh.msg_controllen = sizeof(control.buf);
+
+    ssize_t n;
+    while ((n = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {}
+    *fd = -1;
+    struct cmsghdr* cm = n > 0 ? CMSG_FIRSTHDR(&mh) : NULL;
+    if (cm && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS) memcpy(fd, CMSG_DATA(cm), sizeof(int));
+    if (n < (ssize_t)sizeof(*type) || (mh.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+        if (n >= 0) errno = n < (ssize_t)sizeof(*type) ? ECONNRESET : EMSGSIZE;
+        if (*fd >= 0) close(*fd);
+        return -1;
+    }
+    return (int)(n - sizeof(*type));
+}
+
+// ---- A loop's park task: wait until handover_resume() ----
+// Tasks run between events, so a parked loop is never half way through a
+// frame and holds no room lock.
+static void park(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&park_lock);
+    parked++;
+    pthread_cond_broadcast(&park_cond);
+    while (paused) pthread_cond_wait(&park_cond, &park_lock);
+    parked--;
+    pthread_mutex_unlock(&park_lock);
+}
+
+void handover_pause(void) {
+    pthread_mutex_lock(&park_lock);
+    paused = 1;
+    pthread_mutex_unlock(&park_lock);
+    for (int i = 1; i < num_loops; i++) {
+        loop_task_init(&park_tasks[i], park, NULL);
+        event_loop_post(&loops[i], &park_tasks[i]);
+    }
+    pthread_mutex_lock(&park_lock);
+    while (parked < num_loops - 1) pthread_cond_wait(&park_cond, &park_lock);
+    pthread_mutex_unlock(&park_lock);
+}
+
+void handover_resume(void) {
+    pthread_mutex_lock(&park_lock);
+    paused = 0;
+    pthread_cond_broadcast(&park_cond);
+    pthread_mutex_unlock(&park_lock);
+}
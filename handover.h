@@ -0,0 +1,127 @@
+#ifndef HANDOVER_H
+#define HANDOVER_H
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include "server.h"
+#include "scoreboard.h"
+#include "journal.h"
+
+// ---- Hot restart: hand a running server over to a new process ----
+// With -x path the server listens on a Unix socket for its successor. A new
+// server started with the same -x finds it there and takes over instead of
+// starting empty. The old server pauses its loops between events and sends
+// its listening sockets and every connection's socket (SCM_RIGHTS), along
+// with the player and game state, one record per SOCK_SEQPACKET message.
+// The new server registers all of it with its own loops and re-arms
+// keepalives and room timers at their old deadlines. Both processes read the
+// same CLOCK_MONOTONIC, so the deadlines carry over unchanged. The old
+// server exits once the new one acknowledges, and carries on if it doesn't.
+// Clients see nothing and never reconnect. Both servers must map the same
+// question bank, since rooms keep their bank ids.
+
+#define HANDOVER_VERSION 3          // Bump when a record changes
+#define HANDOVER_TIMEOUT_MS 5000    // Longest wait for the other process to send or read a record
+#define HANDOVER_RETRY_MS 10        // Pause again after this if broadcasts were still in flight
+
+// ---- Records, in the order they are sent ----
+enum {
+    HANDOVER_SERVER = 1,            // HandoverServer
+    HANDOVER_LISTENER,              // fd only
+    HANDOVER_CLUSTER,               // fd + unparsed bytes from the coordinator
+    HANDOVER_CLIENT,                // fd + HandoverClient + unparsed input + queued output
+    HANDOVER_ROOM,                  // HandoverRoom (after its players)
+    HANDOVER_RETURNING,             // HandoverReturning: players a resumed room waits for (after the room)
+    HANDOVER_END                    // Empty; the new server answers with one byte
+};
+
+typedef struct {
+    uint32_t version;               // HANDOVER_VERSION
+    uint64_t cookie_key[2];         // So auth codes already handed out stay valid
+    uint32_t next_game_id;
+} HandoverServer;
+
+typedef struct {
+    uint32_t handle;                // ConnHandle in the old server (to carry scoreboard entries over)
+    struct sockaddr_in addr;
+    int32_t state;                  // CONN_AUTH_WAIT or CONN_PLAYING
+    int32_t started;                // 0 if its start_client() task had not run yet
+    int32_t wire;
+    int32_t tcp_questions;
+    char nickname[32];
+    int32_t loop;                   // Loop index in the old server
+    int32_t room;                   // Room id, or -1
+    uint32_t player_no;
+    QuestionSet acked;              // Seat columns while in a room
+    QuestionSet answered;
+    int32_t score;
+    int32_t via_tcp;
+    QuestionSet repaired;
+    uint64_t keepalive;             // Deadline (now_ms() clock), 0 if not armed
+    int32_t shutdown_pending;
+    uint32_t in_len;                // Bytes that follow: unparsed input, then queued output
+    uint32_t out_len;
+} HandoverClient;
+
+typedef struct {
+    int32_t id;
+    int32_t loop;                   // Index of the loop that drives it
+    int32_t state;
+    int32_t is_open;                // 1 if new players join this lobby
+    uint32_t game_id;
+    int32_t tcp_only;
+    int32_t clustered;
+    uint32_t cluster_seed;
+    int32_t done_sent;
+    uint32_t questions[QUESTIONS_PER_GAME];
+    int32_t num_questions;
+    int32_t current_question;
+    uint64_t window;
+    uint64_t question_open_ms;
+    uint64_t timer;                 // Deadlines (now_ms() clock), 0 if not armed
+    uint64_t repair_timer;
+    int32_t repair_round;
+    uint64_t last_mcast_ms;
+    int32_t ack_count;
+    int32_t repair_count;
+    uint32_t players_joined;
+    int32_t resumed;
+    int32_t resume_from;
+    int32_t num_returning;          // Sent in HANDOVER_RETURNING records
+    int32_t num_scores;
+    struct {
+        int32_t shard;              // Loop index in the old server
+        ScoreEntry entry;           // player is the old ConnHandle
+    } scores[SCOREBOARD_SHARDS * LEADERBOARD_K];
+} HandoverRoom;
+
+typedef struct {
+    int32_t room;
+    int32_t first;                  // Player number of players[0]
+    JournalPlayer players[];        // As many as the record holds
+} HandoverReturning;
+
+#define HANDOVER_MAX_RECORD (4 + sizeof(HandoverClient) + FRAME_RING_SIZE + SENDQ_SIZE)
+
+_Static_assert(sizeof(HandoverRoom) + 4 <= HANDOVER_MAX_RECORD, "room records must fit the receive buffer");
+
+// Connect to the server listening on path. Returns the socket, or -1 if no
+// server is there (or the file is left over from one that is gone).
+int handover_connect(const char* path);
+
+// Listen on path for the next server, on loop 0. give(sock) runs on loop 0
+// for each new server that connects and owns the socket.
+int handover_listen(const char* path, void (*give)(int sock));
+
+// Send one record: type, the parts, and fd (or -1) as SCM_RIGHTS. Returns 0 or -1.
+int handover_send(int sock, uint32_t type, const struct iovec* parts, int count, int fd);
+
+// Receive one record into buf. Sets *type and *fd (-1 if none). Returns the
+// body length, or -1 on error, timeout or a truncated record.
+int handover_recv(int sock, uint32_t* type, void* buf, int size, int* fd);
+
+// Park loops 1..num_loops-1 between events (from loop 0), and let them go again
+void handover_pause(void);
+void handover_resume(void);
+
+#endif // HANDOVER_H
@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <string.h>
+#include "histogram.h"
+
+// ---- Value <-> bucket mapping ----
+// Values below HIST_SUB get a bucket each; above that, group g covers
+// [HIST_SUB << (g - 1), HIST_SUB << g) in HIST_SUB steps of 1 << (g - 1).
+static int bucket_of(uint64_t v) {
+    if (v < HIST_SUB) return (int)v;
+    int msb = 63 - __builtin_clzll(v);
+    if (msb >= HIST_MAX_BITS) return HIST_BUCKETS - 1;
+    int g = msb - HIST_SUB_BITS + 1;
+    return g * HIST_SUB + (int)((v >> (g - 1)) & (HIST_SUB - 1));
+}
+
+// Largest value that falls into bucket i
+static uint64_t bucket_top(int i) {
+    int g = i / HIST_SUB;
+    if (g == 0) return (uint64_t)i;
+    uint64_t low = (uint64_t)(HIST_SUB + i % HIST_SUB) << (g - 1);
+    return low + (1ULL << (g - 1)) - 1;
+}
+
+void hist_init(Histogram* h) {
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void hist_record(Histogram* h, uint64_t us) {
+    h->buckets[bucket_of(us)]++;
+    h->count++;
+    h->sum += us;
+    if (us < h->min) h->min = us;
+    if (us > h->max) h->max = us;
+}
+
+void hist_merge(Histogram* into, const Histogram* from) {
+    for (int i = 0; i < HIST_BUCKETS; i++) into->buckets[i] += from->buckets[i];
+    into->count += from->count;
+    into->sum += from->sum;
+    if (from->min < into->min) into->min = from->min;
+    if (from->max > into->max) into->max = from->max;
+}
+
+uint64_t hist_percentile(const Histogram* h, double p) {
+    if (h->count == 0) return 0;
+    uint64_t rank = (uint64_t)(p / 100.0 * h->count + 0.5);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t v = bucket_top(i);
+            return v > h->max ? h->max : v;  // Never report more than was seen
+        }
+    }
+    return h->max;
+}
+
+void hist_print(const Histogram* h, const char* name) {
+    if (h->count == 0) {
+        printf("%-18s n=0\n", name);
+        return;
+    }
+    printf("%-18s n=%-8llu min %8.2f  p50 %8.2f  p90 %8.2f  p99 %8.2f  p99.9 %8.2f  max %8.2f ms\n",
+           name, (unsigned long long)h->count, h->min / 1000.0,
+           hist_percentile(h, 50) / 1000.0, hist_percentile(h, 90) / 1000.0,
+           hist_percentile(h, 99) / 1000.0, hist_percentile(h, 99.9) / 1000.0,
+           h->max / 1000.0);
+}
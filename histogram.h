@@ -0,0 +1,40 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+// ---- Log-linear latency histogram (microseconds) ----
+// Every power of two is split into 2^HIST_SUB_BITS linear buckets, so any
+// recorded value is reported within ~6% while the whole range up to
+// 2^HIST_MAX_BITS us (~19 hours) takes a few kilobytes. Not thread-safe: give
+// each thread its own histogram and merge them at the end.
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 36
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[HIST_BUCKETS];
+} Histogram;
+
+// Start empty
+void hist_init(Histogram* h);
+
+// Add one sample of us microseconds
+void hist_record(Histogram* h, uint64_t us);
+
+// Add every sample of from to into
+void hist_merge(Histogram* into, const Histogram* from);
+
+// Smallest value v such that at least p% of the samples are <= v (bucket precision)
+uint64_t hist_percentile(const Histogram* h, double p);
+
+// Print "name: n=… min/p50/p90/p99/p99.9/max" in milliseconds
+void hist_print(const Histogram* h, const char* name);
+
+#endif // HISTOGRAM_H
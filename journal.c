@@ -0,0 +1,369 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include "journal.h"
+
+// ---- Single-producer / single-consumer ring of one thread ----
+// Same layout as the trace rings: head is written only by the owning thread,
+// tail only by the writer, each on its own cache line.
+typedef struct {
+    uint64_t head __attribute__((aligned(64)));  // Next record to write
+    uint64_t tail __attribute__((aligned(64)));  // Next record to write out
+    JournalRecord records[JOURNAL_RING_RECORDS] __attribute__((aligned(64)));
+} JournalRing;
+
+int journal_enabled = 0;
+
+static JournalRing* journal_rings[JOURNAL_MAX_THREADS];
+static int journal_ring_count = 0;
+static int journal_fd = -1;
+static pthread_t journal_thread;
+static pthread_mutex_t commit_lock = PTHREAD_MUTEX_INITIALIZER;  // One commit at a time
+static __thread JournalRing* my_ring = NULL;
+
+static uint64_t real_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// ---- First record from a thread: give it a ring ----
+static JournalRing* journal_register(void) {
+    int i = __atomic_fetch_add(&journal_ring_count, 1, __ATOMIC_RELAXED);
+    if (i >= JOURNAL_MAX_THREADS) {
+        fprintf(stderr, "Journal: more than %d threads, records lost\n", JOURNAL_MAX_THREADS);
+        return NULL;
+    }
+    JournalRing* ring = aligned_alloc(64, sizeof(JournalRing));
+    if (!ring) return NULL;
+    memset(ring, 0, sizeof(*ring));
+    __atomic_store_n(&journal_rings[i], ring, __ATOMIC_RELEASE);
+    return ring;
+}
+
+void journal_write(uint16_t type, uint16_t room, uint32_t game, uint32_t player,
+                   uint32_t a0, uint32_t a1, uint32_t a2, const char* nickname) {
+    JournalRing* ring = my_ring;
+    if (!ring && !(ring = my_ring = journal_register())) return;
+
+    // Full: wait for the writer rather than lose a score
+    uint64_t head = ring->head;
+    while (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= JOURNAL_RING_RECORDS) sched_yield();
+
+    JournalRecord* rec = &ring->records[head & (JOURNAL_RING_RECORDS - 1)];
+    rec->ts_ms = real_ms();
+    rec->type = type;
+    rec->room = room;
+    rec->game = game;
+    rec->player = player;
+    rec->a[0] = a0;
+    rec->a[1] = a1;
+    rec->a[2] = a2;
+    memset(rec->nickname, 0, sizeof(rec->nickname));
+    if (nickname) memcpy(rec->nickname, nickname, strnlen(nickname, sizeof(rec->nickname) - 1));
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Write every part, however the kernel splits it up
+static int write_all(int fd, struct iovec* iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+// ---- Group commit: every ring's records in one writev(), then one fdatasync() ----
+// Producers keep writing meanwhile; a ring's records are only released once
+// they are in the file.
+static void journal_commit(void) {
+    static struct iovec iov[JOURNAL_MAX_THREADS * 2];
+    static uint64_t heads[JOURNAL_MAX_THREADS];
+    static int failing = 0;
+    pthread_mutex_lock(&commit_lock);
+
+    int count = __atomic_load_n(&journal_ring_count, __ATOMIC_RELAXED);
+    if (count > JOURNAL_MAX_THREADS) count = JOURNAL_MAX_THREADS;
+    int parts = 0;
+    for (int i = 0; i < count; i++) {
+        JournalRing* ring = __atomic_load_n(&journal_rings[i], __ATOMIC_ACQUIRE);
+        heads[i] = ring ? __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) : 0;
+        if (!ring) continue;        // Still being registered
+        uint64_t tail = ring->tail;
+        while (tail != heads[i]) {
+            // At most two contiguous runs: up to the end of the ring, then from its start
+            uint64_t pos = tail & (JOURNAL_RING_RECORDS - 1);
+            uint64_t n = heads[i] - tail;
+            if (n > JOURNAL_RING_RECORDS - pos) n = JOURNAL_RING_RECORDS - pos;
+            iov[parts].iov_base = &ring->records[pos];
+            iov[parts++].iov_len = n * sizeof(JournalRecord);
+            tail += n;
+        }
+    }
+
+    if (parts > 0) {
+        if (write_all(journal_fd, iov, parts) < 0 || fdatasync(journal_fd) < 0) {
+            if (!failing) perror("Journal write failed");
+            failing = 1;
+        } else {
+            failing = 0;
+        }
+        // Written (or given up on): the producers may reuse the slots
+        for (int i = 0; i < count; i++) {
+            JournalRing* ring = __atomic_load_n(&journal_rings[i], __ATOMIC_ACQUIRE);
+            if (ring) __atomic_store_n(&ring->tail, heads[i], __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&commit_lock);
+}
+
+void journal_sync(void) {
+    if (journal_enabled) journal_commit();
+}
+
+static void* journal_writer(void* arg) {
+    struct timespec period = { 0, JOURNAL_COMMIT_MS * 1000000L };
+    (void)arg;
+    while (1) {
+        nanosleep(&period, NULL);
+        journal_commit();
+    }
+    return NULL;
+}
+
+// ---- Replay: fold the records into one entry per game ----
+static JournalGame* game_of(JournalGame** games, int* count, int* cap, const JournalRecord* rec) {
+    for (int i = *count - 1; i >= 0; i--) {
+        if ((*games)[i].game == rec->game) return &(*games)[i];
+    }
+    if (*count == *cap) {
+        int n = *cap ? *cap * 2 : 16;
+        JournalGame* grown = realloc(*games, n * sizeof(JournalGame));
+        if (!grown) return NULL;
+        *games = grown;
+        *cap = n;
+    }
+    JournalGame* g = &(*games)[(*count)++];
+    memset(g, 0, sizeof(*g));
+    g->game = rec->game;
+    g->room = rec->room;
+    return g;
+}
+
+static JournalPlayer* player_of(JournalGame* g, uint32_t player) {
+    if (player >= JOURNAL_MAX_PLAYERS) return NULL;
+    if ((int)player >= g->num_players) {
+        JournalPlayer* grown = realloc(g->players, (player + 1) * sizeof(JournalPlayer));
+        if (!grown) return NULL;
+        memset(grown + g->num_players, 0, (player + 1 - g->num_players) * sizeof(JournalPlayer));
+        g->players = grown;
+        g->num_players = player + 1;
+    }
+    return &g->players[player];
+}
+
+// Scores only grow and answer bits are only set, so the order records from
+// different threads reached the file in does not matter.
+static void replay_record(JournalGame* g, const JournalRecord* rec) {
+    JournalPlayer* p;
+    switch (rec->type) {
+        case JOURNAL_PICK:
+            if (rec->a[0] < QUESTIONS_PER_GAME) {
+                g->questions[rec->a[0]] = rec->a[1];
+                g->num_questions = rec->a[2] < QUESTIONS_PER_GAME ? (int)rec->a[2] : QUESTIONS_PER_GAME;
+            }
+            break;
+        case JOURNAL_QUESTION:
+            if ((int)rec->a[0] + 1 > g->asked) g->asked = rec->a[0] + 1;
+            break;
+        case JOURNAL_AUTH:
+            if ((p = player_of(g, rec->player)) != NULL) {
+                memcpy(p->nickname, rec->nickname, sizeof(p->nickname));
+                p->nickname[sizeof(p->nickname) - 1] = '\0';
+            }
+            break;
+        case JOURNAL_ANSWER:
+            if ((p = player_of(g, rec->player)) != NULL && rec->a[0] < QUESTIONS_PER_GAME) {
+                *qset_word(&p->answered, rec->a[0]) |= qset_bit(rec->a[0]);
+                if ((int)rec->a[2] > p->score) p->score = rec->a[2];
+            }
+            break;
+        case JOURNAL_SCORE:
+            if ((p = player_of(g, rec->player)) != NULL) {
+                p->answered.w[0] |= (uint64_t)rec->a[2] << 32 | rec->a[1];
+                if ((int)rec->a[0] > p->score) p->score = rec->a[0];
+            }
+            break;
+        case JOURNAL_ANSWERED:
+            if ((p = player_of(g, rec->player)) != NULL && rec->a[0] < QSET_WORDS) {
+                p->answered.w[rec->a[0]] |= (uint64_t)rec->a[2] << 32 | rec->a[1];
+            }
+            break;
+        case JOURNAL_END:
+            g->ended = 1;
+            break;
+    }
+}
+
+int journal_replay(const char* path, JournalGame** games) {
+    *games = NULL;
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        if (errno == ENOENT) return 0;
+        perror("Journal open failed");
+        return -1;
+    }
+    JournalFileHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr.magic, JOURNAL_MAGIC, 4) != 0 ||
+        hdr.version != JOURNAL_VERSION || hdr.record_size != sizeof(JournalRecord)) {
+        fprintf(stderr, "%s is not a version %d journal\n", path, JOURNAL_VERSION);
+        fclose(f);
+        return -1;
+    }
+
+    static JournalRecord batch[1024];
+    int count = 0, cap = 0;
+    size_t n;
+    // A record torn by the crash is short, and fread() leaves it out
+    while ((n = fread(batch, sizeof(JournalRecord), 1024, f)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            JournalGame* g = game_of(games, &count, &cap, &batch[i]);
+            if (g) replay_record(g, &batch[i]);
+        }
+    }
+    fclose(f);
+    return count;
+}
+
+void journal_games_free(JournalGame* games, int count) {
+    for (int i = 0; i < count; i++) free(games[i].players);
+    free(games);
+}
+
+// ---- Snapshot of a resumed game: what its records folded into ----
+static int journal_snapshot(int fd, const JournalGame* g) {
+    JournalRecord recs[QUESTIONS_PER_GAME + 2];
+    memset(recs, 0, sizeof(recs));
+    int n = 0;
+    recs[n++].type = JOURNAL_GAME;
+    for (int q = 0; q < g->num_questions; q++) {
+        recs[n].type = JOURNAL_PICK;
+        recs[n].a[0] = q;
+        recs[n].a[1] = g->questions[q];
+        recs[n++].a[2] = g->num_questions;
+    }
+    if (g->asked > 0) {
+        recs[n].type = JOURNAL_QUESTION;
+        recs[n++].a[0] = g->asked - 1;
+    }
+    uint64_t now = real_ms();
+    for (int i = 0; i < n; i++) {
+        recs[i].ts_ms = now;
+        recs[i].room = g->room;
+        recs[i].game = g->game;
+    }
+    struct iovec iov = { recs, n * sizeof(JournalRecord) };
+    if (write_all(fd, &iov, 1) < 0) return -1;
+
+    for (int i = 0; i < g->num_players; i++) {
+        const JournalPlayer* p = &g->players[i];
+        if (!p->nickname[0]) continue;
+        memset(recs, 0, (QSET_WORDS + 1) * sizeof(JournalRecord));
+        recs[0].type = JOURNAL_AUTH;
+        memcpy(recs[0].nickname, p->nickname, sizeof(recs[0].nickname));
+        recs[1].type = JOURNAL_SCORE;
+        recs[1].a[0] = p->score;
+        recs[1].a[1] = (uint32_t)p->answered.w[0];
+        recs[1].a[2] = (uint32_t)(p->answered.w[0] >> 32);
+        int m = 2;
+        for (int w = 1; w < QSET_WORDS; w++) {
+            if (!p->answered.w[w]) continue;
+            recs[m].type = JOURNAL_ANSWERED;
+            recs[m].a[0] = w;
+            recs[m].a[1] = (uint32_t)p->answered.w[w];
+            recs[m++].a[2] = (uint32_t)(p->answered.w[w] >> 32);
+        }
+        for (int r = 0; r < m; r++) {
+            recs[r].ts_ms = now;
+            recs[r].room = g->room;
+            recs[r].game = g->game;
+            recs[r].player = i;
+        }
+        iov.iov_base = recs;
+        iov.iov_len = m * sizeof(JournalRecord);
+        if (write_all(fd, &iov, 1) < 0) return -1;
+    }
+    return 0;
+}
+
+// The rename is only durable once the directory is synced too
+static void sync_dir(const char* path) {
+    char copy[4096];
+    snprintf(copy, sizeof(copy), "%s", path);
+    int dir = open(dirname(copy), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir < 0) return;
+    fsync(dir);
+    close(dir);
+}
+
+// ---- Open the journal and start the writer ----
+int journal_open(const char* path, const JournalGame* games, int count, int append) {
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(append ? path : tmp, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (append ? 0 : O_TRUNC), 0644);
+    if (fd < 0) {
+        perror("Journal open failed");
+        return -1;
+    }
+
+    int ok = 1;
+    if (!append || lseek(fd, 0, SEEK_END) == 0) {
+        JournalFileHeader hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, JOURNAL_MAGIC, 4);
+        hdr.version = JOURNAL_VERSION;
+        hdr.record_size = sizeof(JournalRecord);
+        struct iovec iov = { &hdr, sizeof(hdr) };
+        ok = write_all(fd, &iov, 1) == 0;
+    }
+    for (int i = 0; ok && !append && i < count; i++) {
+        if (games[i].resumed) ok = journal_snapshot(fd, &games[i]) == 0;
+    }
+    if (!ok || fdatasync(fd) < 0 || (!append && rename(tmp, path) < 0)) {
+        perror("Journal write failed");
+        close(fd);
+        return -1;
+    }
+    if (!append) sync_dir(path);
+
+    journal_fd = fd;
+    if (pthread_create(&journal_thread, NULL, journal_writer, NULL) != 0) {
+        perror("Journal thread failed");
+        close(fd);
+        return -1;
+    }
+    pthread_detach(journal_thread);
+    journal_enabled = 1;
+    return 0;
+}
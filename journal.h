@@ -0,0 +1,106 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include "server.h"
+
+// ---- Crash-safe score journal ----
+// Joins, questions, answers and scores are appended to a binary journal.
+// Like the trace log, each thread writes fixed-size records to its own
+// lock-free ring, so the answer path makes no syscall and takes no lock. A
+// writer thread drains every ring with one writev() and then makes the whole
+// batch durable with a single fdatasync() (group commit). A record is on disk
+// at most JOURNAL_COMMIT_MS plus one fdatasync() after it was written. A full
+// ring makes its thread wait for the writer, so records are never dropped.
+//
+// On startup the journal is replayed. Every game it shows as started but not
+// finished is reopened with its questions and its players' scores, and the
+// journal is rewritten to hold just those games. Cluster games are not
+// journaled: the coordinator runs them, and a node cannot resume one alone.
+
+#define JOURNAL_MAGIC "TRVJ"
+#define JOURNAL_VERSION 1
+#define JOURNAL_RING_RECORDS 16384  // Per thread (power of two)
+#define JOURNAL_MAX_THREADS 64
+#define JOURNAL_COMMIT_MS 5         // Group commit window
+#define JOURNAL_MAX_PLAYERS 65536   // Higher player numbers are taken as corrupt on replay
+
+// ---- Record types; player is the player's number in its game ----
+enum {
+    JOURNAL_GAME = 1,               // Lobby opened
+    JOURNAL_PICK,                   // a0 = question index, a1 = bank id, a2 = questions in the game
+    JOURNAL_QUESTION,               // Question a0 sent
+    JOURNAL_AUTH,                   // player joined, nickname
+    JOURNAL_ANSWER,                 // player answered question a0 with a1, score now a2
+    JOURNAL_SCORE,                  // Snapshot: player has score a0, answered questions 0-63 a2 << 32 | a1
+    JOURNAL_END,                    // Game over (or abandoned)
+    JOURNAL_ANSWERED                // Snapshot: player answered questions 64 * a0 + (a2 << 32 | a1) bits
+};
+
+// ---- One record (64 bytes on disk and in the rings) ----
+typedef struct {
+    uint64_t ts_ms;                 // CLOCK_REALTIME
+    uint16_t type;                  // JOURNAL_* type
+    uint16_t room;
+    uint32_t game;                  // Game id, unique across restarts
+    uint32_t player;
+    uint32_t a[3];
+    char nickname[32];              // JOURNAL_AUTH only
+} JournalRecord;
+
+_Static_assert(sizeof(JournalRecord) == 64, "journal records are 64 bytes");
+
+// ---- File header, followed by records ----
+typedef struct {
+    char magic[4];                  // JOURNAL_MAGIC
+    uint32_t version;               // JOURNAL_VERSION
+    uint32_t record_size;           // sizeof(JournalRecord)
+    uint32_t reserved;
+} JournalFileHeader;
+
+// ---- A game as the journal tells it ----
+typedef struct {
+    char nickname[32];
+    int score;
+    QuestionSet answered;
+} JournalPlayer;
+
+typedef struct {
+    uint32_t game;
+    int room;
+    int ended;
+    int num_questions;              // 0 until the questions were picked
+    uint32_t questions[QUESTIONS_PER_GAME];
+    int asked;                      // Questions sent so far
+    int num_players;
+    JournalPlayer* players;         // By player number
+    int resumed;                    // Set by rooms_resume() when a room took the game up
+} JournalGame;
+
+extern int journal_enabled;
+
+// Read the games recorded in the journal at path (none if it does not exist).
+// Returns how many were put in *games, or -1 if the file is not a journal.
+int journal_replay(const char* path, JournalGame** games);
+
+void journal_games_free(JournalGame* games, int count);
+
+// Start a fresh journal at path holding a snapshot of the resumed games,
+// replace the old file with it, and start the writer thread. With append set
+// (hot restart) the file is kept and appended to instead. Returns 0 or -1.
+int journal_open(const char* path, const JournalGame* games, int count, int append);
+
+// Write everything journaled so far and fdatasync it (any thread)
+void journal_sync(void);
+
+// Append a record from the calling thread (slow path of journal_event)
+void journal_write(uint16_t type, uint16_t room, uint32_t game, uint32_t player,
+                   uint32_t a0, uint32_t a1, uint32_t a2, const char* nickname);
+
+// Record an event; a single predictable branch when journaling is off
+static inline void journal_event(uint16_t type, uint16_t room, uint32_t game, uint32_t player,
+                                 uint32_t a0, uint32_t a1, uint32_t a2, const char* nickname) {
+    if (journal_enabled) journal_write(type, room, game, player, a0, a1, a2, nickname);
+}
+
+#endif // JOURNAL_H
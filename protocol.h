@@ -15,6 +15,18 @@
 #define TRV_AUTH_REPLY    0x07   // Client's reply to the authentication code
 #define TRV_AUTH_OK       0x08   // Authentication successful
 #define TRV_AUTH_FAIL     0x09   // Authentication failed
+#define TRV_NACK          0x0A   // Client missed question question_id; resend it over TCP
+
+// Cluster control frames, between the coordinator and server nodes (cluster.h).
+// They use the v2 header (below), so question ids are 32 bits.
+#define TRV_CLUSTER_HELLO    0x20   // Node joins (payload: the node's player port)
+#define TRV_CLUSTER_OPEN     0x21   // Open the game's lobby (payload: game id)
+#define TRV_CLUSTER_BEGIN    0x22   // Close the lobby (payload: seed for picking questions)
+#define TRV_CLUSTER_QUESTION 0x23   // Send question id
+#define TRV_CLUSTER_DONE     0x24   // Node: every local player answered question id
+#define TRV_CLUSTER_END      0x25   // Last question is over; report scores
+#define TRV_CLUSTER_SCORES   0x26   // Node: "players\nscore nickname\n..." (local top K)
+#define TRV_CLUSTER_RESULT   0x27   // Merged results, sent to every player as TRV_WINNER
 
 #define TRV_MAX_PAYLOAD   512    // Maximum payload size for message data
 
@@ -47,6 +59,50 @@ static inline int build_message(TrvMessage* msg, uint8_t type, uint8_t qid, cons
     return 4 + msg->payload_len; // Header is 4 bytes, plus payload
 }
 
+// ---- Wire format v2 ----
+// Negotiated per connection: the client adds "|v2" to its TRV_AUTH_REPLY, and a
+// server that speaks v2 ends its TRV_AUTH_OK with a "v2 game <id>" line. Every
+// TCP frame after that, in both directions, uses the v2 header; the auth
+// exchange itself and multicast datagrams (shared with v1 players) stay v1.
+// Integers are stored as little-endian bytes, whatever the host's byte order,
+// and question ids are 32 bits.
+// TRV_ACK, TRV_NACK, TRV_KEEPALIVE and TRV_ANSWER are bare 8-byte headers.
+#define TRV_WIRE_V1       1
+#define TRV_WIRE_V2       2
+#define TRV_V2_HEADER_LEN 8
+#define TRV_V1_QUESTIONS  256           // Questions a v1 frame can number (the id is a byte)
+
+typedef struct {
+    uint8_t type;                   // TRV_* type
+    uint8_t arg;                    // TRV_ANSWER: chosen option (1-4); otherwise 0
+    uint8_t payload_len[2];         // Little-endian payload length
+    uint8_t id[4];                  // Little-endian question id (game id in TRV_WINNER)
+} TrvHeaderV2;
+
+static inline uint16_t trv_get16(const uint8_t* p) { return (uint16_t)(p[0] | p[1] << 8); }
+static inline uint32_t trv_get32(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Write a v2 header to out (TRV_V2_HEADER_LEN bytes); the payload follows it
+static inline int build_header_v2(void* out, uint8_t type, uint8_t arg, uint32_t id, uint16_t payload_len) {
+    TrvHeaderV2* h = (TrvHeaderV2*)out;
+    h->type = type;
+    h->arg = arg;
+    h->payload_len[0] = (uint8_t)payload_len;
+    h->payload_len[1] = (uint8_t)(payload_len >> 8);
+    for (int i = 0; i < 4; i++) h->id[i] = (uint8_t)(id >> (8 * i));
+    return TRV_V2_HEADER_LEN + payload_len;
+}
+
+// Write a whole v2 frame with a text payload to out (room for TRV_V2_HEADER_LEN
+// + TRV_MAX_PAYLOAD bytes). Returns its length.
+static inline int build_message_v2(void* out, uint8_t type, uint32_t id, const char* payload) {
+    size_t len = strnlen(payload, TRV_MAX_PAYLOAD - 1);
+    memcpy((char*)out + TRV_V2_HEADER_LEN, payload, len);
+    return build_header_v2(out, type, 0, id, (uint16_t)len);
+}
+
 // Utility function to print the contents of a protocol message (for debugging)
 static inline void print_message(const TrvMessage* msg) {
     printf("== TRV Message ==\n");
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "qbank.h"
+#include "frame.h"
+
+// ---- Map and validate a bank file ----
+int qbank_open(QBank* bank, const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(QBankHeader)) {
+        fprintf(stderr, "%s: not a question bank\n", path);
+        close(fd);
+        return -1;
+    }
+
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);  // The mapping keeps the file alive
+    if (map == MAP_FAILED) {
+        perror("mmap failed");
+        return -1;
+    }
+
+    bank->base = map;
+    bank->size = st.st_size;
+    bank->header = map;
+
+    const QBankHeader* h = bank->header;
+    uint64_t index_end = h->index_offset + (uint64_t)h->count * sizeof(QBankEntry);
+    uint64_t cat_end = h->category_offset + (uint64_t)h->num_categories * sizeof(QBankCategory);
+    if (memcmp(h->magic, QBANK_MAGIC, 4) != 0 || h->version != QBANK_VERSION ||
+        h->count == 0 || h->num_categories > QBANK_MAX_CATEGORIES ||
+        index_end > bank->size || cat_end > bank->size || h->frames_offset > bank->size) {
+        fprintf(stderr, "%s: bad question bank header\n", path);
+        qbank_close(bank);
+        return -1;
+    }
+    bank->categories = (const QBankCategory*)(bank->base + h->category_offset);
+    bank->index = (const QBankEntry*)(bank->base + h->index_offset);
+
+    // Questions are sent straight from the mapping: every range must be inside
+    // it, and every frame a whole TRV_QUESTION whose header agrees with the index
+    for (uint32_t i = 0; i < h->num_categories; i++) {
+        const QBankCategory* c = &bank->categories[i];
+        if ((uint64_t)c->first + c->count > h->count) {
+            fprintf(stderr, "%s: category %u is outside the index\n", path, i);
+            qbank_close(bank);
+            return -1;
+        }
+        if (c->count == 0) {  // A game in it would have no questions
+            fprintf(stderr, "%s: category %u is empty\n", path, i);
+            qbank_close(bank);
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; i < h->count; i++) {
+        const QBankEntry* e = &bank->index[i];
+        uint16_t payload_len;
+        if (e->frame_len < FRAME_HEADER_LEN || e->frame_len > FRAME_HEADER_LEN + TRV_MAX_PAYLOAD - 1 ||
+            e->frame_offset > bank->size || e->frame_len > bank->size - e->frame_offset ||
+            e->correct_index > 3 || e->category >= h->num_categories) {
+            fprintf(stderr, "%s: question %u is corrupt\n", path, i);
+            qbank_close(bank);
+            return -1;
+        }
+        memcpy(&payload_len, bank->base + e->frame_offset + 2, sizeof(payload_len));
+        if (bank->base[e->frame_offset] != TRV_QUESTION || payload_len != e->frame_len - FRAME_HEADER_LEN) {
+            fprintf(stderr, "%s: question %u is corrupt\n", path, i);
+            qbank_close(bank);
+            return -1;
+        }
+    }
+
+    // Questions are read in random order; don't let readahead pull in neighbours
+    madvise((void*)(bank->base + h->frames_offset), bank->size - h->frames_offset, MADV_RANDOM);
+
+    printf("📚 Loaded %u questions in %u categories from %s\n", h->count, h->num_categories, path);
+    return 0;
+}
+
+void qbank_close(QBank* bank) {
+    munmap((void*)bank->base, bank->size);
+    bank->base = NULL;
+}
+
+// ---- Look up a category by name ----
+int qbank_find_category(const QBank* bank, const char* name) {
+    for (uint32_t i = 0; i < bank->header->num_categories; i++) {
+        if (strncmp(bank->categories[i].name, name, QBANK_NAME_LEN) == 0) return (int)i;
+    }
+    return -1;
+}
+
+// ---- Pick n distinct random questions ----
+int qbank_pick(const QBank* bank, int category, uint32_t* ids, int n, unsigned int* seed) {
+    uint32_t first = 0, count = bank->header->count;
+    if (category >= 0) {
+        first = bank->categories[category].first;
+        count = bank->categories[category].count;
+    }
+
+    // Small pool: take all of it, shuffled
+    if (count <= (uint32_t)n) {
+        for (uint32_t i = 0; i < count; i++) ids[i] = first + i;
+        for (uint32_t i = count; i > 1; i--) {
+            uint32_t j = rand_r(seed) % i;
+            uint32_t t = ids[i - 1];
+            ids[i - 1] = ids[j];
+            ids[j] = t;
+        }
+        return (int)count;
+    }
+
+    // Large pool: rejection-sample duplicates (n is a handful of questions)
+    int picked = 0;
+    while (picked < n) {
+        uint32_t r = ((uint32_t)rand_r(seed) << 16) ^ (uint32_t)rand_r(seed);
+        uint32_t id = first + r % count;
+        int dup = 0;
+        for (int i = 0; i < picked; i++) {
+            if (ids[i] == id) {
+                dup = 1;
+                break;
+            }
+        }
+        if (!dup) ids[picked++] = id;
+    }
+    return picked;
+}
@@ -0,0 +1,85 @@
+#ifndef QBANK_H
+#define QBANK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ---- On-disk question bank ----
+// File layout (integers in the byte order of the machine that ran qbank_build,
+// which writes its structs as they are; offsets from start of file):
+//   QBankHeader
+//   QBankCategory[num_categories]    questions are sorted by category, so each
+//                                    category is a contiguous range of the index
+//   QBankEntry[count]                fixed-size index, one entry per question
+//   frames                           one ready-to-send TRV_QUESTION frame per
+//                                    question (4-byte header + payload)
+// The server mmaps the file read-only; a question is sent straight from the
+// mapping with only the 4-byte header patched with the in-game question number.
+
+#define QBANK_MAGIC        "TRVQ"
+#define QBANK_VERSION      1
+#define QBANK_MAX_CATEGORIES 256
+#define QBANK_NAME_LEN     24
+
+typedef struct {
+    char magic[4];                  // QBANK_MAGIC
+    uint32_t version;               // QBANK_VERSION
+    uint32_t count;                 // Number of questions
+    uint32_t num_categories;        // Number of QBankCategory records
+    uint64_t category_offset;       // Offset of the category table
+    uint64_t index_offset;          // Offset of the QBankEntry index
+    uint64_t frames_offset;         // Offset of the first encoded frame
+} __attribute__((packed)) QBankHeader;
+
+typedef struct {
+    uint32_t first;                 // Index of the first question in this category
+    uint32_t count;                 // Number of questions in this category
+    char name[QBANK_NAME_LEN];      // NUL-terminated category name
+} __attribute__((packed)) QBankCategory;
+
+typedef struct {
+    uint64_t frame_offset;          // Offset of the encoded TRV_QUESTION frame
+    uint16_t frame_len;             // Header + payload length in bytes
+    uint8_t correct_index;          // Index of the correct answer (0-3)
+    uint8_t category;               // Category number
+    uint32_t reserved;
+} __attribute__((packed)) QBankEntry;
+
+// ---- Mapped bank ----
+typedef struct {
+    const uint8_t* base;            // Start of the mapping
+    size_t size;                    // Mapping length
+    const QBankHeader* header;
+    const QBankCategory* categories;
+    const QBankEntry* index;
+} QBank;
+
+// Map and validate a bank file: the header, every category range (none empty)
+// and every index entry. Returns 0 on success, -1 on error (message printed).
+int qbank_open(QBank* bank, const char* path);
+
+// Unmap a bank opened with qbank_open()
+void qbank_close(QBank* bank);
+
+static inline uint32_t qbank_count(const QBank* bank) {
+    return bank->header->count;
+}
+
+static inline const QBankEntry* qbank_entry(const QBank* bank, uint32_t id) {
+    return &bank->index[id];
+}
+
+// Pointer to the encoded frame of question id (inside the mapping)
+static inline const uint8_t* qbank_frame(const QBank* bank, uint32_t id) {
+    return bank->base + bank->index[id].frame_offset;
+}
+
+// Category number for a name, or -1 if the bank has no such category
+int qbank_find_category(const QBank* bank, const char* name);
+
+// Fill ids[0..n) with distinct random question ids, from one category or from
+// the whole bank when category is -1. Returns the number of ids picked (fewer
+// than n if the pool is smaller than n).
+int qbank_pick(const QBank* bank, int category, uint32_t* ids, int n, unsigned int* seed);
+
+#endif // QBANK_H
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "protocol.h"
+#include "qbank.h"
+
+// ---- Question bank compiler ----
+// Reads tab-separated questions, one per line:
+//   category <TAB> question <TAB> option1 <TAB> option2 <TAB> option3 <TAB> option4 <TAB> correct(1-4)
+// Empty lines and lines starting with '#' are ignored.
+// Writes a QBank file (see qbank.h) that the server maps at startup.
+
+// One parsed question, with its encoded frame stored in the frames buffer
+typedef struct {
+    uint64_t offset;                // Offset of the frame in the frames buffer
+    uint16_t len;                   // Frame length (header + payload)
+    uint8_t correct_index;
+    uint8_t category;
+} Record;
+
+char category_names[QBANK_MAX_CATEGORIES][QBANK_NAME_LEN];
+uint32_t category_count[QBANK_MAX_CATEGORIES];
+int num_categories = 0;
+
+Record* records = NULL;
+size_t num_records = 0, cap_records = 0;
+char* frames = NULL;
+size_t frames_len = 0, cap_frames = 0;
+
+// ---- Helper: category name -> number (adds new categories) ----
+int category_id(const char* name) {
+    for (int i = 0; i < num_categories; i++) {
+        if (strncmp(category_names[i], name, QBANK_NAME_LEN - 1) == 0) return i;
+    }
+    if (num_categories == QBANK_MAX_CATEGORIES) return -1;
+    strncpy(category_names[num_categories], name, QBANK_NAME_LEN - 1);
+    return num_categories++;
+}
+
+// ---- Helper: parse one line and append its record and frame ----
+int add_question(char* line, int lineno) {
+    char* fields[7];
+    char* saveptr;
+    int n = 0;
+    for (char* f = strtok_r(line, "\t", &saveptr); f && n < 7; f = strtok_r(NULL, "\t", &saveptr)) {
+        fields[n++] = f;
+    }
+    int correct = n == 7 ? atoi(fields[6]) : 0;
+    if (correct < 1 || correct > 4) {
+        fprintf(stderr, "line %d: expected 7 fields ending in the correct option (1-4)\n", lineno);
+        return -1;
+    }
+    int cat = category_id(fields[0]);
+    if (cat < 0) {
+        fprintf(stderr, "line %d: too many categories\n", lineno);
+        return -1;
+    }
+
+    TrvMessage frame;
+    int len = snprintf(frame.payload, sizeof(frame.payload), "%s\n1. %s\n2. %s\n3. %s\n4. %s",
+                       fields[1], fields[2], fields[3], fields[4], fields[5]);
+    if (len >= TRV_MAX_PAYLOAD) {
+        fprintf(stderr, "line %d: question longer than %d bytes\n", lineno, TRV_MAX_PAYLOAD - 1);
+        return -1;
+    }
+    frame.type = TRV_QUESTION;
+    frame.question_id = 0;          // Patched with the in-game number at send time
+    frame.payload_len = (uint16_t)len;
+
+    if (num_records == cap_records) {
+        cap_records = cap_records ? cap_records * 2 : 1024;
+        records = realloc(records, cap_records * sizeof(Record));
+    }
+    if (frames_len + 4 + len > cap_frames) {
+        cap_frames = cap_frames ? cap_frames * 2 : 1 << 20;
+        frames = realloc(frames, cap_frames);
+    }
+    if (!records || !frames) {
+        perror("realloc failed");
+        exit(1);
+    }
+
+    Record* r = &records[num_records++];
+    r->offset = frames_len;
+    r->len = (uint16_t)(4 + len);
+    r->correct_index = (uint8_t)(correct - 1);
+    r->category = (uint8_t)cat;
+    memcpy(frames + frames_len, &frame, 4 + len);
+    frames_len += 4 + len;
+    category_count[cat]++;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <questions.tsv> <questions.qb>\n", argv[0]);
+        return 1;
+    }
+    FILE* in = fopen(argv[1], "r");
+    if (!in) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    // --- Parse all questions ---
+    char line[4096];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), in)) {
+        lineno++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') continue;
+        if (add_question(line, lineno) < 0) return 1;
+    }
+    fclose(in);
+    if (num_records == 0) {
+        fprintf(stderr, "%s: no questions\n", argv[1]);
+        return 1;
+    }
+
+    // --- Group questions by category (counting sort) ---
+    QBankCategory cats[QBANK_MAX_CATEGORIES];
+    uint32_t next[QBANK_MAX_CATEGORIES];
+    uint32_t first = 0;
+    memset(cats, 0, sizeof(cats));
+    for (int c = 0; c < num_categories; c++) {
+        cats[c].first = first;
+        cats[c].count = category_count[c];
+        memcpy(cats[c].name, category_names[c], QBANK_NAME_LEN);
+        next[c] = first;
+        first += category_count[c];
+    }
+    uint32_t* order = malloc(num_records * sizeof(uint32_t));
+    for (size_t i = 0; i < num_records; i++) order[next[records[i].category]++] = i;
+
+    // --- Write header, category table, index, then frames in index order ---
+    QBankHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, QBANK_MAGIC, 4);
+    h.version = QBANK_VERSION;
+    h.count = (uint32_t)num_records;
+    h.num_categories = (uint32_t)num_categories;
+    h.category_offset = sizeof(h);
+    h.index_offset = h.category_offset + num_categories * sizeof(QBankCategory);
+    h.frames_offset = h.index_offset + num_records * sizeof(QBankEntry);
+
+    FILE* out = fopen(argv[2], "wb");
+    if (!out) {
+        perror(argv[2]);
+        return 1;
+    }
+    fwrite(&h, sizeof(h), 1, out);
+    fwrite(cats, sizeof(QBankCategory), num_categories, out);
+
+    uint64_t offset = h.frames_offset;
+    for (size_t i = 0; i < num_records; i++) {
+        Record* r = &records[order[i]];
+        QBankEntry e;
+        memset(&e, 0, sizeof(e));
+        e.frame_offset = offset;
+        e.frame_len = r->len;
+        e.correct_index = r->correct_index;
+        e.category = r->category;
+        fwrite(&e, sizeof(e), 1, out);
+        offset += r->len;
+    }
+    for (size_t i = 0; i < num_records; i++) {
+        Record* r = &records[order[i]];
+        fwrite(frames + r->offset, 1, r->len, out);
+    }
+    if (fclose(out) != 0) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    printf("Wrote %zu questions in %d categories to %s\n", num_records, num_categories, argv[2]);
+    return 0;
+}
@@ -0,0 +1,828 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include "protocol.h"
+#include "frame.h"
+#include "event_loop.h"
+#include "histogram.h"
+#include "capture.h"
+
+// ---- Capture replay ----
+// Sends the client side of a capture (server -r) to a server again. Every
+// captured connection is opened at its captured time and sends the same
+// frames in the same order. The auth reply carries the new server's code.
+// ACKs, NACKs and answers are sent the captured think time after their
+// question reaches the replayed connection. Everything else keeps its
+// captured offset. -x speeds the schedule up: -x 10 plays ten seconds of
+// capture per second. Server timers (lobby, answer timeout) keep their own
+// pace, so a compressed replay measures how a build takes connect and frame
+// bursts rather than whole games. Given several ports, the capture is played
+// against each in turn and the runs are compared with the first.
+//
+// Usage: ./replay [-s server_ip] [-t threads] [-x speed] [-T max_seconds] capture_file port [port...]
+//        ./replay -l capture_file        (print the records)
+
+#define SERVER_IP "127.0.0.1"
+#define REPLAY_MAX_THREADS 64
+#define REPLAY_MAX_ROOMS 1024       // MAX_ROOMS in room.h
+#define REPLAY_MAX_RUNS 8
+#define ANCHORED_QUESTIONS 64       // Question ids that responses can be timed from
+
+// ---- Session lifecycle ----
+enum {
+    SESSION_WAITING,                // Before its captured connect time
+    SESSION_CONNECTING,             // Non-blocking connect in progress
+    SESSION_OPEN,                   // Connected, replaying steps
+    SESSION_DONE                    // Closed
+};
+
+// ---- One frame a session sends (bytes NULL: the client closed the connection) ----
+typedef struct {
+    const uint8_t* bytes;           // As captured, in the capture's buffer
+    uint16_t len;
+    uint8_t type;
+    int8_t question;                // ACK/NACK/ANSWER: the question it responds to, else -1
+    uint64_t at_ns;                 // Capture time, from the first record
+    uint64_t gap_ns;                // Since the question reached the client (question >= 0)
+} Step;
+
+struct ReplayThread;
+
+// ---- One captured connection ----
+typedef struct Session {
+    EventHandler ev;                // TCP socket registration (must be first)
+
+    // --- From the capture ---
+    uint32_t conn;                  // ConnHandle in the captured server
+    uint64_t open_ns;
+    Step* steps;
+    int num_steps;
+    int cap_steps;
+    int room;                       // Room in the capture, -1 before TRV_AUTH_OK
+    uint64_t joined_ns;
+    uint64_t seen_ns[ANCHORED_QUESTIONS];  // Capture time + 1 question q reached it over TCP, 0 if not
+    int got_result;                 // 1 if the server ended it (TRV_WINNER or TRV_AUTH_FAIL)
+    int closed;
+    uint64_t close_ns;
+
+    // --- Replay ---
+    struct ReplayThread* thread;
+    int sock;
+    int state;                      // SESSION_* state
+    int wire;
+    FrameRing in;
+    char code[17];                  // From TRV_AUTH_CODE, "" before
+    int next;                       // Next step
+    uint64_t arrived_ns[ANCHORED_QUESTIONS];  // When question q arrived, 0 if not yet
+    int latest_question;
+    int group_room;                 // Multicast group joined, -1 if none
+    struct Session* next_in_room;
+    uint64_t t_start, t_connected, t_auth_sent;
+    Timer timer;                    // Connect time, then the next step
+} Session;
+
+// ---- Multicast group of one room, shared by the thread's sessions in it ----
+typedef struct {
+    EventHandler ev;                // Must be first
+    int sock;                       // -1 if the group could not be joined
+    Session* sessions;              // Linked through next_in_room
+} RoomGroup;
+
+// ---- Per-thread state: no locks, merged once the threads exit ----
+typedef struct ReplayThread {
+    EventLoop loop;
+    Session** sessions;
+    int num_sessions;
+    int live;                       // Sessions not yet SESSION_DONE
+    Timer deadline;
+    Histogram connect;              // connect() -> established
+    Histogram handshake;            // Established -> TRV_AUTH_CODE
+    Histogram auth;                 // TRV_AUTH_REPLY sent -> TRV_AUTH_OK
+    Histogram slip;                 // How late frames went out against the schedule
+    uint64_t sent, received, mcast, skipped, send_errors, finished, failed, auth_failed;
+    RoomGroup* groups[REPLAY_MAX_ROOMS];
+} ReplayThread;
+
+// ---- Merged results of one run ----
+typedef struct {
+    int port;
+    double seconds;
+    Histogram connect, handshake, auth, slip;
+    uint64_t sent, received, mcast, skipped, send_errors, finished, failed, auth_failed;
+} RunResult;
+
+// ---- Configuration and the loaded capture (set before the runs) ----
+struct sockaddr_in server_addr;
+int num_threads = 4;
+double speed = 1.0;
+int max_seconds = 0;                // 0 = until every session is done
+uint8_t* capture;                   // The whole file; steps point into it
+Session* sessions;
+int num_sessions;
+int captured_results;               // Sessions the captured server ended
+uint64_t capture_dropped;           // Records the captured server lost to full rings
+uint64_t run_start_ns;
+int mcast_warned = 0;
+
+ReplayThread threads[REPLAY_MAX_THREADS];
+RunResult runs[REPLAY_MAX_RUNS];
+
+// ---- Function declarations ----
+int load_capture(const char* path, int list);
+void replay(RunResult* run);
+void session_connect(Session* s);
+void session_on_event(EventHandler* h, uint32_t events);
+void session_on_timer(void* arg);
+void session_process(Session* s, TrvMessage* msg);
+void session_question(Session* s, uint32_t qid);
+void session_schedule(Session* s);
+void session_send(Session* s, const Step* st);
+void session_join_group(Session* s, const char* ip, int port);
+void session_done(Session* s, int failed);
+void group_on_event(EventHandler* h, uint32_t events);
+void thread_on_deadline(void* arg);
+void print_run(const RunResult* r);
+void print_comparison(const RunResult* base, const RunResult* r);
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(int argc, char* argv[]) {
+    const char* server_ip = SERVER_IP;
+    int list = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:t:x:T:l")) != -1) {
+        switch (opt) {
+            case 's': server_ip = optarg; break;
+            case 't': num_threads = atoi(optarg); break;
+            case 'x': speed = atof(optarg); break;
+            case 'T': max_seconds = atoi(optarg); break;
+            case 'l': list = 1; break;
+            default:
+                fprintf(stderr, "Usage: %s [-s server_ip] [-t threads] [-x speed] [-T max_seconds] capture_file port [port...]\n"
+                                "       %s -l capture_file\n", argv[0], argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc || (!list && optind + 1 >= argc)) {
+        fprintf(stderr, "Usage: %s [-s server_ip] [-t threads] [-x speed] [-T max_seconds] capture_file port [port...]\n"
+                        "       %s -l capture_file\n", argv[0], argv[0]);
+        return 1;
+    }
+    if (num_threads < 1) num_threads = 1;
+    if (num_threads > REPLAY_MAX_THREADS) num_threads = REPLAY_MAX_THREADS;
+    if (speed <= 0) speed = 1.0;
+
+    if (load_capture(argv[optind], list) < 0) return 1;
+    if (list) return 0;
+    printf("Loaded %d session(s) from %s", num_sessions, argv[optind]);
+    if (capture_dropped) printf(" (the server dropped %llu records; the capture is incomplete)", (unsigned long long)capture_dropped);
+    printf(".\n");
+
+    server_addr.sin_family = AF_INET;
+    if (inet_pton(AF_INET, server_ip, &server_addr.sin_addr) != 1) {
+        fprintf(stderr, "Bad server address '%s'\n", server_ip);
+        return 1;
+    }
+
+    // One socket per session plus the multicast groups
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    for (int t = 0; t < num_threads; t++) {
+        if (event_loop_init(&threads[t].loop, t) < 0) return 1;
+        threads[t].sessions = malloc((num_sessions / num_threads + 1) * sizeof(Session*));
+        if (!threads[t].sessions) {
+            perror("malloc failed");
+            return 1;
+        }
+    }
+
+    int num_runs = 0;
+    for (int i = optind + 1; i < argc && num_runs < REPLAY_MAX_RUNS; i++) {
+        RunResult* r = &runs[num_runs++];
+        r->port = atoi(argv[i]);
+        server_addr.sin_port = htons(r->port);
+        printf("Replaying at %gx against %s:%d...\n", speed, server_ip, r->port);
+        replay(r);
+        print_run(r);
+    }
+    for (int i = 1; i < num_runs; i++) print_comparison(&runs[0], &runs[i]);
+    return 0;
+}
+
+// ---- Loading: index the records, merged across threads by time ----
+typedef struct {
+    const CaptureRecord* rec;
+    size_t order;                   // Position in the file, to keep same-time records stable
+} Entry;
+
+static int by_time(const void* a, const void* b) {
+    const Entry* x = a;
+    const Entry* y = b;
+    if (x->rec->ts_ns != y->rec->ts_ns) return x->rec->ts_ns < y->rec->ts_ns ? -1 : 1;
+    return x->order < y->order ? -1 : x->order > y->order;
+}
+
+// Type, question id and length of the frame at p; 0 if it is cut short
+static int frame_info(const uint8_t* p, uint32_t len, int wire, uint8_t* type, uint32_t* qid) {
+    uint32_t header = wire == TRV_WIRE_V2 ? TRV_V2_HEADER_LEN : FRAME_HEADER_LEN;
+    if (len < header) return 0;
+    uint32_t payload = trv_get16(p + 2);  // v1 frames are little-endian on x86 too
+    if (len < header + payload) return 0;
+    *type = p[0];
+    *qid = wire == TRV_WIRE_V2 ? trv_get32(p + 4) : p[1];
+    return header + payload;
+}
+
+static const char* type_name(uint8_t type) {
+    static const char* names[] = { "?", "QUESTION", "ACK", "ANSWER", "KEEPALIVE", "WINNER", "AUTH_CODE",
+                                   "AUTH_REPLY", "AUTH_OK", "AUTH_FAIL", "NACK" };
+    return type < sizeof(names) / sizeof(names[0]) ? names[type] : "?";
+}
+
+// ---- Connection handle -> session (open addressing) ----
+static uint32_t* keys;
+static int* slots;
+static uint32_t table_size;
+
+static Session* session_of(uint32_t conn, int create, uint64_t t) {
+    uint32_t i = (conn * 2654435761u) & (table_size - 1);
+    while (slots[i] >= 0 && keys[i] != conn) i = (i + 1) & (table_size - 1);
+    if (slots[i] >= 0) return &sessions[slots[i]];
+    if (!create) return NULL;
+    Session* s = &sessions[num_sessions];
+    memset(s, 0, sizeof(*s));
+    s->conn = conn;
+    s->open_ns = t;
+    s->room = -1;
+    keys[i] = conn;
+    slots[i] = num_sessions++;
+    return s;
+}
+
+static void add_step(Session* s, const Step* st) {
+    if (s->num_steps == s->cap_steps) {
+        s->cap_steps = s->cap_steps ? s->cap_steps * 2 : 16;
+        s->steps = realloc(s->steps, s->cap_steps * sizeof(Step));
+        if (!s->steps) {
+            perror("realloc failed");
+            exit(1);
+        }
+    }
+    s->steps[s->num_steps++] = *st;
+}
+
+// Print one record (-l)
+static void list_record(const CaptureRecord* rec, uint64_t t0) {
+    static const char* kinds[] = { "?", "OPEN", "IN", "OUT", "MCAST", "CLOSE", "DROPPED" };
+    const uint8_t* p = (const uint8_t*)(rec + 1);
+    printf("%12.6f %-7s %-10u", (rec->ts_ns - t0) / 1e9, kinds[rec->kind <= CAPTURE_DROPPED ? rec->kind : 0], rec->conn);
+    if (rec->kind == CAPTURE_OPEN && rec->len >= sizeof(struct sockaddr_in)) {
+        struct sockaddr_in addr;
+        memcpy(&addr, p, sizeof(addr));
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+        printf(" %s:%d", ip, ntohs(addr.sin_port));
+    }
+    uint32_t off = 0;
+    uint8_t type;
+    uint32_t qid;
+    int n;
+    while (rec->kind != CAPTURE_OPEN && (n = frame_info(p + off, rec->len - off, rec->wire, &type, &qid)) > 0) {
+        uint32_t header = rec->wire == TRV_WIRE_V2 ? TRV_V2_HEADER_LEN : FRAME_HEADER_LEN;
+        int text = n - header > 40 ? 40 : n - header;
+        printf(" %s%s q=%u \"", off ? "| " : "", type_name(type), qid);
+        for (int i = 0; i < text; i++) putchar(p[off + header + i] >= ' ' ? p[off + header + i] : '.');
+        printf("\"");
+        off += n;
+    }
+    printf("\n");
+}
+
+int load_capture(const char* path, int list) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        perror("Capture file open failed");
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    capture = malloc(size > 0 ? size : 1);
+    CaptureFileHeader* hdr = (CaptureFileHeader*)capture;
+    if (!capture || size < (long)sizeof(*hdr) || fread(capture, 1, size, f) != (size_t)size ||
+        memcmp(hdr->magic, CAPTURE_MAGIC, 4) != 0 || hdr->version != CAPTURE_VERSION) {
+        fprintf(stderr, "%s is not a version %d capture file\n", path, CAPTURE_VERSION);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    // --- Index every record (a partial record at the end is ignored) ---
+    size_t count = 0, cap = 4096;
+    Entry* entries = malloc(cap * sizeof(Entry));
+    long pos = sizeof(*hdr);
+    while (entries && pos + (long)sizeof(CaptureRecord) <= size) {
+        const CaptureRecord* rec = (const CaptureRecord*)(capture + pos);
+        long next = pos + sizeof(CaptureRecord) + CAPTURE_ALIGN(rec->len);
+        if (next > size) break;
+        entries[count].rec = rec;
+        entries[count].order = count;
+        if (++count == cap) {
+            cap *= 2;
+            entries = realloc(entries, cap * sizeof(Entry));
+        }
+        pos = next;
+    }
+    if (!entries) {
+        perror("malloc failed");
+        return -1;
+    }
+    qsort(entries, count, sizeof(Entry), by_time);
+    uint64_t t0 = count ? entries[0].rec->ts_ns : 0;
+    if (list) {
+        for (size_t i = 0; i < count; i++) list_record(entries[i].rec, t0);
+        return 0;
+    }
+
+    // --- Fold the records into sessions and their steps ---
+    table_size = 1024;
+    while (table_size < count * 2) table_size *= 2;
+    keys = malloc(table_size * sizeof(uint32_t));
+    slots = malloc(table_size * sizeof(int));
+    sessions = malloc((count + 1) * sizeof(Session));
+    static uint64_t mcast_seen[REPLAY_MAX_ROOMS][ANCHORED_QUESTIONS];  // Time + 1 room's group got question q
+    static int mcast_last[REPLAY_MAX_ROOMS];
+    if (!keys || !slots || !sessions) {
+        perror("malloc failed");
+        return -1;
+    }
+    memset(slots, 0xff, table_size * sizeof(int));
+
+    for (size_t i = 0; i < count; i++) {
+        const CaptureRecord* rec = entries[i].rec;
+        const uint8_t* p = (const uint8_t*)(rec + 1);
+        uint64_t t = rec->ts_ns - t0;
+        Session* s;
+        uint8_t type;
+        uint32_t qid;
+        int n;
+
+        if (rec->kind == CAPTURE_OPEN) {
+            session_of(rec->conn, 1, t);
+        } else if (rec->kind == CAPTURE_IN && frame_info(p, rec->len, rec->wire, &type, &qid) > 0) {
+            // Connections already open when the capture started are replayed from their first frame
+            s = session_of(rec->conn, 1, t);
+            Step st = { p, rec->len, type, -1, t, 0 };
+            if ((type == TRV_ACK || type == TRV_NACK || type == TRV_ANSWER) && qid < ANCHORED_QUESTIONS) {
+                // Timed from whichever copy of the question reached the client first
+                uint64_t seen = s->seen_ns[qid];
+                uint64_t m = s->room >= 0 && s->room < REPLAY_MAX_ROOMS ? mcast_seen[s->room][qid] : 0;
+                if (m && m - 1 >= s->joined_ns && (!seen || m < seen)) seen = m;
+                if (seen && t >= seen - 1) {
+                    st.question = (int8_t)qid;
+                    st.gap_ns = t - (seen - 1);
+                }
+            }
+            add_step(s, &st);
+        } else if (rec->kind == CAPTURE_OUT && (s = session_of(rec->conn, 0, t)) != NULL) {
+            for (uint32_t off = 0; (n = frame_info(p + off, rec->len - off, rec->wire, &type, &qid)) > 0; off += n) {
+                if (type == TRV_QUESTION && qid < ANCHORED_QUESTIONS && !s->seen_ns[qid]) s->seen_ns[qid] = t + 1;
+                if (type == TRV_AUTH_OK) {
+                    char text[TRV_MAX_PAYLOAD];
+                    uint32_t header = rec->wire == TRV_WIRE_V2 ? TRV_V2_HEADER_LEN : FRAME_HEADER_LEN;
+                    memcpy(text, p + off + header, n - header);
+                    text[n - header] = '\0';
+                    char* room = strstr(text, "Room ");
+                    if (room) sscanf(room, "Room %d", &s->room);
+                    s->joined_ns = t;
+                }
+                if (type == TRV_WINNER || type == TRV_AUTH_FAIL) s->got_result = 1;
+            }
+        } else if (rec->kind == CAPTURE_MCAST && rec->conn < REPLAY_MAX_ROOMS &&
+                   frame_info(p, rec->len, TRV_WIRE_V1, &type, &qid) > 0) {
+            // A lower question id than the last one means the room started a new game
+            uint64_t* seen = mcast_seen[rec->conn];
+            if (type == TRV_WINNER || (type == TRV_QUESTION && (int)qid < mcast_last[rec->conn])) {
+                memset(seen, 0, sizeof(mcast_seen[0]));
+            }
+            if (type == TRV_QUESTION && qid < ANCHORED_QUESTIONS) {
+                if (!seen[qid]) seen[qid] = t + 1;
+                mcast_last[rec->conn] = qid;
+            }
+        } else if (rec->kind == CAPTURE_CLOSE && (s = session_of(rec->conn, 0, t)) != NULL) {
+            s->closed = 1;
+            s->close_ns = t;
+        } else if (rec->kind == CAPTURE_DROPPED) {
+            capture_dropped += rec->conn;
+        }
+    }
+
+    // A connection the server closed without ending it was closed by its client
+    for (int i = 0; i < num_sessions; i++) {
+        Session* s = &sessions[i];
+        captured_results += s->got_result;
+        if (s->closed && !s->got_result) {
+            Step st = { NULL, 0, 0, -1, s->close_ns, 0 };
+            add_step(s, &st);
+        }
+    }
+    free(entries);
+    return 0;
+}
+
+// ---- One run against server_addr ----
+void replay(RunResult* run) {
+    for (int t = 0; t < num_threads; t++) {
+        ReplayThread* th = &threads[t];
+        th->num_sessions = 0;
+        th->live = 0;
+        hist_init(&th->connect);
+        hist_init(&th->handshake);
+        hist_init(&th->auth);
+        hist_init(&th->slip);
+        th->sent = th->received = th->mcast = th->skipped = th->send_errors = 0;
+        th->finished = th->failed = th->auth_failed = 0;
+        memset(th->groups, 0, sizeof(th->groups));
+    }
+
+    // Session i runs on thread i % num_threads
+    run_start_ns = now_ns() + 100000000;  // A moment to set everything up
+    for (int i = 0; i < num_sessions; i++) {
+        Session* s = &sessions[i];
+        ReplayThread* th = &threads[i % num_threads];
+        s->thread = th;
+        s->sock = -1;
+        s->state = SESSION_WAITING;
+        s->wire = TRV_WIRE_V1;
+        s->code[0] = '\0';
+        s->next = 0;
+        memset(s->arrived_ns, 0, sizeof(s->arrived_ns));
+        s->latest_question = -1;
+        s->group_room = -1;
+        s->t_auth_sent = 0;
+        s->ev.on_event = session_on_event;
+        timer_init(&s->timer, session_on_timer, s);
+        uint64_t at = run_start_ns + (uint64_t)(s->open_ns / speed);
+        uint64_t now = now_ns();
+        event_loop_timer(&th->loop, &s->timer, at > now ? (at - now) / 1000000 : 0);
+        th->sessions[th->num_sessions++] = s;
+        th->live++;
+    }
+    for (int t = 0; t < num_threads; t++) {
+        ReplayThread* th = &threads[t];
+        timer_init(&th->deadline, thread_on_deadline, th);
+        if (max_seconds > 0) event_loop_timer(&th->loop, &th->deadline, (uint64_t)max_seconds * 1000);
+        if (th->live == 0) continue;
+        if (event_loop_start(&th->loop) != 0) {
+            perror("pthread_create failed");
+            exit(1);
+        }
+    }
+    for (int t = 0; t < num_threads; t++) {
+        if (threads[t].num_sessions > 0) pthread_join(threads[t].loop.thread, NULL);
+    }
+    run->seconds = (now_ns() - run_start_ns) / 1e9;
+
+    // --- Sessions cut off by -T; then merge the threads' results ---
+    hist_init(&run->connect);
+    hist_init(&run->handshake);
+    hist_init(&run->auth);
+    hist_init(&run->slip);
+    for (int t = 0; t < num_threads; t++) {
+        ReplayThread* th = &threads[t];
+        timer_cancel(&th->deadline);
+        for (int i = 0; i < th->num_sessions; i++) {
+            if (th->sessions[i]->state != SESSION_DONE) session_done(th->sessions[i], 0);
+        }
+        for (int g = 0; g < REPLAY_MAX_ROOMS; g++) {
+            if (!th->groups[g]) continue;
+            if (th->groups[g]->sock >= 0) {
+                event_loop_del(&th->loop, th->groups[g]->sock);
+                close(th->groups[g]->sock);
+            }
+            free(th->groups[g]);
+        }
+        hist_merge(&run->connect, &th->connect);
+        hist_merge(&run->handshake, &th->handshake);
+        hist_merge(&run->auth, &th->auth);
+        hist_merge(&run->slip, &th->slip);
+        run->sent += th->sent;
+        run->received += th->received;
+        run->mcast += th->mcast;
+        run->skipped += th->skipped;
+        run->send_errors += th->send_errors;
+        run->finished += th->finished;
+        run->failed += th->failed;
+        run->auth_failed += th->auth_failed;
+    }
+}
+
+// ---- Start a non-blocking connect ----
+void session_connect(Session* s) {
+    ReplayThread* t = s->thread;
+    s->sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s->sock < 0) {
+        perror("socket failed");
+        session_done(s, 1);
+        return;
+    }
+    frame_ring_init(&s->in);
+    s->t_start = now_ns();
+    if (connect(s->sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0 && errno != EINPROGRESS) {
+        session_done(s, 1);
+        return;
+    }
+    s->state = SESSION_CONNECTING;
+    if (event_loop_add(&t->loop, s->sock, &s->ev, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET) < 0) {
+        perror("epoll_ctl failed");
+        session_done(s, 1);
+    }
+}
+
+// ---- TCP socket readiness ----
+void session_on_event(EventHandler* h, uint32_t events) {
+    Session* s = (Session*)h;
+    ReplayThread* t = s->thread;
+
+    if (s->state == SESSION_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(s->sock, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0 || (events & (EPOLLERR | EPOLLHUP))) {
+            session_done(s, 1);
+            return;
+        }
+        if (!(events & EPOLLOUT)) return;
+        s->t_connected = now_ns();
+        hist_record(&t->connect, (s->t_connected - s->t_start) / 1000);
+        s->state = SESSION_OPEN;
+        event_loop_mod(&t->loop, s->sock, &s->ev, EPOLLIN | EPOLLRDHUP | EPOLLET);
+        session_schedule(s);
+    }
+
+    // Edge-triggered: drain the socket, then every complete frame
+    while (s->state == SESSION_OPEN) {
+        int n = frame_ring_fill(&s->in, s->sock);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            session_done(s, 0);     // The server ended it (or reset it)
+            return;
+        }
+        TrvMessage msg;
+        int res = 0;
+        uint32_t id;
+        uint8_t arg;
+        while (s->state == SESSION_OPEN) {
+            if (s->wire == TRV_WIRE_V2) res = frame_next_v2(&s->in, &msg, &id, &arg);
+            else if ((res = frame_next(&s->in, &msg)) > 0) id = msg.question_id;
+            if (res != 1) break;
+            t->received++;
+            if (msg.type == TRV_QUESTION) session_question(s, id);
+            else session_process(s, &msg);
+        }
+        if (s->state == SESSION_OPEN && res < 0) {
+            session_done(s, 1);     // Corrupt stream
+            return;
+        }
+        if (n < 0) return;          // EAGAIN: wait for the next edge
+    }
+}
+
+// ---- One frame from the server (other than a question) ----
+void session_process(Session* s, TrvMessage* msg) {
+    ReplayThread* t = s->thread;
+    if (msg->type == TRV_AUTH_CODE) {
+        hist_record(&t->handshake, (now_ns() - s->t_connected) / 1000);
+        snprintf(s->code, sizeof(s->code), "%.16s", msg->payload);
+        session_schedule(s);
+    } else if (msg->type == TRV_AUTH_OK) {
+        if (s->t_auth_sent) hist_record(&t->auth, (now_ns() - s->t_auth_sent) / 1000);
+        if (strstr(msg->payload, "\nv2 game ")) s->wire = TRV_WIRE_V2;
+
+        // The welcome ends with "Room <n>, multicast <ip>:<port>" (or ", tcp")
+        char ip[INET_ADDRSTRLEN];
+        int room, port;
+        char* line = strstr(msg->payload, "Room ");
+        if (line && sscanf(line, "Room %d, multicast %15[0-9.]:%d", &room, ip, &port) == 3 &&
+            room >= 0 && room < REPLAY_MAX_ROOMS) {
+            s->group_room = room;
+            session_join_group(s, ip, port);
+        }
+    } else if (msg->type == TRV_AUTH_FAIL) {
+        t->auth_failed++;
+    } else if (msg->type == TRV_WINNER) {
+        t->finished++;
+    }
+}
+
+// ---- A question arrived (TCP or multicast): steps waiting for it may go ----
+void session_question(Session* s, uint32_t qid) {
+    if (s->state != SESSION_OPEN || qid >= ANCHORED_QUESTIONS || s->arrived_ns[qid]) return;
+    s->arrived_ns[qid] = now_ns();
+    if ((int)qid > s->latest_question) s->latest_question = qid;
+    session_schedule(s);
+}
+
+// ---- Send every step that is due, then arm the timer for the next one ----
+// A step that depends on the auth code or on a question waits for it; one
+// whose question never came (a later one did) is skipped.
+void session_schedule(Session* s) {
+    ReplayThread* t = s->thread;
+    while (s->state == SESSION_OPEN && s->next < s->num_steps) {
+        const Step* st = &s->steps[s->next];
+        uint64_t due;
+        if (st->type == TRV_AUTH_REPLY && !s->code[0]) return;
+        if (st->question >= 0) {
+            uint64_t at = s->arrived_ns[st->question];
+            if (!at) {
+                if (s->latest_question <= st->question) return;
+                t->skipped++;
+                s->next++;
+                continue;
+            }
+            due = at + (uint64_t)(st->gap_ns / speed);
+        } else {
+            due = run_start_ns + (uint64_t)(st->at_ns / speed);
+        }
+        uint64_t now = now_ns();
+        if (due > now + 500000) {
+            event_loop_timer(&t->loop, &s->timer, (due - now + 500000) / 1000000);
+            return;
+        }
+        hist_record(&t->slip, now > due ? (now - due) / 1000 : 0);
+        s->next++;
+        session_send(s, st);
+    }
+}
+
+// ---- Send one captured frame (the auth reply with this server's code) ----
+void session_send(Session* s, const Step* st) {
+    ReplayThread* t = s->thread;
+    if (!st->bytes) {
+        session_done(s, 0);         // The client hung up here in the capture
+        return;
+    }
+    const void* buf = st->bytes;
+    int len = st->len;
+    TrvMessage msg;
+    if (st->type == TRV_AUTH_REPLY && len > FRAME_HEADER_LEN) {
+        // "code|nickname|options": only the code changes
+        char payload[TRV_MAX_PAYLOAD];
+        int n = len - FRAME_HEADER_LEN < TRV_MAX_PAYLOAD - 1 ? len - FRAME_HEADER_LEN : TRV_MAX_PAYLOAD - 1;
+        memcpy(payload, st->bytes + FRAME_HEADER_LEN, n);
+        payload[n] = '\0';
+        char* rest = strchr(payload, '|');
+        char reply[TRV_MAX_PAYLOAD];
+        snprintf(reply, sizeof(reply), "%s%s", s->code, rest ? rest : "");
+        len = build_message(&msg, TRV_AUTH_REPLY, 0, reply);
+        buf = &msg;
+        s->t_auth_sent = now_ns();
+    }
+    // Best effort, as the bench does: frames are tiny
+    if (send(s->sock, buf, len, MSG_NOSIGNAL | MSG_DONTWAIT) != len) t->send_errors++;
+    else t->sent++;
+}
+
+void session_on_timer(void* arg) {
+    Session* s = (Session*)arg;
+    if (s->state == SESSION_WAITING) session_connect(s);
+    else session_schedule(s);
+}
+
+// ---- Listen to the room's group (one socket per room and thread) ----
+void session_join_group(Session* s, const char* ip, int port) {
+    ReplayThread* t = s->thread;
+    RoomGroup* g = t->groups[s->group_room];
+    if (!g) {
+        g = calloc(1, sizeof(RoomGroup));
+        if (!g) return;
+        g->ev.on_event = group_on_event;
+        g->sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+        int reuse = 1;
+        setsockopt(g->sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+        int mcast_all = 0;
+        setsockopt(g->sock, IPPROTO_IP, IP_MULTICAST_ALL, &mcast_all, sizeof(mcast_all));
+        struct ip_mreq mreq;
+        mreq.imr_multiaddr.s_addr = inet_addr(ip);
+        mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+
+        if (g->sock < 0 || bind(g->sock, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+            setsockopt(g->sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0 ||
+            event_loop_add(&t->loop, g->sock, &g->ev, EPOLLIN | EPOLLET) < 0) {
+            if (!__atomic_exchange_n(&mcast_warned, 1, __ATOMIC_RELAXED)) {
+                perror("⚠️  Multicast join failed, relying on TCP repairs");
+            }
+            if (g->sock >= 0) close(g->sock);
+            g->sock = -1;
+        }
+        t->groups[s->group_room] = g;
+    }
+    s->next_in_room = g->sessions;
+    g->sessions = s;
+}
+
+// ---- Multicast datagrams: hand each question to every session in the room ----
+void group_on_event(EventHandler* h, uint32_t events) {
+    RoomGroup* g = (RoomGroup*)h;
+    char datagram[sizeof(TrvMessage)];
+    TrvMessage msg;
+    int n;
+    (void)events;
+    while ((n = recvfrom(g->sock, datagram, sizeof(datagram), 0, NULL, NULL)) >= 0) {
+        if (frame_decode(datagram, n, &msg) < 0 || msg.type != TRV_QUESTION) continue;
+        for (Session* s = g->sessions; s; s = s->next_in_room) {
+            s->thread->mcast++;
+            session_question(s, msg.question_id);
+        }
+    }
+}
+
+// ---- Close a session and stop the thread after its last one ----
+void session_done(Session* s, int failed) {
+    ReplayThread* t = s->thread;
+    if (s->state == SESSION_DONE) return;
+    timer_cancel(&s->timer);
+    if (s->group_room >= 0 && t->groups[s->group_room]) {
+        Session** link = &t->groups[s->group_room]->sessions;
+        while (*link && *link != s) link = &(*link)->next_in_room;
+        if (*link) *link = s->next_in_room;
+    }
+    if (s->sock >= 0) {
+        event_loop_del(&t->loop, s->sock);
+        close(s->sock);
+        s->sock = -1;
+    }
+    s->state = SESSION_DONE;
+    if (failed) t->failed++;
+    if (--t->live == 0) event_loop_stop(&t->loop);
+}
+
+void thread_on_deadline(void* arg) {
+    event_loop_stop(&((ReplayThread*)arg)->loop);
+}
+
+// ---- Reports ----
+void print_run(const RunResult* r) {
+    printf("\n=== Port %d: %d sessions, %.1f s ===\n", r->port, num_sessions, r->seconds);
+    printf("Results: %llu (capture: %d), connects failed: %llu, auth failed: %llu\n",
+           (unsigned long long)r->finished, captured_results, (unsigned long long)r->failed,
+           (unsigned long long)r->auth_failed);
+    printf("Frames: %llu sent, %llu received (%.0f/s), %llu questions via multicast\n",
+           (unsigned long long)r->sent, (unsigned long long)r->received,
+           r->seconds > 0 ? r->received / r->seconds : 0.0, (unsigned long long)r->mcast);
+    printf("Steps skipped: %llu, send errors: %llu\n\n", (unsigned long long)r->skipped,
+           (unsigned long long)r->send_errors);
+    hist_print(&r->connect, "connect");
+    hist_print(&r->handshake, "handshake");
+    hist_print(&r->auth, "auth");
+    hist_print(&r->slip, "schedule slip");
+}
+
+static void compare_row(const char* name, double a, double b) {
+    if (a > 0) printf("%-22s %12.2f %12.2f %+9.1f%%\n", name, a, b, (b - a) * 100 / a);
+    else printf("%-22s %12.2f %12.2f %10s\n", name, a, b, "-");
+}
+
+static void compare_hist(const char* name, const Histogram* a, const Histogram* b) {
+    char label[64];
+    snprintf(label, sizeof(label), "%s p50 (ms)", name);
+    compare_row(label, hist_percentile(a, 50) / 1000.0, hist_percentile(b, 50) / 1000.0);
+    snprintf(label, sizeof(label), "%s p99 (ms)", name);
+    compare_row(label, hist_percentile(a, 99) / 1000.0, hist_percentile(b, 99) / 1000.0);
+}
+
+void print_comparison(const RunResult* base, const RunResult* r) {
+    char a[16], b[16];
+    snprintf(a, sizeof(a), ":%d", base->port);
+    snprintf(b, sizeof(b), ":%d", r->port);
+    printf("\n=== Port %d against port %d ===\n", r->port, base->port);
+    printf("%-22s %12s %12s %10s\n", "", a, b, "change");
+    compare_row("results", base->finished, r->finished);
+    compare_row("frames received/s", base->seconds > 0 ? base->received / base->seconds : 0,
+                r->seconds > 0 ? r->received / r->seconds : 0);
+    compare_row("run time (s)", base->seconds, r->seconds);
+    compare_hist("connect", &base->connect, &r->connect);
+    compare_hist("handshake", &base->handshake, &r->handshake);
+    compare_hist("auth", &base->auth, &r->auth);
+}
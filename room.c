@@ -0,0 +1,908 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "room.h"
+#include "trace.h"
+#include "capture.h"
+#include "conn_pool.h"
+#include "broadcast.h"
+#include "cluster.h"
+
+Room rooms[MAX_ROOMS];
+Room* open_room = NULL;             // Room whose lobby new players join
+pthread_mutex_t rooms_lock = PTHREAD_MUTEX_INITIALIZER; // Guards open_room / room allocation
+uint32_t next_game_id = 0;          // Last game id handed out (atomic)
+int resume_lobbies = 0;             // Resumed rooms still waiting for their players (atomic)
+
+// ---- Function declarations ----
+void room_on_timer(void* arg);
+void room_on_repair(void* arg);
+void room_on_all_answered(void* arg);
+void room_advance(Room* r);
+void room_close_question(Room* r);
+void room_cluster_done(Room* r);
+void room_send_question(Room* r);
+void room_send_question_tcp(Room* r, int qid);
+int room_send_question_to(Room* r, int qid, int sock, struct sockaddr_in* to);
+Bcast* room_question_bcast(Room* r, int qid);
+int room_claim_repair(Room* r, Client* c, int qid);
+void room_announce_winner(Room* r);
+void room_finish(Room* r, const char* message);
+void room_multicast(Room* r, TrvMessage* msg);
+
+// Journal an event of r's game (cluster games are left to the coordinator)
+static inline void room_journal(Room* r, uint16_t type, uint32_t player, uint32_t a0, uint32_t a1,
+                                uint32_t a2, const char* nickname) {
+    if (journal_enabled && !r->clustered) journal_write(type, r->id, r->game_id, player, a0, a1, a2, nickname);
+}
+
+// ---- Set up all rooms ----
+void rooms_init(int mcast_port) {
+    in_addr_t group = ntohl(inet_addr(MULTICAST_IP));
+    for (int i = 0; i < MAX_ROOMS; i++) {
+        Room* r = &rooms[i];
+        memset(r, 0, sizeof(*r));
+        r->id = i;
+        timer_init(&r->timer, room_on_timer, r);
+        timer_init(&r->repair_timer, room_on_repair, r);
+        loop_task_init(&r->close_task, room_on_all_answered, r);
+        r->state = ROOM_FREE;
+        r->mcast_sock = -1;
+        pthread_mutex_init(&r->lock, NULL);
+        r->mcast_addr.sin_family = AF_INET;
+        r->mcast_addr.sin_addr.s_addr = htonl(group + i);
+        r->mcast_addr.sin_port = htons(mcast_port);
+    }
+}
+
+// ---- Double a seat block's columns (on the block's loop, room lock held) ----
+static int seats_grow(RoomSeats* s) {
+    int cap = s->cap ? s->cap * 2 : 64;
+    Client** conns = aligned_alloc(64, cap * sizeof(Client*));
+    QuestionSet* acked = aligned_alloc(64, cap * sizeof(QuestionSet));
+    QuestionSet* answered = aligned_alloc(64, cap * sizeof(QuestionSet));
+    int* score = aligned_alloc(64, cap * sizeof(int));
+    uint8_t* via_tcp = aligned_alloc(64, cap);
+    if (!conns || !acked || !answered || !score || !via_tcp) {
+        free(conns);
+        free(acked);
+        free(answered);
+        free(score);
+        free(via_tcp);
+        return -1;
+    }
+    if (s->count) {
+        memcpy(conns, s->conns, s->count * sizeof(Client*));
+        memcpy(acked, s->acked, s->count * sizeof(QuestionSet));
+        memcpy(answered, s->answered, s->count * sizeof(QuestionSet));
+        memcpy(score, s->score, s->count * sizeof(int));
+        memcpy(via_tcp, s->via_tcp, s->count);
+    }
+    free(s->conns);
+    free(s->acked);
+    free(s->answered);
+    free(s->score);
+    free(s->via_tcp);
+    s->conns = conns;
+    s->acked = acked;
+    s->answered = answered;
+    s->score = score;
+    s->via_tcp = via_tcp;
+    s->cap = cap;
+    return 0;
+}
+
+// ---- Give a client the next seat of its loop in r (on that loop, room lock held) ----
+static int room_seat(Room* r, Client* client, uint32_t player_no, int score, const QuestionSet* answered) {
+    RoomSeats* s = &r->seats[client->ev.loop->index];
+    if (s->count == s->cap && seats_grow(s) < 0) return -1;
+    int slot = s->count++;
+    s->conns[slot] = client;
+    memset(&s->acked[slot], 0, sizeof(QuestionSet));
+    if (answered) s->answered[slot] = *answered;
+    else memset(&s->answered[slot], 0, sizeof(QuestionSet));
+    s->score[slot] = score;
+    s->via_tcp[slot] = r->tcp_only || client->tcp_questions;
+    r->tcp_count += s->via_tcp[slot];
+    memset(&client->repaired, 0, sizeof(client->repaired));
+    client->room_slot = slot;
+    client->player_no = player_no;
+    r->player_count++;
+    __atomic_store_n(&client->room, r, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// ---- A player of a resumed game is back: old seat, score and answers ----
+// Called with rooms_lock held. Returns the room, or NULL if no resumed lobby
+// waits for this nickname.
+static Room* room_rejoin(Client* client) {
+    for (int i = 0; i < MAX_ROOMS; i++) {
+        Room* r = &rooms[i];
+        if (!__atomic_load_n(&r->resumed, __ATOMIC_RELAXED)) continue;
+        pthread_mutex_lock(&r->lock);
+        for (int p = 0; r->state == ROOM_LOBBY && p < r->num_returning; p++) {
+            JournalPlayer* jp = &r->returning[p];
+            if (!jp->nickname[0] || strcmp(jp->nickname, client->nickname) != 0) continue;
+            if (room_seat(r, client, p, jp->score, &jp->answered) < 0) break;
+            jp->nickname[0] = '\0';
+            if (jp->score > 0) {
+                scoreboard_update(&r->scores, client->ev.loop->index, client->handle, client->nickname, jp->score);
+            }
+            room_journal(r, JOURNAL_AUTH, p, 0, 0, 0, client->nickname);
+            pthread_mutex_unlock(&r->lock);
+            printf("🔁 Room %d: %s is back with %d point(s).\n", r->id, client->nickname, jp->score);
+            return r;
+        }
+        pthread_mutex_unlock(&r->lock);
+    }
+    return NULL;
+}
+
+// ---- Matchmaking: join the open lobby or open a new room ----
+Room* room_join(Client* client) {
+    int opened = 0;
+    pthread_mutex_lock(&rooms_lock);
+
+    Room* r = __atomic_load_n(&resume_lobbies, __ATOMIC_RELAXED) > 0 ? room_rejoin(client) : NULL;
+    if (r) {
+        pthread_mutex_unlock(&rooms_lock);
+        return r;
+    }
+
+    r = open_room;
+    if (r) {
+        pthread_mutex_lock(&r->lock);
+        if (r->state != ROOM_LOBBY || r->player_count >= MAX_ROOM_PLAYERS) {
+            pthread_mutex_unlock(&r->lock);
+            r = NULL;
+        }
+    }
+    if (!r && cluster_mode) {
+        pthread_mutex_unlock(&rooms_lock);  // Lobbies open only when the coordinator says so
+        return NULL;
+    }
+    if (!r) {
+        for (int i = 0; i < MAX_ROOMS && !r; i++) {
+            pthread_mutex_lock(&rooms[i].lock);
+            if (rooms[i].state == ROOM_FREE) r = &rooms[i];
+            else pthread_mutex_unlock(&rooms[i].lock);
+        }
+        if (!r) {
+            pthread_mutex_unlock(&rooms_lock);
+            return NULL;
+        }
+        __atomic_store_n(&r->state, ROOM_LOBBY, __ATOMIC_RELEASE);
+        r->loop = event_loop_current();
+        scoreboard_reset(&r->scores);
+        event_loop_timer(r->loop, &r->timer, GAME_LOBBY_TIME * 1000);
+        r->player_count = 0;
+        r->tcp_count = 0;
+        r->num_questions = 0;
+        r->tcp_only = question_delivery == DELIVER_TCP;
+        r->game_id = __atomic_add_fetch(&next_game_id, 1, __ATOMIC_RELAXED);
+        r->clustered = 0;
+        r->players_joined = 0;
+        r->resumed = 0;
+        open_room = r;
+        opened = 1;
+        room_journal(r, JOURNAL_GAME, 0, 0, 0, 0, NULL);
+    }
+
+    if (room_seat(r, client, r->players_joined, 0, 0) < 0) {
+        pthread_mutex_unlock(&r->lock);
+        pthread_mutex_unlock(&rooms_lock);
+        return NULL;
+    }
+    room_journal(r, JOURNAL_AUTH, r->players_joined++, 0, 0, 0, client->nickname);
+
+    pthread_mutex_unlock(&r->lock);
+    pthread_mutex_unlock(&rooms_lock);
+
+    if (opened) printf("🚪 Room %d lobby open for %d seconds...\n", r->id, GAME_LOBBY_TIME);
+    return r;
+}
+
+// ---- Remove a disconnecting client from its room ----
+void room_leave(Client* client) {
+    Room* r = __atomic_load_n(&client->room, __ATOMIC_ACQUIRE);
+    if (!r) return;
+
+    pthread_mutex_lock(&r->lock);
+    if (client->room == r) {
+        // Swap-remove from this loop's seats (we are on that loop)
+        RoomSeats* s = &r->seats[client->ev.loop->index];
+        int slot = client->room_slot;
+        int answered = qset_has(&s->answered[slot], r->current_question);
+        int last = --s->count;
+        r->tcp_count -= s->via_tcp[slot];
+        s->conns[slot] = s->conns[last];
+        s->acked[slot] = s->acked[last];
+        s->answered[slot] = s->answered[last];
+        s->score[slot] = s->score[last];
+        s->via_tcp[slot] = s->via_tcp[last];
+        s->conns[slot]->room_slot = slot;
+        r->player_count--;
+        __atomic_store_n(&client->room, NULL, __ATOMIC_RELEASE);
+
+        // The player's answer no longer counts toward closing the question early,
+        // but its departure may mean everyone left has now answered
+        if (r->state == ROOM_QUESTION || r->state == ROOM_STARTING) {
+            uint64_t w = __atomic_load_n(&r->window, __ATOMIC_ACQUIRE);
+            while ((w >> 32) == (uint64_t)r->current_question + 1 && (uint32_t)w > 0 && answered &&
+                   !__atomic_compare_exchange_n(&r->window, &w, w - 1, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            }
+            if (r->player_count == 0 || (w >> 32) != 0) event_loop_post(r->loop, &r->close_task);
+        }
+    }
+    pthread_mutex_unlock(&r->lock);
+}
+
+// ---- Score an answer (lock-free) ----
+// Runs on the player's event loop, which is the only writer of the player's
+// seat columns and of that loop's scoreboard shard. The answer window packs the open
+// question and its answer count into one word, so a single CAS both checks the
+// answer is on time and counts it; an answer can never leak into the next question.
+void room_answer(Client* client, uint32_t qid, int ans) {
+    Room* r = __atomic_load_n(&client->room, __ATOMIC_ACQUIRE);
+    if (!r || qid >= QUESTIONS_PER_GAME) return;
+
+    uint64_t w = __atomic_load_n(&r->window, __ATOMIC_ACQUIRE);
+    if ((w >> 32) != (uint64_t)qid + 1) {
+        trace_event(TRACE_ANSWER_LATE, conn_index(client->handle), qid, 0, 0, 0);
+        return;
+    }
+    RoomSeats* s = &r->seats[client->ev.loop->index];
+    int slot = client->room_slot;
+    if (qset_has(&s->answered[slot], qid)) {
+        trace_event(TRACE_ANSWER_DUP, conn_index(client->handle), qid, 0, 0, 0);
+        return;
+    }
+    *qset_word(&s->answered[slot], qid) |= qset_bit(qid);
+    do {
+        if ((w >> 32) != (uint64_t)qid + 1) return;  // Closed while we were counting
+    } while (!__atomic_compare_exchange_n(&r->window, &w, w + 1, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    // question_open_ms was written before the window opened
+    uint64_t open_ms = __atomic_load_n(&r->question_open_ms, __ATOMIC_RELAXED);
+    uint64_t latency = client->rx_ms > open_ms ? client->rx_ms - open_ms : 0;
+
+    const QBankEntry* q = qbank_entry(&bank, r->questions[qid]);
+    int correct = ans == q->correct_index + 1;
+    if (correct) {
+        int score = ++s->score[slot];
+        scoreboard_update(&r->scores, client->ev.loop->index, client->handle, client->nickname, score);
+    }
+    trace_event(TRACE_ANSWER, conn_index(client->handle), qid, ans, correct, (uint32_t)latency);
+    room_journal(r, JOURNAL_ANSWER, client->player_no, qid, (uint32_t)ans, (uint32_t)s->score[slot], NULL);
+
+    if ((uint32_t)(w + 1) >= (uint32_t)__atomic_load_n(&r->player_count, __ATOMIC_RELAXED)) {
+        event_loop_post(r->loop, &r->close_task);  // Last answer: don't wait for the timeout
+    }
+}
+
+// ---- TRV_ACK: the player has question qid (called on the player's event loop) ----
+void room_ack(Client* client, uint32_t qid) {
+    Room* r = __atomic_load_n(&client->room, __ATOMIC_ACQUIRE);
+    if (!r || qid >= QUESTIONS_PER_GAME) return;
+
+    // Single writer: only the room's loop reads this column concurrently
+    uint64_t* acked = qset_word(&r->seats[client->ev.loop->index].acked[client->room_slot], qid);
+    uint64_t bit = qset_bit(qid);
+    uint64_t old = *acked;
+    __atomic_store_n(acked, old | bit, __ATOMIC_RELAXED);
+    if (!(old & bit) && qid == (uint32_t)__atomic_load_n(&r->current_question, __ATOMIC_RELAXED)) {
+        __atomic_add_fetch(&r->ack_count, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// ---- TRV_NACK: the player saw a gap in the question sequence ----
+// Only the open question is worth repairing; each player gets one repair per question.
+void room_nack(Client* client, uint32_t qid) {
+    Room* r = __atomic_load_n(&client->room, __ATOMIC_ACQUIRE);
+    if (!r || __atomic_load_n(&r->state, __ATOMIC_ACQUIRE) != ROOM_QUESTION) return;
+    if (qid != (uint32_t)__atomic_load_n(&r->current_question, __ATOMIC_RELAXED)) return;
+    if (!room_claim_repair(r, client, qid)) return;
+    Bcast* b = room_question_bcast(r, qid);
+    if (!b) return;
+    conn_send_bcast(client, b, BCAST_BULK);  // On the player's own loop
+    bcast_unref(b);
+}
+
+// ---- Every player answered (or left): close the question without waiting ----
+// Runs on the room's loop; the count is checked again under the lock since
+// players may have joined the count or left since the task was posted.
+void room_on_all_answered(void* arg) {
+    Room* r = (Room*)arg;
+    pthread_mutex_lock(&r->lock);
+    if (r->state == ROOM_STARTING || r->state == ROOM_QUESTION) {
+        uint64_t w = __atomic_load_n(&r->window, __ATOMIC_ACQUIRE);
+        if (r->player_count == 0 && !r->clustered) {
+            printf("🚪 Room %d: every player left, ending the game.\n", r->id);
+            timer_cancel(&r->timer);
+            room_announce_winner(r);
+        } else if (r->state == ROOM_QUESTION && (w >> 32) == (uint64_t)r->current_question + 1 &&
+                   (uint32_t)w >= (uint32_t)r->player_count) {
+            if (r->clustered) {
+                room_cluster_done(r);  // The coordinator decides when the question closes
+                pthread_mutex_unlock(&r->lock);
+                return;
+            }
+            printf("⏩ Room %d: every player answered question %d after %llu ms.\n", r->id,
+                   r->current_question + 1, (unsigned long long)(now_ms() - r->question_open_ms));
+            timer_cancel(&r->timer);
+            room_advance(r);
+        }
+    }
+    pthread_mutex_unlock(&r->lock);
+}
+
+// ---- Room timer: the current phase is over ----
+void room_on_timer(void* arg) {
+    Room* r = (Room*)arg;
+    pthread_mutex_lock(&r->lock);
+    room_advance(r);
+    pthread_mutex_unlock(&r->lock);
+}
+
+// ---- A resumed room's lobby closes: players not back keep their scores ----
+// They are listed under numbers no connection handle has (generation 0).
+static void room_close_returning(Room* r) {
+    for (int i = 0; i < r->num_returning; i++) {
+        JournalPlayer* jp = &r->returning[i];
+        if (jp->nickname[0] && jp->score > 0) {
+            scoreboard_update(&r->scores, r->loop->index, (uint32_t)(MAX_CLIENTS + i), jp->nickname, jp->score);
+        }
+    }
+    free(r->returning);
+    r->returning = NULL;
+    r->num_returning = 0;
+    __atomic_sub_fetch(&resume_lobbies, 1, __ATOMIC_RELAXED);
+}
+
+// ---- Room state machine (called with r->lock held, on the room's loop) ----
+void room_advance(Room* r) {
+    if (r->state == ROOM_LOBBY) {
+        if (r->resumed) room_close_returning(r);
+        if (r->player_count == 0) {
+            room_journal(r, JOURNAL_END, 0, 0, 0, 0, NULL);
+            __atomic_store_n(&r->resumed, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&r->state, ROOM_FREE, __ATOMIC_RELEASE);  // Everyone left before the game started
+            return;
+        }
+        printf("Room %d lobby closed with %d players. Starting game!\n", r->id, r->player_count);
+
+        // --- Multicast from the room's loop's long-lived UDP socket ---
+        r->mcast_sock = broadcast_mcast_socket(r->loop);
+
+        // Send dummy data to help clients join group early
+        char dummy_data[1] = {0};
+        if (r->tcp_count < r->player_count) {
+            sendto(r->mcast_sock, dummy_data, sizeof(dummy_data), 0,
+                   (struct sockaddr*)&r->mcast_addr, sizeof(r->mcast_addr));
+        }
+
+        __atomic_store_n(&r->state, ROOM_STARTING, __ATOMIC_RELEASE);
+        // Give clients 2 seconds before the first question (the coordinator's clock in a cluster)
+        if (!r->clustered) event_loop_timer(r->loop, &r->timer, 2000);
+    } else if (r->state == ROOM_STARTING) {
+        if (r->resumed) {
+            r->current_question = r->resume_from;  // Questions came from the journal
+        } else {
+            // --- Pick this game's questions from the bank (the same on every cluster node) ---
+            unsigned int seed = r->clustered ? r->cluster_seed : (unsigned int)now_ms() ^ (unsigned int)r->id;
+            r->num_questions = qbank_pick(&bank, bank_category, r->questions, QUESTIONS_PER_GAME, &seed);
+            r->current_question = 0;
+            for (int q = 0; q < r->num_questions; q++) {
+                room_journal(r, JOURNAL_PICK, 0, q, r->questions[q], r->num_questions, NULL);
+            }
+        }
+        if (r->num_questions == 0) {  // Nothing to ask: straight to the (empty) results
+            room_announce_winner(r);
+            return;
+        }
+        __atomic_store_n(&r->state, ROOM_QUESTION, __ATOMIC_RELEASE);  // Publishes questions[]
+        room_send_question(r);
+        if (!r->clustered) event_loop_timer(r->loop, &r->timer, ANSWER_TIMEOUT * 1000);
+    } else if (r->state == ROOM_QUESTION) {
+        room_close_question(r);
+        if (r->current_question + 1 < r->num_questions) {
+            __atomic_store_n(&r->current_question, r->current_question + 1, __ATOMIC_RELAXED);
+            room_send_question(r);
+            event_loop_timer(r->loop, &r->timer, ANSWER_TIMEOUT * 1000);
+        } else {
+            room_announce_winner(r);
+        }
+    }
+}
+
+// ---- Close the open question's answer window and report on it ----
+void room_close_question(Room* r) {
+    uint64_t w = __atomic_exchange_n(&r->window, 0, __ATOMIC_ACQ_REL);
+    printf("📊 Room %d question %d: %d/%d players acked, %u answered, %d repairs.\n", r->id,
+           r->current_question + 1, r->ack_count, r->player_count, (uint32_t)w, r->repair_count);
+}
+
+// ---- Send question qid straight from the bank mapping ----
+// Only the 4-byte header is copied so the in-game question number (which is also
+// the datagram sequence number) can be patched in.
+int room_send_question_to(Room* r, int qid, int sock, struct sockaddr_in* to) {
+    const uint8_t* frame = qbank_frame(&bank, r->questions[qid]);
+    const QBankEntry* q = qbank_entry(&bank, r->questions[qid]);
+    uint8_t header[FRAME_HEADER_LEN];
+    memcpy(header, frame, FRAME_HEADER_LEN);
+    header[1] = (uint8_t)qid;       // question_id
+
+    struct iovec iov[2];
+    iov[0].iov_base = header;
+    iov[0].iov_len = FRAME_HEADER_LEN;
+    iov[1].iov_base = (void*)(frame + FRAME_HEADER_LEN);
+    iov[1].iov_len = q->frame_len - FRAME_HEADER_LEN;
+
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_name = to;
+    mh.msg_namelen = to ? sizeof(*to) : 0;
+    mh.msg_iov = iov;
+    mh.msg_iovlen = 2;
+    if (capture_enabled) capture_write(CAPTURE_MCAST, r->id, TRV_WIRE_V1, header, FRAME_HEADER_LEN, iov[1].iov_base, iov[1].iov_len);
+    return sendmsg(sock, &mh, MSG_NOSIGNAL);
+}
+
+// ---- Send the current question and start tracking ACK coverage ----
+// Multicast reaches everyone who listens to the group; players that asked for
+// TCP delivery (or every player with -d tcp) get it over their connection.
+void room_send_question(Room* r) {
+    int i = r->current_question;
+    __atomic_store_n(&r->ack_count, 0, __ATOMIC_RELAXED);
+    r->repair_count = 0;
+    r->repair_round = 0;
+    r->last_mcast_ms = now_ms();
+    __atomic_store_n(&r->question_open_ms, r->last_mcast_ms, __ATOMIC_RELAXED);
+    room_journal(r, JOURNAL_QUESTION, 0, i, 0, 0, NULL);
+
+    // In a resumed game some players may have answered this one before the crash
+    uint64_t answers = 0;
+    for (int l = 0; r->resumed && l < num_loops; l++) {
+        RoomSeats* s = &r->seats[l];
+        for (int p = 0; p < s->count; p++) answers += (__atomic_load_n(qset_word(&s->answered[p], i), __ATOMIC_RELAXED) & qset_bit(i)) != 0;
+    }
+    __atomic_store_n(&r->window, (uint64_t)(i + 1) << 32 | answers, __ATOMIC_RELEASE);  // Open for answers
+    if (answers > 0 && answers >= (uint64_t)r->player_count) event_loop_post(r->loop, &r->close_task);
+    if (r->tcp_count < r->player_count &&
+        room_send_question_to(r, i, r->mcast_sock, &r->mcast_addr) < 0) perror("sendto failed");
+    if (r->tcp_count > 0) room_send_question_tcp(r, i);
+    event_loop_timer(r->loop, &r->repair_timer, REPAIR_DELAY_MS);
+
+    printf("📨 Room %d: sent question %d. Waiting for answers...\n", r->id, i + 1);
+}
+
+// ---- Deliver question qid over TCP to the players that get it that way ----
+// One shared frame per question; each loop writes it to its own players, paced
+// in batches so thousands of sends don't leave as one burst.
+void room_send_question_tcp(Room* r, int qid) {
+    Bcast* b = room_question_bcast(r, qid);
+    if (!b) return;
+    for (int l = 0; l < num_loops; l++) {
+        RoomSeats* s = &r->seats[l];
+        if (r->tcp_only) {
+            bcast_fanout(b, &loops[l], s->conns, s->count, BCAST_BULK | BCAST_PACED);
+            continue;
+        }
+        Client** due = malloc(s->count * sizeof(Client*) + 1);
+        if (!due) break;
+        int n = 0;
+        for (int i = 0; i < s->count; i++) {
+            if (s->via_tcp[i]) due[n++] = s->conns[i];
+        }
+        bcast_fanout(b, &loops[l], due, n, BCAST_BULK | BCAST_PACED);
+        free(due);
+    }
+    bcast_unref(b);
+}
+
+// ---- Encode question qid as a TCP frame, for TCP delivery and repairs ----
+// Both wire versions are encoded; each connection is sent the one it speaks.
+Bcast* room_question_bcast(Room* r, int qid) {
+    const uint8_t* frame = qbank_frame(&bank, r->questions[qid]);
+    const QBankEntry* q = qbank_entry(&bank, r->questions[qid]);
+    Bcast* b = bcast_alloc(q->frame_len);
+    if (!b) return NULL;
+    memcpy(b->data, frame, q->frame_len);
+    b->data[1] = (char)qid;         // question_id
+    b->v2 = bcast_new_v2(TRV_QUESTION, 0, (uint32_t)qid, frame + FRAME_HEADER_LEN,
+                         q->frame_len - FRAME_HEADER_LEN);
+    return b;
+}
+
+// ---- A player is due a TCP repair of qid (at most once per question) ----
+// Returns 1 if the caller should send it.
+int room_claim_repair(Room* r, Client* c, int qid) {
+    uint64_t bit = qset_bit(qid);
+    if (__atomic_fetch_or(qset_word(&c->repaired, qid), bit, __ATOMIC_RELAXED) & bit) return 0;
+    __atomic_add_fetch(&r->repair_count, 1, __ATOMIC_RELAXED);
+    trace_event(TRACE_REPAIR, conn_index(c->handle), qid, 0, 0, 0);
+    return 1;
+}
+
+// ---- Repair timer: resend the open question to players that did not ACK it ----
+// When many players are missing it, one multicast retransmit (at most every
+// MCAST_REPAIR_INTERVAL_MS) is cheaper; otherwise repair each player over TCP.
+// Rounds back off exponentially, up to REPAIR_ROUNDS per question. The last round
+// always goes over TCP in case multicast is not reaching the players at all.
+void room_on_repair(void* arg) {
+    Room* r = (Room*)arg;
+    pthread_mutex_lock(&r->lock);
+    if (r->state != ROOM_QUESTION) {
+        pthread_mutex_unlock(&r->lock);
+        return;
+    }
+
+    int qid = r->current_question;
+    int missing = r->player_count - __atomic_load_n(&r->ack_count, __ATOMIC_RELAXED);
+    if (missing > 0) {
+        uint64_t now = now_ms();
+        if (!r->tcp_only && r->repair_round < REPAIR_ROUNDS - 1 &&
+            missing * 100 >= r->player_count * MCAST_REPAIR_PERCENT &&
+            now - r->last_mcast_ms >= MCAST_REPAIR_INTERVAL_MS) {
+            r->last_mcast_ms = now;
+            room_send_question_to(r, qid, r->mcast_sock, &r->mcast_addr);
+        } else {
+            // Scan the ACK column of each loop's seats; only misses touch a Client.
+            // Each loop then sends the one encoded frame to its own missing players.
+            uint64_t bit = qset_bit(qid);
+            Bcast* b = room_question_bcast(r, qid);
+            for (int l = 0; b && l < num_loops; l++) {
+                RoomSeats* s = &r->seats[l];
+                Client** due = malloc(s->count * sizeof(Client*) + 1);
+                if (!due) break;
+                int n = 0;
+                for (int i = 0; i < s->count; i++) {
+                    if (!(__atomic_load_n(qset_word(&s->acked[i], qid), __ATOMIC_RELAXED) & bit) &&
+                        room_claim_repair(r, s->conns[i], qid)) {
+                        due[n++] = s->conns[i];
+                    }
+                }
+                bcast_fanout(b, &loops[l], due, n, BCAST_BULK);
+                free(due);
+            }
+            if (b) bcast_unref(b);
+        }
+        if (++r->repair_round < REPAIR_ROUNDS) {
+            event_loop_timer(r->loop, &r->repair_timer, (uint64_t)REPAIR_DELAY_MS << r->repair_round);
+        }
+    }
+    pthread_mutex_unlock(&r->lock);
+}
+
+// ---- Announce winner to the room's players and free the room ----
+// Results come from the merged top-K, so this is O(K) no matter how many play.
+void room_announce_winner(Room* r) {
+    __atomic_store_n(&r->window, 0, __ATOMIC_RELEASE);         // Stop scoring first
+    ScoreEntry top[LEADERBOARD_K];
+    int n = scoreboard_top(&r->scores, num_loops, top, LEADERBOARD_K);
+    char message[TRV_MAX_PAYLOAD];
+    scoreboard_format(top, n, r->player_count, message, sizeof(message));
+    room_finish(r, message);
+}
+
+// ---- Send the results to every player, close their connections, free the room ----
+// The results are the room's own, or the cluster's merged ones on a cluster node.
+void room_finish(Room* r, const char* message) {
+    __atomic_store_n(&r->window, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&r->state, ROOM_FREE, __ATOMIC_RELEASE);
+    timer_cancel(&r->repair_timer);
+    room_journal(r, JOURNAL_END, 0, 0, 0, 0, NULL);
+    __atomic_store_n(&r->resumed, 0, __ATOMIC_RELAXED);
+
+    TrvMessage winmsg;
+    build_message(&winmsg, TRV_WINNER, 0, message);
+
+    // Send to all players (TCP); their event loops close the sockets.
+    // The message is encoded once and each loop sends it to its own players.
+    Bcast* b = bcast_new(&winmsg);
+    if (b) b->v2 = bcast_new_v2(TRV_WINNER, 0, r->game_id, winmsg.payload, winmsg.payload_len);
+    for (int l = 0; l < num_loops; l++) {
+        RoomSeats* s = &r->seats[l];
+        int queued = b && bcast_fanout(b, &loops[l], s->conns, s->count, BCAST_SHUTDOWN) == 0;
+        for (int i = 0; i < s->count; i++) {
+            Client* c = s->conns[i];
+            if (!queued) shutdown(c->socket, SHUT_RDWR);  // Out of memory: at least end the game
+            __atomic_store_n(&c->room, NULL, __ATOMIC_RELEASE);
+        }
+        s->count = 0;
+    }
+    if (b) bcast_unref(b);
+
+    // Also announce result via multicast
+    if (!r->tcp_only) room_multicast(r, &winmsg);
+    r->mcast_sock = -1;
+
+    printf("Room %d:%s", r->id, message);
+    printf("\nRoom %d game over.\n", r->id);
+    r->player_count = 0;
+}
+
+// ---- Cluster node: the coordinator drives rooms[0] (all on loop 0) ----
+// The node's partition of the coordinator's game is an ordinary room whose
+// phase changes come from the coordinator instead of the room's timers, so
+// the room's players see exactly the standalone protocol.
+void room_cluster_open(uint32_t game_id) {
+    Room* r = &rooms[0];
+    pthread_mutex_lock(&rooms_lock);
+    pthread_mutex_lock(&r->lock);
+    if (r->state != ROOM_FREE) room_announce_winner(r);  // Previous game never got its results
+    __atomic_store_n(&r->state, ROOM_LOBBY, __ATOMIC_RELEASE);
+    r->loop = &loops[0];
+    scoreboard_reset(&r->scores);
+    r->player_count = 0;
+    r->tcp_count = 0;
+    r->num_questions = 0;
+    r->tcp_only = question_delivery == DELIVER_TCP;
+    r->game_id = game_id;
+    r->clustered = 1;
+    r->done_sent = 0;
+    r->players_joined = 0;
+    open_room = r;
+    pthread_mutex_unlock(&r->lock);
+    pthread_mutex_unlock(&rooms_lock);
+    printf("🚪 Room %d lobby open for cluster game %u...\n", r->id, game_id);
+}
+
+void room_cluster_begin(unsigned seed) {
+    Room* r = &rooms[0];
+    pthread_mutex_lock(&r->lock);
+    if (r->state == ROOM_LOBBY) {
+        r->cluster_seed = seed;
+        room_advance(r);            // With no players here the room is freed and sits the game out
+    }
+    pthread_mutex_unlock(&r->lock);
+}
+
+// A node with nothing to ask (no players, or a smaller bank) reports the
+// question as answered at once, so it never holds up the cluster.
+void room_cluster_question(uint32_t qid) {
+    Room* r = &rooms[0];
+    pthread_mutex_lock(&r->lock);
+    if (r->state == ROOM_STARTING && qid == 0) {
+        room_advance(r);            // Picks the questions and sends the first
+    } else if (r->state == ROOM_QUESTION && qid == (uint32_t)r->current_question + 1 &&
+               qid < (uint32_t)r->num_questions) {
+        room_close_question(r);
+        __atomic_store_n(&r->current_question, (int)qid, __ATOMIC_RELAXED);
+        room_send_question(r);
+    } else {
+        cluster_send(TRV_CLUSTER_DONE, qid, "");
+        pthread_mutex_unlock(&r->lock);
+        return;
+    }
+    if (r->player_count == 0) room_cluster_done(r);
+    pthread_mutex_unlock(&r->lock);
+}
+
+// ---- Every local player answered: tell the coordinator, once per question ----
+void room_cluster_done(Room* r) {
+    if (r->done_sent == r->current_question + 1) return;
+    r->done_sent = r->current_question + 1;
+    cluster_send(TRV_CLUSTER_DONE, (uint32_t)r->current_question, "");
+}
+
+// ---- Report the local player count and top K: "players\nscore nickname\n..." ----
+void room_cluster_end(void) {
+    Room* r = &rooms[0];
+    char report[TRV_MAX_PAYLOAD];
+    int players = 0, n = 0;
+    ScoreEntry top[LEADERBOARD_K];
+    pthread_mutex_lock(&r->lock);
+    if (r->state == ROOM_QUESTION) {
+        room_close_question(r);
+        timer_cancel(&r->repair_timer);
+        __atomic_store_n(&r->state, ROOM_RESULTS, __ATOMIC_RELEASE);
+        players = r->player_count;
+        n = scoreboard_top(&r->scores, num_loops, top, LEADERBOARD_K);
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    int len = snprintf(report, sizeof(report), "%d\n", players);
+    for (int i = 0; i < n && len < (int)sizeof(report); i++) {
+        len += snprintf(report + len, sizeof(report) - len, "%d %s\n", top[i].score, top[i].nickname);
+    }
+    cluster_send(TRV_CLUSTER_SCORES, 0, report);
+}
+
+void room_cluster_result(const char* text) {
+    Room* r = &rooms[0];
+    pthread_mutex_lock(&r->lock);
+    if (r->state == ROOM_RESULTS) room_finish(r, text);
+    pthread_mutex_unlock(&r->lock);
+}
+
+// ---- The coordinator is gone: end a running game with this node's own results ----
+void room_cluster_lost(void) {
+    Room* r = &rooms[0];
+    pthread_mutex_lock(&r->lock);
+    if (r->state != ROOM_FREE) room_announce_winner(r);
+    pthread_mutex_unlock(&r->lock);
+}
+
+// ---- Crash recovery: reopen the journal's unfinished games ----
+// A game that never got its questions has no scores to save; its players just
+// join a new game. Games keep their ids, so their journal records carry on.
+void rooms_resume(JournalGame* games, int count) {
+    int id = 0;
+    for (int i = 0; i < count; i++) {
+        JournalGame* g = &games[i];
+        if (g->game > next_game_id) next_game_id = g->game;
+        if (g->ended || g->num_questions == 0) continue;
+        while (id < MAX_ROOMS && rooms[id].state != ROOM_FREE) id++;
+        JournalPlayer* returning = malloc(g->num_players * sizeof(JournalPlayer) + 1);
+        if (id == MAX_ROOMS || !returning) {
+            fprintf(stderr, "No room left to resume game %u\n", g->game);
+            free(returning);
+            continue;
+        }
+        memcpy(returning, g->players, g->num_players * sizeof(JournalPlayer));
+
+        Room* r = &rooms[id];
+        r->loop = &loops[id % num_loops];
+        r->state = ROOM_LOBBY;
+        r->game_id = g->game;
+        r->tcp_only = question_delivery == DELIVER_TCP;
+        r->clustered = 0;
+        memcpy(r->questions, g->questions, sizeof(r->questions));
+        r->num_questions = g->num_questions;
+        r->resume_from = g->asked > 0 ? g->asked - 1 : 0;  // The open question is asked again
+        r->players_joined = g->num_players;
+        r->returning = returning;
+        r->num_returning = g->num_players;
+        r->resumed = 1;
+        resume_lobbies++;
+        scoreboard_reset(&r->scores);
+        timer_add(&r->loop->timers, &r->timer, now_ms() + GAME_LOBBY_TIME * 1000);
+        g->room = id;
+        g->resumed = 1;
+        printf("🔁 Room %d: resuming game %u at question %d; its %d player(s) have %d seconds to return.\n",
+               id, g->game, r->resume_from + 1, g->num_players, GAME_LOBBY_TIME);
+    }
+}
+
+// ---- Hot restart: everything a room needs to resume in another process ----
+// Called with every loop paused (or not started yet), so no lock is taken.
+int room_save(int id, HandoverRoom* out) {
+    Room* r = &rooms[id];
+    if (r->state == ROOM_FREE) return -1;
+    memset(out, 0, sizeof(*out));
+    out->id = id;
+    out->loop = r->loop->index;
+    out->state = r->state;
+    out->is_open = open_room == r;
+    out->game_id = r->game_id;
+    out->tcp_only = r->tcp_only;
+    out->clustered = r->clustered;
+    out->cluster_seed = r->cluster_seed;
+    out->done_sent = r->done_sent;
+    memcpy(out->questions, r->questions, sizeof(out->questions));
+    out->num_questions = r->num_questions;
+    out->current_question = r->current_question;
+    out->window = r->window;
+    out->question_open_ms = r->question_open_ms;
+    out->timer = timer_pending(&r->timer) ? r->timer.expires : 0;
+    out->repair_timer = timer_pending(&r->repair_timer) ? r->repair_timer.expires : 0;
+    out->repair_round = r->repair_round;
+    out->last_mcast_ms = r->last_mcast_ms;
+    out->ack_count = r->ack_count;
+    out->repair_count = r->repair_count;
+    out->players_joined = r->players_joined;
+    out->resumed = r->resumed;
+    out->resume_from = r->resume_from;
+    out->num_returning = r->num_returning;
+    for (int l = 0; l < num_loops; l++) {
+        ScoreShard* s = &r->scores.shards[l];
+        for (int i = 0; i < s->count; i++) {
+            out->scores[out->num_scores].shard = l;
+            out->scores[out->num_scores++].entry = s->top[i];
+        }
+    }
+    return 0;
+}
+
+// Seats were filled by room_restore_seat(); a shard of the old server goes to
+// the loop its players were moved to, and merging two shards' top K keeps
+// every entry that can still reach the overall top K.
+void room_restore(const HandoverRoom* in) {
+    Room* r = &rooms[in->id];
+    r->loop = &loops[in->loop % num_loops];
+    r->state = in->state;
+    r->game_id = in->game_id;
+    r->tcp_only = in->tcp_only;
+    r->clustered = in->clustered;
+    r->cluster_seed = in->cluster_seed;
+    r->done_sent = in->done_sent;
+    memcpy(r->questions, in->questions, sizeof(r->questions));
+    r->num_questions = in->num_questions;
+    r->current_question = in->current_question;
+    r->window = in->window;
+    r->question_open_ms = in->question_open_ms;
+    r->repair_round = in->repair_round;
+    r->last_mcast_ms = in->last_mcast_ms;
+    r->ack_count = in->ack_count;
+    r->repair_count = in->repair_count;
+    r->players_joined = in->players_joined;
+    r->resumed = in->resumed;
+    r->resume_from = in->resume_from;
+    if (in->num_returning > 0) {
+        // Filled in by room_restore_returning(); unknown numbers stay empty
+        r->returning = calloc(in->num_returning, sizeof(JournalPlayer));
+        r->num_returning = r->returning ? in->num_returning : 0;
+        resume_lobbies++;
+    }
+    scoreboard_reset(&r->scores);
+    for (int i = 0; i < in->num_scores; i++) {
+        const ScoreEntry* e = &in->scores[i].entry;
+        scoreboard_update(&r->scores, in->scores[i].shard % num_loops, e->player, e->nickname, e->score);
+    }
+    if (r->state != ROOM_LOBBY) r->mcast_sock = broadcast_mcast_socket(r->loop);
+    if (in->timer) timer_add(&r->loop->timers, &r->timer, in->timer);
+    if (in->repair_timer) timer_add(&r->loop->timers, &r->repair_timer, in->repair_timer);
+    if (in->is_open) open_room = r;
+    if (in->game_id > next_game_id) next_game_id = in->game_id;
+
+    // Answers or departures may have closed the question while it was in transit
+    if (r->state == ROOM_STARTING || r->state == ROOM_QUESTION) event_loop_post(r->loop, &r->close_task);
+}
+
+int room_save_returning(int id, int first, JournalPlayer* out, int count) {
+    Room* r = &rooms[id];
+    if (first >= r->num_returning) return 0;
+    if (count > r->num_returning - first) count = r->num_returning - first;
+    memcpy(out, r->returning + first, count * sizeof(JournalPlayer));
+    return count;
+}
+
+int room_restore_returning(int id, int first, const JournalPlayer* in, int count) {
+    Room* r = &rooms[id];
+    if (first < 0 || count < 0 || first + count > r->num_returning) return -1;
+    memcpy(r->returning + first, in, count * sizeof(JournalPlayer));
+    return 0;
+}
+
+void room_save_seat(Client* c, HandoverClient* out) {
+    Room* r = c->room;
+    out->room = r ? r->id : -1;
+    if (!r) return;
+    out->player_no = c->player_no;
+    RoomSeats* s = &r->seats[c->ev.loop->index];
+    out->acked = s->acked[c->room_slot];
+    out->answered = s->answered[c->room_slot];
+    out->score = s->score[c->room_slot];
+    out->via_tcp = s->via_tcp[c->room_slot];
+}
+
+int room_restore_seat(Client* c, const HandoverClient* in) {
+    Room* r = &rooms[in->room];
+    RoomSeats* s = &r->seats[c->ev.loop->index];
+    if (s->count == s->cap && seats_grow(s) < 0) return -1;
+    int slot = s->count++;
+    s->conns[slot] = c;
+    s->acked[slot] = in->acked;
+    s->answered[slot] = in->answered;
+    s->score[slot] = in->score;
+    s->via_tcp[slot] = (uint8_t)in->via_tcp;
+    r->tcp_count += s->via_tcp[slot];
+    r->player_count++;
+    c->room_slot = slot;
+    c->player_no = in->player_no;
+    c->room = r;
+    return 0;
+}
+
+// ---- Helper: send a message to the room's multicast group ----
+void room_multicast(Room* r, TrvMessage* msg) {
+    capture_event(CAPTURE_MCAST, r->id, TRV_WIRE_V1, msg, 4 + msg->payload_len);
+    sendto(r->mcast_sock, msg, 4 + msg->payload_len, 0,
+           (struct sockaddr*)&r->mcast_addr, sizeof(r->mcast_addr));
+}
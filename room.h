@@ -0,0 +1,146 @@
+#ifndef ROOM_H
+#define ROOM_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include "server.h"
+#include "scoreboard.h"
+#include "handover.h"
+#include "journal.h"
+
+#define MAX_ROOMS 1024
+#define MAX_ROOM_PLAYERS 4096
+#define REPAIR_DELAY_MS 250           // First repair round after a question is sent
+#define REPAIR_ROUNDS 4               // Repair rounds per question (delay doubles each round)
+#define MCAST_REPAIR_PERCENT 25       // Re-multicast instead of unicast if this many % lack the question
+#define MCAST_REPAIR_INTERVAL_MS 200  // Minimum gap between multicasts of the same question
+
+// Question sets are sized to the game and v2 and cluster frames carry 32-bit
+// question ids; only v1 and multicast frames limit the length of a game
+_Static_assert(QUESTIONS_PER_GAME <= TRV_V1_QUESTIONS, "v1 and multicast frames carry the question in a byte");
+
+_Static_assert(SCOREBOARD_SHARDS >= MAX_LOOPS, "one scoreboard shard per event loop");
+
+// ---- Room lifecycle ----
+enum {
+    ROOM_FREE,                      // Not in use
+    ROOM_LOBBY,                     // Accepting players until the lobby deadline
+    ROOM_STARTING,                  // Lobby closed, group primed, questions about to start
+    ROOM_QUESTION,                  // current_question is open for answers
+    ROOM_RESULTS                    // Cluster node: scores reported, waiting for the merged results
+};
+
+// ---- The room's players that live on one event loop, as column arrays ----
+// Only that loop writes acked/answered/score (lock-free), and only that loop
+// joins or removes its players (under the room lock), so growing the arrays
+// never races with a writer. The room's loop scans the columns under the lock
+// as contiguous arrays. Blocks of different loops never share a cache line.
+typedef struct {
+    int count;
+    int cap;
+    Client** conns;                 // Cold: socket and nickname, for sends
+    QuestionSet* acked;             // Questions the player ACKed
+    QuestionSet* answered;          // Questions the player answered
+    int* score;                     // Correct answers this game
+    uint8_t* via_tcp;               // 1 if questions go over the player's TCP connection
+} __attribute__((aligned(64))) RoomSeats;
+
+// ---- One game: lobby, question schedule, multicast group and scoreboard ----
+typedef struct Room {
+    int id;                         // Index in rooms[]
+    EventLoop* loop;                // Loop whose timer wheel drives this room's schedule
+    pthread_mutex_t lock;           // Guards everything below
+    Timer timer;                    // Fires when the current phase ends (room's loop only)
+    LoopTask close_task;            // Posted to the room's loop when every player has answered
+    int state;                      // ROOM_* state
+    RoomSeats seats[MAX_LOOPS];     // Players, grouped by the loop that owns them
+    int player_count;               // Sum of seats[].count
+    int tcp_count;                  // Players whose questions go over TCP
+    int tcp_only;                   // 1: no multicast at all in this room (-d tcp)
+    uint32_t game_id;               // Unique per game, given to v2 clients
+    int clustered;                  // 1: the coordinator drives the schedule (cluster.h)
+    unsigned cluster_seed;          // Coordinator's seed, so every node picks the same questions
+    int done_sent;                  // Cluster: question + 1 already reported as all answered
+    uint32_t questions[QUESTIONS_PER_GAME]; // Bank ids, in game order
+    int num_questions;
+    int current_question;           // Index into questions[] while ROOM_QUESTION (also the sequence number)
+    uint64_t window;                // Answer window: (open question + 1) << 32 | answers; 0 = closed (atomic)
+    uint64_t question_open_ms;      // When the open question was sent
+    struct sockaddr_in mcast_addr;  // Multicast group/port of this room
+    int mcast_sock;                 // Room loop's multicast socket while the game runs
+    Timer repair_timer;             // Next repair round for the open question
+    int repair_round;               // Repair rounds done for the open question
+    uint64_t last_mcast_ms;         // Last (re)multicast of the open question
+    int ack_count;                  // Players that ACKed the open question (atomic)
+    int repair_count;               // TCP repairs sent for the open question (atomic)
+    Scoreboard scores;              // Per-loop top-K shards (written without the lock)
+    uint32_t players_joined;        // Player numbers handed out this game
+    int resumed;                    // 1: a game restored from the journal (journal.h)
+    int resume_from;                // Resumed game: question it goes on with
+    JournalPlayer* returning;       // Resumed game's players by number while its lobby is open;
+    int num_returning;              //   a nickname is cleared once its player is back
+} Room;
+
+// Set up all rooms; room n multicasts to MULTICAST_IP + n on mcast_port
+void rooms_init(int mcast_port);
+
+// Put an authenticated client in the open lobby, opening a new room if needed.
+// A new room is driven by the calling thread's event loop. A player of a
+// resumed game gets their old seat back instead.
+// Returns the room, or NULL if every room is busy.
+Room* room_join(Client* client);
+
+// Remove a client from its room (no-op if it is not in one)
+void room_leave(Client* client);
+
+// Score a TRV_ANSWER from a player (called on the player's event loop).
+// Only the first answer to the open question counts; late and duplicate
+// answers are rejected. The last player to answer closes the question early.
+void room_answer(Client* client, uint32_t qid, int ans);
+
+// Record a TRV_ACK for a question (called on the player's event loop)
+void room_ack(Client* client, uint32_t qid);
+
+// Repair a question the player reports missing with TRV_NACK
+void room_nack(Client* client, uint32_t qid);
+
+// ---- Cluster node (cluster.h): coordinator steps, run on loop 0 ----
+void room_cluster_open(uint32_t game_id);   // Open the lobby of the coordinator's game
+void room_cluster_begin(unsigned seed);     // Close the lobby
+void room_cluster_question(uint32_t qid);   // Send question qid
+void room_cluster_end(void);                // Close the last question and report scores
+void room_cluster_result(const char* text); // Send the merged results and free the room
+void room_cluster_lost(void);               // Coordinator gone: finish with local results
+
+// ---- Crash recovery (journal.h): before the loops run ----
+// Reopen each unfinished game in a free room, with a lobby that only the
+// game's own players can join. They get their scores back, and once the lobby
+// closes the game goes on from the question it was at. Players who do not
+// come back keep their place in the results.
+void rooms_resume(JournalGame* games, int count);
+
+// ---- Hot restart (handover.h): only while no loop runs room code ----
+extern uint32_t next_game_id;       // Last game id handed out
+
+// Snapshot a room in use. Returns 0, or -1 if the room is free.
+int room_save(int id, HandoverRoom* out);
+
+// Recreate a room on this server, after its players were seated again.
+// Score entries must already name the players' new handles.
+void room_restore(const HandoverRoom* in);
+
+// Players a resumed room is still waiting for, count at most from first on.
+// Returns how many were copied.
+int room_save_returning(int id, int first, JournalPlayer* out, int count);
+
+// Add players a resumed room is waiting for (after room_restore()). Returns 0 or -1.
+int room_restore_returning(int id, int first, const JournalPlayer* in, int count);
+
+// Copy a client's seat in its room (room -1 if it has none)
+void room_save_seat(Client* c, HandoverClient* out);
+
+// Seat a handed-over client again (its loop is set). Returns 0, or -1 if out of memory.
+int room_restore_seat(Client* c, const HandoverClient* in);
+
+#endif // ROOM_H
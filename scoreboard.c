@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <string.h>
+#include "scoreboard.h"
+
+void scoreboard_reset(Scoreboard* sb) {
+    memset(sb, 0, sizeof(*sb));
+}
+
+// ---- Incremental top-K insert (single writer per shard) ----
+void scoreboard_update(Scoreboard* sb, int shard, uint32_t player, const char* nickname, int score) {
+    ScoreShard* s = &sb->shards[shard];
+
+    int pos = -1;
+    for (int i = 0; i < s->count; i++) {
+        if (s->top[i].player == player) {
+            pos = i;
+            break;
+        }
+    }
+    if (pos < 0 && s->count == LEADERBOARD_K && score <= s->top[LEADERBOARD_K - 1].score) {
+        return;  // Not in the top K
+    }
+
+    // --- Write section: readers retry while seq is odd ---
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    if (pos < 0) {
+        pos = s->count < LEADERBOARD_K ? s->count++ : LEADERBOARD_K - 1;  // Evict the lowest
+        s->top[pos].player = player;
+        strncpy(s->top[pos].nickname, nickname, sizeof(s->top[pos].nickname) - 1);
+        s->top[pos].nickname[sizeof(s->top[pos].nickname) - 1] = '\0';
+    }
+    s->top[pos].score = score;
+    while (pos > 0 && s->top[pos - 1].score < s->top[pos].score) {
+        ScoreEntry tmp = s->top[pos - 1];
+        s->top[pos - 1] = s->top[pos];
+        s->top[pos] = tmp;
+        pos--;
+    }
+
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+}
+
+// ---- Take a consistent copy of a shard ----
+static void shard_snapshot(const ScoreShard* s, ScoreShard* copy) {
+    uint32_t before, after;
+    do {
+        before = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        memcpy(copy, s, sizeof(*copy));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+    } while ((before & 1) || before != after);
+}
+
+// ---- Merge shard top-Ks: O(K * shards), independent of the number of players ----
+int scoreboard_top(Scoreboard* sb, int num_shards, ScoreEntry* out, int k) {
+    if (k > LEADERBOARD_K) k = LEADERBOARD_K;
+    int n = 0;
+    for (int i = 0; i < num_shards; i++) {
+        ScoreShard copy;
+        shard_snapshot(&sb->shards[i], &copy);
+
+        // Insert each entry into the sorted output, keeping at most k
+        for (int j = 0; j < copy.count; j++) {
+            ScoreEntry* e = &copy.top[j];
+            int pos = n < k ? n++ : k;
+            while (pos > 0 && out[pos - 1].score < e->score) {
+                if (pos < k) out[pos] = out[pos - 1];
+                pos--;
+            }
+            if (pos < k) out[pos] = *e;
+        }
+    }
+    return n;
+}
+
+int scoreboard_format(const ScoreEntry* top, int n, int players, char* out, int size) {
+    int len = snprintf(out, size, "\n\n=== Top %d of %d players ===\n", n, players);
+    for (int i = 0; i < n && len < size; i++) {
+        len += snprintf(out + len, size - len, "%d. %s: %d\n", i + 1, top[i].nickname, top[i].score);
+    }
+    if (len < size) {
+        if (n == 0) {
+            len += snprintf(out + len, size - len, "\nNo one answered any questions correctly.\n");
+        } else if (n == 1 || top[1].score < top[0].score) {
+            len += snprintf(out + len, size - len, "\n🏆 Winner: %s!\n", top[0].nickname);
+        } else {
+            len += snprintf(out + len, size - len, "\n⚔️ It's a tie between multiple players!\n");
+        }
+    }
+    return len < size ? len : size - 1;
+}
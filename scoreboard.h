@@ -0,0 +1,45 @@
+#ifndef SCOREBOARD_H
+#define SCOREBOARD_H
+
+#include <stdint.h>
+
+#define LEADERBOARD_K 8             // Entries kept per shard and reported at game end
+#define SCOREBOARD_SHARDS 16        // One shard per event loop (>= MAX_LOOPS)
+
+// ---- One leaderboard line ----
+typedef struct {
+    uint32_t player;                // ConnHandle of the player
+    int score;
+    char nickname[32];
+} ScoreEntry;
+
+// ---- Top-K of the players handled by one event loop ----
+// Only that loop's thread writes the shard, so updates need no lock. Readers on
+// other threads take a consistent copy with the seq counter (odd = write in progress).
+typedef struct {
+    uint32_t seq;
+    int count;
+    ScoreEntry top[LEADERBOARD_K];  // Sorted by score, highest first
+} __attribute__((aligned(64))) ScoreShard;
+
+typedef struct {
+    ScoreShard shards[SCOREBOARD_SHARDS];
+} Scoreboard;
+
+// Clear all shards (only while no game is running)
+void scoreboard_reset(Scoreboard* sb);
+
+// Record that player now has score. Scores only ever grow, which keeps every
+// shard's top-K exact with one O(K) insertion per correct answer.
+// Must be called from the thread that owns the shard.
+void scoreboard_update(Scoreboard* sb, int shard, uint32_t player, const char* nickname, int score);
+
+// Merge the shards into the overall top k (k <= LEADERBOARD_K), highest first.
+// Returns the number of entries written to out.
+int scoreboard_top(Scoreboard* sb, int num_shards, ScoreEntry* out, int k);
+
+// Write the results text announced at game end: the top n of players, then
+// the winner or a tie. Returns the length written (at most size - 1).
+int scoreboard_format(const ScoreEntry* top, int n, int players, char* out, int size);
+
+#endif // SCOREBOARD_H
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include "sendq.h"
+
+#define SENDQ_SLABS (SENDQ_MAX_BUFFERS / SENDQ_SLAB_BUFFERS)
+
+_Static_assert(SENDQ_MAX_BUFFERS % SENDQ_SLAB_BUFFERS == 0, "SENDQ_MAX_BUFFERS must be a whole number of slabs");
+
+static int slabs_mapped = 0;
+static char* free_list[SENDQ_MAX_BUFFERS];  // Stack of free buffers
+static int num_free = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// ---- Take a buffer, mapping the next slab if none is free ----
+static char* buffer_alloc(void) {
+    pthread_mutex_lock(&pool_lock);
+    if (num_free == 0 && slabs_mapped < SENDQ_SLABS) {
+        char* slab = mmap(NULL, (size_t)SENDQ_SLAB_BUFFERS * SENDQ_SIZE, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (slab == MAP_FAILED) {
+            perror("mmap send queue slab failed");
+        } else {
+            slabs_mapped++;
+            for (int i = SENDQ_SLAB_BUFFERS - 1; i >= 0; i--) free_list[num_free++] = slab + (size_t)i * SENDQ_SIZE;
+        }
+    }
+    char* buf = num_free > 0 ? free_list[--num_free] : NULL;
+    pthread_mutex_unlock(&pool_lock);
+    return buf;
+}
+
+static void buffer_free(char* buf) {
+    pthread_mutex_lock(&pool_lock);
+    free_list[num_free++] = buf;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+int sendq_push(SendQueue* q, const void* buf, uint32_t len) {
+    if (len > SENDQ_SIZE - sendq_used(q)) return -1;
+    if (!q->data) {
+        q->data = buffer_alloc();
+        if (!q->data) return -1;
+        q->head = q->tail = 0;
+    }
+    uint32_t off = q->tail & (SENDQ_SIZE - 1);
+    uint32_t first = SENDQ_SIZE - off;
+    if (first > len) first = len;
+    memcpy(q->data + off, buf, first);
+    memcpy(q->data, (const char*)buf + first, len - first);
+    q->tail += len;
+    return 0;
+}
+
+// ---- Write the queued bytes (one or two segments per call) ----
+// sendmsg() is writev() with MSG_NOSIGNAL, so a closed peer doesn't raise SIGPIPE.
+int sendq_flush(SendQueue* q, int sock) {
+    while (sendq_used(q) > 0) {
+        uint32_t used = sendq_used(q);
+        uint32_t off = q->head & (SENDQ_SIZE - 1);
+        uint32_t first = SENDQ_SIZE - off;
+        if (first > used) first = used;
+
+        struct iovec iov[2];
+        iov[0].iov_base = q->data + off;
+        iov[0].iov_len = first;
+        iov[1].iov_base = q->data;
+        iov[1].iov_len = used - first;
+
+        struct msghdr mh;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = iov;
+        mh.msg_iovlen = iov[1].iov_len ? 2 : 1;
+        ssize_t n = sendmsg(sock, &mh, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return (int)sendq_used(q);
+            return -1;
+        }
+        q->head += (uint32_t)n;
+    }
+    sendq_release(q);
+    return 0;
+}
+
+uint32_t sendq_peek(const SendQueue* q, void* dst) {
+    uint32_t used = sendq_used(q);
+    if (used == 0) return 0;
+    uint32_t off = q->head & (SENDQ_SIZE - 1);
+    uint32_t first = SENDQ_SIZE - off;
+    if (first > used) first = used;
+    memcpy(dst, q->data + off, first);
+    memcpy((char*)dst + first, q->data, used - first);
+    return used;
+}
+
+void sendq_release(SendQueue* q) {
+    if (q->data) buffer_free(q->data);
+    q->data = NULL;
+    q->head = q->tail = 0;
+}
@@ -0,0 +1,42 @@
+#ifndef SENDQ_H
+#define SENDQ_H
+
+#include <stdint.h>
+
+// ---- Bounded outbound queue of one stream socket ----
+// Most sends go straight to the socket; only bytes the kernel would not take
+// are queued here, and written out with one gathered send once the socket is
+// writable again. The buffer is taken on first use and given back when the
+// queue drains, so an idle or fast connection carries no buffer at all.
+// Buffers come from a pool like the connection slabs: slabs are mapped as the
+// number of backlogged connections grows and are then reused through a free
+// list, so a burst of slow consumers does not churn the heap.
+
+#define SENDQ_SIZE 16384            // Capacity in bytes (power of two)
+#define SENDQ_HIGH 12288            // Above this the slow-consumer policy kicks in
+#define SENDQ_LOW 4096              // Coalesced traffic is released below this
+#define SENDQ_SLAB_BUFFERS 64       // Buffers per mapped slab (1 MB)
+#define SENDQ_MAX_BUFFERS 16384     // Backlogged connections at once (>= MAX_CLIENTS)
+
+typedef struct {
+    char* data;                     // SENDQ_SIZE bytes while anything is queued, else NULL
+    uint32_t head;                  // Next byte to write to the socket
+    uint32_t tail;                  // Next free byte
+} SendQueue;
+
+static inline uint32_t sendq_used(const SendQueue* q) { return q->tail - q->head; }
+
+// Append len bytes. Returns 0, or -1 if they don't fit (or no buffer is left).
+int sendq_push(SendQueue* q, const void* buf, uint32_t len);
+
+// Write as much as the socket takes. Returns the bytes still queued, or -1 on
+// a socket error other than EAGAIN. The buffer goes back to the pool once empty.
+int sendq_flush(SendQueue* q, int sock);
+
+// Copy the queued bytes to dst without removing them. Returns how many.
+uint32_t sendq_peek(const SendQueue* q, void* dst);
+
+// Drop everything and give the buffer back
+void sendq_release(SendQueue* q);
+
+#endif // SENDQ_H
@@ -0,0 +1,138 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <netinet/in.h>
+#include "protocol.h"
+#include "event_loop.h"
+#include "frame.h"
+#include "sendq.h"
+#include "qbank.h"
+
+// ---- Constants for server and game configuration ----
+#define PORT 8889
+#define MAX_CLIENTS 16384
+#define MAX_LOOPS 16
+#define GAME_LOBBY_TIME 30
+#define MULTICAST_IP "224.1.1.1"      // Group of room 0; room n uses MULTICAST_IP + n
+#define MULTICAST_IF "192.3.1.1"      // Interface multicast is sent from
+#define MULTICAST_PORT 12345
+#define ANSWER_TIMEOUT 30
+#define KEEPALIVE_TIMEOUT_MS 10200
+#define AUTH_TIMEOUT_MS 20000         // Handshake deadline: TRV_AUTH_REPLY must arrive by then
+#define MAX_HANDSHAKES (MAX_CLIENTS / 4)  // Connections allowed in CONN_AUTH_WAIT at once
+#define QUESTIONS_PER_GAME 6         // At most TRV_V1_QUESTIONS (see room.h)
+#define QBANK_PATH "questions.qb"
+
+struct Room;
+
+// ---- Set of a game's question numbers, one bit each ----
+// Set bits with the word and bit of qset_word()/qset_bit(), so that callers
+// pick their own atomicity.
+#define QSET_WORDS ((QUESTIONS_PER_GAME + 63) / 64)
+
+typedef struct {
+    uint64_t w[QSET_WORDS];
+} QuestionSet;
+
+static inline uint64_t* qset_word(QuestionSet* s, uint32_t q) { return &s->w[q / 64]; }
+static inline uint64_t qset_bit(uint32_t q) { return 1ULL << (q % 64); }
+static inline int qset_has(const QuestionSet* s, uint32_t q) { return (s->w[q / 64] >> (q % 64)) & 1; }
+
+// ---- Generation-tagged connection handle ----
+// generation << CONN_INDEX_BITS | slot. Freeing a connection bumps its slot's
+// generation, so a handle kept past the connection's life never matches again.
+typedef uint32_t ConnHandle;
+#define CONN_INDEX_BITS 16
+
+// ---- Per-connection protocol state ----
+enum {
+    CONN_AUTH_WAIT,                 // TRV_AUTH_CODE sent, waiting for TRV_AUTH_REPLY
+    CONN_PLAYING,                   // Authenticated: keepalives and answers
+    CONN_CLOSED                     // Socket closed, slot unused
+};
+
+// ---- Client information structure ----
+// Fields touched on every frame come first and share the first cache lines;
+// per-game player state (score, ACK and answer bits) lives in the room's
+// column arrays instead (see RoomSeats). Clients are cache-line aligned so
+// neighbouring connections owned by different loops never share a line.
+typedef struct Client {
+    // --- Hot: every event ---
+    EventHandler ev;                // Event loop registration (must be first)
+    ConnHandle handle;              // This connection's handle (atomic; changes when freed)
+    int socket;                     // TCP socket for communication with client
+    int state;                      // CONN_* state of the connection
+    int wire;                       // TRV_WIRE_V1, or TRV_WIRE_V2 once negotiated at auth
+    int room_slot;                  // Index in room->seats[ev.loop->index]
+    uint32_t player_no;             // Player number in the room's game (journal records)
+    struct Room* room;              // Room the player is in (NULL before auth / after game)
+    uint64_t rx_ms;                 // Monotonic time the frames being processed were read
+    Timer keepalive;                // Handshake deadline, then keepalive timeout (owning loop only)
+    QuestionSet repaired;           // Question q was resent over TCP (atomic words)
+
+    // --- Cold: connection setup and reporting ---
+    struct sockaddr_in addr;        // Client address
+    int verified;                   // 1 if authenticated, 0 otherwise
+    int tcp_questions;              // 1 if the client asked for questions over TCP ("code|nick|tcp")
+    char nickname[32];              // Player's nickname
+    LoopTask start;                 // Hands a new connection to its loop (round-robin accept)
+
+    // --- Outbound backlog (owning loop only) ---
+    SendQueue out;                  // Bytes the socket did not take yet
+    uint32_t in_flight;             // With -u: bytes queued on the ring, not yet sent
+    struct Bcast* owed;             // Newest coalesced question, sent once out drains (SLOW_COALESCE)
+    int shutdown_pending;           // Shut down once out is empty (final message queued)
+    uint32_t out_peak;              // Deepest the queue got
+    uint32_t out_shed;              // Frames dropped or coalesced by the slow-consumer policy
+
+    FrameRing in;                   // Received bytes not yet parsed into frames
+} __attribute__((aligned(64))) Client;
+
+// ---- Shared server state (server_RON.c) ----
+extern EventLoop loops[MAX_LOOPS];
+extern int num_loops;
+extern QBank bank;
+extern int bank_category;
+
+// ---- What to do with a client whose send queue is past SENDQ_HIGH (-o) ----
+// Only bulk traffic (TCP question repairs, which multicast also delivers) is
+// subject to the policy; auth replies and results are always queued, and a
+// client whose queue overflows SENDQ_SIZE is disconnected.
+enum {
+    SLOW_COALESCE,                  // Keep only the newest question, sent once below SENDQ_LOW
+    SLOW_DROP,                      // Drop the question
+    SLOW_DISCONNECT                 // Close the connection
+};
+extern int slow_policy;
+
+// ---- How rooms deliver questions (-d) ----
+enum {
+    DELIVER_MULTICAST,              // Multicast, plus TCP for clients that ask for it
+    DELIVER_TCP                     // Every player over TCP, no multicast at all
+};
+extern int question_delivery;
+
+extern int use_uring;               // Accept/recv/send through each loop's io_uring (-u)
+
+// Send a full message on a socket that has no Client (e.g. "Server full")
+int send_message(int sock, TrvMessage* msg);
+
+// Send on a client's connection without blocking, queueing what the socket
+// does not take (owning loop only). Returns 0, or -1 if the client was dropped.
+int conn_send(Client* c, const void* buf, int len);
+
+// Queue the rest of buf after a send to the empty queue that wrote sent bytes
+// (or failed with -errno), and capture it. Returns 0, or -1 if the client was
+// dropped.
+int conn_send_rest(Client* c, const void* buf, int len, int sent);
+
+// Send a shared broadcast buffer (owning loop only). flags are BCAST_* flags:
+// BCAST_BULK applies the slow-consumer policy, BCAST_SHUTDOWN shuts the socket
+// down once everything queued before it has gone out, BCAST_BATCH (fan-outs
+// only) may defer the send to the loop's batch. Returns 0 or -1 as above.
+int conn_send_bcast(Client* c, struct Bcast* b, int flags);
+
+#endif // SERVER_H
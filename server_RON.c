@@ -1,360 +1,940 @@
-// #define _DEFAULT_SOURCE
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <time.h>
-#include <sys/select.h>
-#include "protocol.h"
-
-// ---- Constants for server and game configuration ----
-#define PORT 8889
-#define MAX_CLIENTS 10
-#define GAME_LOBBY_TIME 30
-#define MULTICAST_IP "224.1.1.1"
-#define MULTICAST_PORT 12345
-#define ANSWER_TIMEOUT 30
-#define KEEPALIVE_TIMEOUT 10.2
-
-// ---- Client information structure ----
+#include <errno.h>
+#include <sys/socket.h>
+#include "server.h"
+#include "room.h"
+#include "conn_pool.h"
+#include "trace.h"
+#include "uring.h"
+#include "broadcast.h"
+#include "cookie.h"
+#include "cluster.h"
+#include "handover.h"
+#include "journal.h"
+#include "capture.h"
+
+// ---- Listening socket registration ----
 typedef struct {
-    int socket;                     // TCP socket for communication with client
-    struct sockaddr_in addr;        // Client address
-    int verified;                   // 1 if authenticated, 0 otherwise
-    int score;                      // Trivia score
-    int auth_code;                  // Auth code to verify client
-    time_t last_keepalive;          // Last keepalive timestamp
-    char nickname[32];              // Player's nickname
-} Client;
-
-Client clients[MAX_CLIENTS];        // Array of connected clients
-int client_count = 0;               // Current number of clients
-int game_started = 0;               // 1 if game has started, 0 if still in lobby
-
-// ---- Sample trivia questions ----
-TriviaQuestion questions[6] = {
-    {"Which course is the best in CSE?", {"Computer Networks Design", "Intro to Electrical Engineering", "Data Structures", "Sadna Akademit"}, 0},
-    {"What is Paz's Dog's name?", {"Chili", "Nala", "Lucy", "Mitzi"}, 0},
-    {"Who is Ron Zimerman's favorite singer?", {"Shiri Maimon", "Mergui", "Noa Kirel", "Anna Zak"}, 2},
-    {"In an M/M/1 queue, what does the “1” represent?", {"One arrival process", "One service channel (server)", "One customer in the system", "One time unit per service"}, 1},
-    {"Which cat is hairless?", {"Maine Coon", "Bengal", "Siamese", "Sphynx"}, 3},
-    {"When is Efi Korenfeld's birthday?", {"September 29th", "April 14th", "July 22nd", "May 14th"}, 1}
-};
+    EventHandler ev;                // Event loop registration (must be first)
+    int socket;                     // Listening TCP socket
+} Listener;
+
+EventLoop loops[MAX_LOOPS];         // Event loops, loops[0] runs on the main thread
+int num_loops = 1;                  // Number of event loops in use
+int next_loop = 0;                  // Round-robin index for new connections
+int sharded_accept = 0;             // 1: one SO_REUSEPORT listener per loop (-s)
+Listener listeners[MAX_LOOPS];      // Listening sockets; only listeners[0] unless sharded
+int num_listeners = 0;
+int use_uring = 0;                  // 1: accept/recv/send through each loop's io_uring (-u)
+int slow_policy = SLOW_COALESCE;    // What to do with clients whose send queue backs up (-o)
+int question_delivery = DELIVER_MULTICAST; // How rooms send questions (-d)
+int handshakes = 0;                 // Connections in CONN_AUTH_WAIT (atomic)
+int listen_port = PORT;             // Player port (-p); cluster nodes on one host need their own
+int successor = -1;                 // Handover socket of a new server waiting for a quiet moment
+Timer handover_retry;               // Tries that handover again (loop 0)
+
+QBank bank;                         // Memory-mapped question bank
+int bank_category = -1;             // Category to draw from, -1 for any
 
 // ---- Function declarations ----
-void* handle_client(void* arg);
-void* game_lobby_timer(void* arg);
-void* keepalive_checker(void* arg);
-void start_game();
-void announce_winner_and_close();
-void send_multicast_message(TrvMessage* msg);
-
-// ---- Helper: Receive exactly len bytes from a socket ----
-int recv_full(int sock, void* buf, int len) {
-    int received = 0;
-    while (received < len) {
-        int n = recv(sock, (char*)buf + received, len - received, 0);
-        if (n <= 0) return n;
-        received += n;
-    }
-    return received;
+int open_listener(int reuseport);
+void start_listener(Listener* l, int fd, EventLoop* loop);
+void accept_clients(EventHandler* h, uint32_t events);
+void setup_client(Listener* l, int client_sock, struct sockaddr_in* client_addr);
+void start_client(void* arg);
+int watch_client(Client* client);
+void handle_client(EventHandler* h, uint32_t events);
+int process_frames(Client* client, ConnHandle self);
+int conn_flush(Client* client);
+void uring_accepted(void* ctx, int fd);
+int uring_received(ConnHandle h, const char* data, int len);
+void uring_sent(ConnHandle h, int len);
+void process_message(Client* client, TrvMessage* msg, uint32_t qid, int arg);
+void capture_frame(Client* client, const TrvMessage* msg, uint32_t qid, uint8_t arg);
+void drop_client(Client* client);
+void keepalive_expired(void* arg);
+void handover_give(int sock);
+void handover_retried(void* arg);
+int handover_save(int sock);
+int handover_take(int sock);
+Client* take_client(int fd, const HandoverClient* hc, const char* bytes);
+
+// ---- Helper: send a full message on a socket that has no Client yet ----
+// The socket is new and non-blocking, so a short write is reported but not retried.
+int send_message(int sock, TrvMessage* msg) {
+    int len = 4 + msg->payload_len;
+    int n = send(sock, msg, len, MSG_NOSIGNAL);
+    if (n != len) perror("send failed");
+    return n;
+}
+
+// ---- Non-blocking send with a bounded per-connection queue ----
+// Bytes go straight to the socket while nothing is queued; whatever it does not
+// take is queued and written out on EPOLLOUT, keeping frames in order. With -u
+// the send is queued on the loop's ring instead and submitted with the batch;
+// the bytes the ring has not sent yet count against the same bound. A frame is
+// captured once it is sent or queued; one that is not drops the client.
+int conn_send(Client* c, const void* buf, int len) {
+    if (use_uring) {
+        if (c->in_flight + len > SENDQ_SIZE) {
+            trace_event(TRACE_SLOW, conn_index(c->handle), c->in_flight, SLOW_DISCONNECT, 0, 0);
+            drop_client(c);
+            return -1;
+        }
+        if (uring_send(c->ev.loop->uring, c->socket, c->handle, buf, len, 0) < 0) {
+            drop_client(c);         // The ring is out of entries or memory: the frame would be lost
+            return -1;
+        }
+        capture_event(CAPTURE_OUT, c->handle, c->wire, buf, len);
+        c->in_flight += len;
+        if (c->in_flight > c->out_peak) c->out_peak = c->in_flight;
+        return 0;
+    }
+    int sent = 0;
+    if (sendq_used(&c->out) == 0) {
+        sent = send(c->socket, buf, len, MSG_NOSIGNAL);
+        if (sent < 0) sent = -errno;
+    }
+    return conn_send_rest(c, buf, len, sent);
+}
+
+// ---- Queue what a send to an empty queue left over (sent: bytes or -errno) ----
+int conn_send_rest(Client* c, const void* buf, int len, int sent) {
+    if (sent < 0 && sent != -EAGAIN && sent != -EWOULDBLOCK) sent = len;  // Reset; the read side drops it
+    if (sent < len) {
+        if (sent < 0) sent = 0;
+        if (sendq_push(&c->out, (const char*)buf + sent, len - sent) < 0) {
+            trace_event(TRACE_SLOW, conn_index(c->handle), sendq_used(&c->out), SLOW_DISCONNECT, 0, 0);
+            drop_client(c);  // Not even essential traffic fits: the client stopped reading
+            return -1;
+        }
+        if (sendq_used(&c->out) > c->out_peak) c->out_peak = sendq_used(&c->out);
+    }
+    capture_event(CAPTURE_OUT, c->handle, c->wire, buf, len);
+    return 0;
+}
+
+int conn_send_bcast(Client* c, Bcast* b, int flags) {
+    if (c->wire == TRV_WIRE_V2 && b->v2) b = b->v2;
+
+    // --- Slow consumer: bulk traffic is shed instead of growing the backlog ---
+    uint32_t queued = use_uring ? c->in_flight : sendq_used(&c->out);
+    if ((flags & BCAST_BULK) && (c->owed || queued + b->len > SENDQ_HIGH)) {
+        trace_event(TRACE_SLOW, conn_index(c->handle), queued, slow_policy, 0, 0);
+        if (slow_policy == SLOW_DISCONNECT) {
+            drop_client(c);
+            return -1;
+        }
+        c->out_shed++;
+        if (slow_policy == SLOW_COALESCE) {
+            bcast_ref(b);
+            if (c->owed) bcast_unref(c->owed);
+            c->owed = b;
+        }
+        return 0;
+    }
+
+    if (use_uring) {
+        if (c->in_flight + b->len > SENDQ_SIZE) {
+            trace_event(TRACE_SLOW, conn_index(c->handle), c->in_flight, SLOW_DISCONNECT, 0, 0);
+            drop_client(c);
+            return -1;
+        }
+        if (uring_send_bcast(c->ev.loop->uring, c->socket, c->handle, b, flags & BCAST_SHUTDOWN) < 0) {
+            drop_client(c);
+            return -1;
+        }
+        capture_event(CAPTURE_OUT, c->handle, c->wire, b->data, b->len);
+        c->in_flight += b->len;
+        if (c->in_flight > c->out_peak) c->out_peak = c->in_flight;
+        if (flags & BCAST_SHUTDOWN) {
+            if (c->owed) bcast_unref(c->owed);
+            c->owed = NULL;
+        }
+        return 0;
+    }
+    if ((flags & BCAST_BATCH) && sendq_used(&c->out) == 0 && bcast_batch_add(c, b) == 0) {
+        if (flags & BCAST_SHUTDOWN) {
+            if (c->owed) bcast_unref(c->owed);
+            c->owed = NULL;
+            c->shutdown_pending = 1;  // Once the batch completes and out is empty
+        }
+        return 0;
+    }
+    if (conn_send(c, b->data, b->len) < 0) return -1;
+    if (flags & BCAST_SHUTDOWN) {
+        if (c->owed) bcast_unref(c->owed);  // Nothing goes out after the final message
+        c->owed = NULL;
+        if (sendq_used(&c->out) == 0) shutdown(c->socket, SHUT_RDWR);
+        else c->shutdown_pending = 1;
+    }
+    return 0;
+}
+
+// ---- Socket writable again: write the backlog, then any coalesced question ----
+// Returns 0, or -1 on a socket error.
+int conn_flush(Client* client) {
+    while (1) {
+        int left = sendq_flush(&client->out, client->socket);
+        if (left < 0) return -1;
+        if (client->owed && left < SENDQ_LOW) {
+            Bcast* b = client->owed;
+            client->owed = NULL;
+            int res = sendq_push(&client->out, b->data, b->len);
+            if (res == 0) capture_event(CAPTURE_OUT, client->handle, client->wire, b->data, b->len);
+            bcast_unref(b);
+            if (res < 0) return -1;
+            continue;
+        }
+        if (left == 0 && client->shutdown_pending) shutdown(client->socket, SHUT_RDWR);
+        return 0;
+    }
+}
+
+// ---- io_uring: a send completed; release a coalesced question once below SENDQ_LOW ----
+void uring_sent(ConnHandle h, int len) {
+    Client* c = conn_get(h);
+    if (!c) return;                 // Dropped since
+    c->in_flight -= len;
+    if (c->owed && c->in_flight < SENDQ_LOW) {
+        Bcast* b = c->owed;
+        c->owed = NULL;
+        int res = uring_send_bcast(c->ev.loop->uring, c->socket, c->handle, b, 0);
+        if (res >= 0) {
+            capture_event(CAPTURE_OUT, c->handle, c->wire, b->data, b->len);
+            c->in_flight += b->len;
+        }
+        bcast_unref(b);
+        if (res < 0) drop_client(c);
+    }
 }
 
 // ---- Main server function ----
-int main() {
-    srand(time(NULL));  // Initialize random seed (for auth codes)
-    int server_fd;
-    struct sockaddr_in server_addr;
-    pthread_t lobby_thread, keep_thread;
+int main(int argc, char* argv[]) {
+    // --- Command line ---
+    num_loops = sysconf(_SC_NPROCESSORS_ONLN);
+    const char* bank_path = QBANK_PATH;
+    const char* category = NULL;
+    const char* trace_path = NULL;
+    const char* coordinator = NULL;
+    const char* handover_path = NULL;
+    const char* journal_path = NULL;
+    const char* capture_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:q:c:l:suo:d:p:k:x:j:r:")) != -1) {
+        if (opt == 't') num_loops = atoi(optarg);
+        else if (opt == 's') sharded_accept = 1;
+        else if (opt == 'u') use_uring = sharded_accept = 1;  // Connections stay on their ring's loop
+        else if (opt == 'q') bank_path = optarg;
+        else if (opt == 'c') category = optarg;
+        else if (opt == 'l') trace_path = optarg;
+        else if (opt == 'o' && strcmp(optarg, "coalesce") == 0) slow_policy = SLOW_COALESCE;
+        else if (opt == 'o' && strcmp(optarg, "drop") == 0) slow_policy = SLOW_DROP;
+        else if (opt == 'o' && strcmp(optarg, "disconnect") == 0) slow_policy = SLOW_DISCONNECT;
+        else if (opt == 'd' && strcmp(optarg, "multicast") == 0) question_delivery = DELIVER_MULTICAST;
+        else if (opt == 'd' && strcmp(optarg, "tcp") == 0) question_delivery = DELIVER_TCP;
+        else if (opt == 'p') listen_port = atoi(optarg);
+        else if (opt == 'k') coordinator = optarg;
+        else if (opt == 'x') handover_path = optarg;
+        else if (opt == 'j') journal_path = optarg;
+        else if (opt == 'r') capture_path = optarg;
+        else {
+            fprintf(stderr, "Usage: %s [-t threads] [-q questions.qb] [-c category] [-l trace_file] [-s] [-u]\n"
+                            "       [-o coalesce|drop|disconnect] [-d multicast|tcp] [-p port] [-k coordinator:port]\n"
+                            "       [-x handover_socket] [-j journal_file] [-r capture_file]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (num_loops < 1) num_loops = 1;
+    if (num_loops > MAX_LOOPS) num_loops = MAX_LOOPS;
+
+    // --- Map the question bank ---
+    if (qbank_open(&bank, bank_path) < 0) return 1;
+    if (category) {
+        bank_category = qbank_find_category(&bank, category);
+        if (bank_category < 0) {
+            fprintf(stderr, "No category '%s' in %s\n", category, bank_path);
+            return 1;
+        }
+    }
+
+    // --- Every frame in and out goes to the capture file, for ./replay ---
+    // First: every thread started later must block the signals it takes
+    if (capture_path && capture_open(capture_path) < 0) return 1;
+
+    // --- Per-connection events go to the binary trace log ---
+    if (trace_path && trace_open(trace_path) < 0) return 1;
+
+    // --- Key for the auth cookies ---
+    if (cookie_init() < 0) return 1;
+
+    // --- Create the event loops ---
+    // With -u each loop also gets an io_uring that takes over its socket I/O.
+    int num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    UringCallbacks uring_cb = { uring_accepted, uring_received, uring_sent };
+    for (int i = 0; i < num_loops; i++) {
+        if (event_loop_init(&loops[i], i) < 0) return 1;
+        if (sharded_accept) loops[i].cpu = i % num_cpus;
+        if (use_uring && uring_init(&loops[i], &uring_cb) < 0) {
+            fprintf(stderr, "io_uring unavailable; run without -u\n");
+            return 1;
+        }
+    }
+    if (broadcast_init() < 0) return 1;
+
+    // Servers on one host (cluster nodes on loopback) use their own multicast
+    // port, offset like the player port, so their rooms' groups stay apart
+    int mcast_port = MULTICAST_PORT + (listen_port - PORT);
+    if (mcast_port <= 0 || mcast_port > 65535) mcast_port = MULTICAST_PORT;
+    rooms_init(mcast_port);
+
+    // --- Hot restart: take over from the server on the handover socket, if one runs ---
+    int predecessor = handover_path ? handover_connect(handover_path) : -1;
+    if (predecessor >= 0 && handover_take(predecessor) < 0) {
+        fprintf(stderr, "Hot restart failed; the old server keeps running.\n");
+        return 1;
+    }
+
+    // --- Score journal: resume the games a crash interrupted, then record ---
+    // A hot restart carries the games over itself and just keeps appending.
+    if (journal_path) {
+        JournalGame* games = NULL;
+        int count = predecessor >= 0 ? 0 : journal_replay(journal_path, &games);
+        if (count < 0) return 1;
+        rooms_resume(games, count);
+        int res = journal_open(journal_path, games, count, predecessor >= 0);
+        journal_games_free(games, count);
+        if (res < 0) return 1;
+    }
+
+    // --- Listening sockets (or more of them than the old server had) ---
+    // Normally loop 0 accepts and deals connections out round-robin. With -s
+    // every loop has its own SO_REUSEPORT listener, pinned to its own CPU, and
+    // keeps the connections it accepts; the kernel spreads connects over them.
+    int wanted = sharded_accept ? num_loops : 1;
+    while (num_listeners < wanted) {
+        int fd = open_listener(sharded_accept);
+        if (fd < 0) {
+            if (predecessor >= 0) break;    // The old server's listeners will do
+            return 1;
+        }
+        start_listener(&listeners[num_listeners], fd, &loops[num_listeners]);
+        num_listeners++;
+    }
+
+    printf("Server running on port %d with %d event loop(s) and %d listener(s)%s. Waiting for clients...\n",
+           listen_port, num_loops, num_listeners, use_uring ? " on io_uring" : "");
+
+    // --- Cluster node: the coordinator schedules the games ---
+    if (coordinator && !cluster_mode) {
+        if (cluster_connect(coordinator, listen_port) < 0) return 1;
+        printf("Cluster node of coordinator %s.\n", coordinator);
+    }
+
+    // --- Wait for the server that will replace this one ---
+    timer_init(&handover_retry, handover_retried, NULL);
+    if (handover_path && handover_listen(handover_path, handover_give) < 0) return 1;
+
+    for (int i = 1; i < num_loops; i++) event_loop_start(&loops[i]);
+    event_loop_run(&loops[0]);
+    return 0;
+}
 
-    // --- Create and set up the TCP server socket ---
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
+// ---- Create a non-blocking listening socket on the player port ----
+int open_listener(int reuseport) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     int reuse = 1;
-    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, (char *)&reuse, sizeof(reuse));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (char *)&reuse, sizeof(reuse));
+    // Accepted sockets inherit TCP_NODELAY: replies are whole frames, already
+    // gathered per send, so Nagle would only hold them back for an ACK
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &reuse, sizeof(reuse));
+    if (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0) {
+        perror("SO_REUSEPORT failed");
+        close(fd);
+        return -1;
+    }
 
+    struct sockaddr_in server_addr;
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(PORT);
+    server_addr.sin_port = htons(listen_port);
     server_addr.sin_addr.s_addr = INADDR_ANY;
 
-    bind(server_fd, (struct sockaddr*)&server_addr, sizeof(server_addr));
-    listen(server_fd, 5);
+    if (bind(fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0 ||
+        listen(fd, SOMAXCONN) < 0) {
+        perror("Failed to open listening socket");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
 
-    printf("Server running on port %d. Waiting for clients...\n", PORT);
+// ---- Accept on a listening socket from the given loop ----
+void start_listener(Listener* l, int fd, EventLoop* loop) {
+    l->socket = fd;
+    l->ev.on_event = accept_clients;
+    l->ev.loop = loop;
+    if (use_uring) {
+        uring_accept(loop->uring, fd, l);
+        uring_flush(loop->uring);
+    } else {
+        event_loop_add(loop, fd, &l->ev, EPOLLIN | EPOLLET);
+    }
+}
 
-    // --- Start lobby and keepalive threads ---
-    pthread_create(&lobby_thread, NULL, game_lobby_timer, NULL);
-    pthread_create(&keep_thread, NULL, keepalive_checker, NULL);
+// ---- Listening socket is readable: accept every pending connection ----
+void accept_clients(EventHandler* h, uint32_t events) {
+    Listener* l = (Listener*)h;
+    (void)events;
 
-    // --- Accept client connections while lobby is open ---
     while (1) {
         struct sockaddr_in client_addr;
         socklen_t len = sizeof(client_addr);
-        int client_sock = accept(server_fd, (struct sockaddr*)&client_addr, &len);
-
-        // If game started or lobby full, reject new clients
-        if (game_started || client_count >= MAX_CLIENTS) {
-            TrvMessage reject_msg;
-            build_message(&reject_msg, TRV_AUTH_FAIL, 0, "Game already started or lobby full.");
-            send(client_sock, &reject_msg, 4 + reject_msg.payload_len, 0);
-            close(client_sock);
-            continue;
+        int client_sock = accept4(l->socket, (struct sockaddr*)&client_addr, &len,
+                                  SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_sock < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept failed");
+            return;
         }
 
-        // Initialize client struct
-        clients[client_count].socket = client_sock;
-        clients[client_count].addr = client_addr;
-        clients[client_count].verified = 0;
-        clients[client_count].score = 0;
-        strcpy(clients[client_count].nickname, "(unknown)");
+        setup_client(l, client_sock, &client_addr);
+    }
+}
 
-        // Create a thread to handle the client
-        pthread_t tid;
-        pthread_create(&tid, NULL, handle_client, &clients[client_count]);
-        client_count++;
+// ---- Set up a newly accepted connection ----
+// At most MAX_HANDSHAKES connections may be waiting to authenticate, so a
+// join storm or idle sockets can't take the slots of authenticated players.
+void setup_client(Listener* l, int client_sock, struct sockaddr_in* client_addr) {
+    // Take a pooled connection object, or reject the client if the server is full
+    Client* client = NULL;
+    if (__atomic_add_fetch(&handshakes, 1, __ATOMIC_RELAXED) <= MAX_HANDSHAKES) client = conn_alloc();
+    if (!client) {
+        __atomic_sub_fetch(&handshakes, 1, __ATOMIC_RELAXED);
+        TrvMessage reject_msg;
+        build_message(&reject_msg, TRV_AUTH_FAIL, 0, "Server full.");
+        send_message(client_sock, &reject_msg);
+        close(client_sock);
+        return;
     }
-    return 0;
+
+    // Initialize client struct (conn_alloc() zeroed it)
+    client->socket = client_sock;
+    client->addr = *client_addr;
+    client->state = CONN_AUTH_WAIT;
+    client->wire = TRV_WIRE_V1;
+    client->ev.on_event = handle_client;
+    timer_init(&client->keepalive, keepalive_expired, client);
+    frame_ring_init(&client->in);
+    strcpy(client->nickname, "(unknown)");
+    trace_event(TRACE_CONNECT, conn_index(client->handle), client_addr->sin_addr.s_addr,
+                ntohs(client_addr->sin_port), 0, 0);
+    capture_event(CAPTURE_OPEN, client->handle, TRV_WIRE_V1, client_addr, sizeof(*client_addr));
+
+    // Sharded or io_uring: stay on the accepting loop. Otherwise spread
+    // round-robin; the chosen loop starts the connection on its own thread,
+    // since the deadline timer and the first send belong to that loop.
+    if (sharded_accept) {
+        client->ev.loop = l->ev.loop;
+        start_client(client);
+        return;
+    }
+    client->ev.loop = &loops[next_loop];
+    next_loop = (next_loop + 1) % num_loops;
+    loop_task_init(&client->start, start_client, client);
+    event_loop_post(client->ev.loop, &client->start);
 }
 
-// ---- Per-client thread: handle authentication and answers ----
-void* handle_client(void* arg) {
+// ---- On the connection's loop: register it, arm its handshake deadline, send the cookie ----
+// The auth code is a MAC of the peer's address (see cookie.h), so nothing about
+// it is stored; the reply is checked by recomputing it.
+void start_client(void* arg) {
     Client* client = (Client*)arg;
-    TrvMessage msg;
+    EventLoop* loop = client->ev.loop;
+
+    if (watch_client(client) < 0) return;
+    event_loop_timer(loop, &client->keepalive, AUTH_TIMEOUT_MS);
 
-    // --- Send random authentication code to client ---
-    client->auth_code = rand() % 9000 + 1000;  // Random 4-digit code
-    char code_str[32];
-    snprintf(code_str, sizeof(code_str), "%d", client->auth_code);
+    TrvMessage msg;
+    char code_str[16];
+    snprintf(code_str, sizeof(code_str), "%06u", cookie_make(&client->addr, now_ms()));
     build_message(&msg, TRV_AUTH_CODE, 0, code_str);
-    send(client->socket, &msg, 4 + msg.payload_len, 0);
+    conn_send(client, &msg, 4 + msg.payload_len);
+}
+
+// ---- Register a connection's socket with its loop ----
+// Returns 0, or -1 if the client was dropped.
+int watch_client(Client* client) {
+    EventLoop* loop = client->ev.loop;
+    if (use_uring) {
+        // The socket is read by a multishot recv on this loop's ring
+        if (uring_recv(loop->uring, client->socket, client->handle) < 0) {
+            drop_client(client);
+            return -1;
+        }
+    } else if (event_loop_add(loop, client->socket, &client->ev, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET) < 0) {
+        // EPOLLOUT is edge-triggered too: it only fires once a full socket drains
+        perror("epoll_ctl failed");
+        drop_client(client);
+        return -1;
+    }
+    return 0;
+}
 
-    // --- Receive authentication reply (code|nickname) from client ---
-    int n = recv_full(client->socket, &msg, 4);
-    if (n <= 0) {
-        close(client->socket);
-        pthread_exit(NULL);
+// ---- Client socket event: read every complete frame that is available ----
+// Edge-triggered, so keep reading until the socket is drained. Once the client
+// is dropped its object may be reused by another connection, so the loop stops
+// as soon as the handle no longer matches.
+void handle_client(EventHandler* h, uint32_t events) {
+    Client* client = (Client*)h;
+    ConnHandle self = client->handle;
+
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        drop_client(client);
+        return;
+    }
+    if ((events & EPOLLOUT) && conn_flush(client) < 0) {
+        drop_client(client);
+        return;
     }
-    if (msg.payload_len > 0) {
-        n = recv_full(client->socket, msg.payload, msg.payload_len);
+    if (!(events & (EPOLLIN | EPOLLRDHUP))) return;
+
+    while (conn_get(self) == client) {
+        // One readv() pulls in as many pipelined frames as the ring can hold
+        uint32_t space = frame_ring_space(&client->in);
+        int n = frame_ring_fill(&client->in, client->socket);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
         if (n <= 0) {
-            close(client->socket);
-            pthread_exit(NULL);
+            drop_client(client);
+            return;
         }
+        client->rx_ms = now_ms();   // Receive time of every frame in this batch
+        if (!process_frames(client, self)) return;
+
+        // A short read means the socket buffer was emptied
+        if ((uint32_t)n < space) return;
     }
-    msg.payload[msg.payload_len] = '\0';
+}
 
-    // --- Check if game started during authentication ---
-    if (game_started) {
-        build_message(&msg, TRV_AUTH_FAIL, 0, "Game already started.");
-        send(client->socket, &msg, 4 + msg.payload_len, 0);
-        close(client->socket);
-        pthread_exit(NULL);
+// ---- Capture a received frame as the client sent it (before handlers modify it) ----
+void capture_frame(Client* client, const TrvMessage* msg, uint32_t qid, uint8_t arg) {
+    if (client->wire == TRV_WIRE_V2) {
+        uint8_t header[TRV_V2_HEADER_LEN];
+        build_header_v2(header, msg->type, arg, qid, msg->payload_len);
+        capture_write(CAPTURE_IN, client->handle, TRV_WIRE_V2, header, sizeof(header), msg->payload, msg->payload_len);
+    } else {
+        capture_write(CAPTURE_IN, client->handle, TRV_WIRE_V1, msg, FRAME_HEADER_LEN + msg->payload_len, NULL, 0);
     }
+}
 
-    // --- Verify token and nickname ---
-    char* token = strtok(msg.payload, "|");
-    char* nickname = strtok(NULL, "|");
-    if (!token || !nickname || atoi(token) != client->auth_code) {
-        build_message(&msg, TRV_AUTH_FAIL, 0, "Invalid code or nickname.");
-        send(client->socket, &msg, 4 + msg.payload_len, 0);
-        close(client->socket);
-        pthread_exit(NULL);
+// ---- Handle every complete frame in the client's ring ----
+// Returns 1, or 0 if the client was dropped (bad frame, or by a handler).
+// A v1 answer is ASCII and parsed here; a v2 answer is the header's arg byte.
+int process_frames(Client* client, ConnHandle self) {
+    TrvMessage msg;
+    uint32_t qid;
+    uint8_t arg;
+    int res = 0;
+    while (1) {
+        if (client->wire == TRV_WIRE_V2) {
+            res = frame_next_v2(&client->in, &msg, &qid, &arg);
+        } else if ((res = frame_next(&client->in, &msg)) > 0) {
+            qid = msg.question_id;
+            arg = msg.type == TRV_ANSWER ? (uint8_t)atoi(msg.payload) : 0;
+        }
+        if (res <= 0) break;
+        if (capture_enabled) capture_frame(client, &msg, qid, arg);
+        process_message(client, &msg, qid, arg);
+        if (conn_get(self) != client) return 0;  // Dropped while handling the frame
+    }
+    if (res < 0) {
+        trace_event(TRACE_BAD_FRAME, conn_index(client->handle), 0, 0, 0, 0);
+        drop_client(client);
+        return 0;
     }
+    return 1;
+}
 
-    client->verified = 1;
-    strncpy(client->nickname, nickname, sizeof(client->nickname));
-    client->nickname[sizeof(client->nickname) - 1] = '\0';
-    client->last_keepalive = time(NULL);
+// ---- io_uring: multishot accept completed ----
+void uring_accepted(void* ctx, int fd) {
+    struct sockaddr_in client_addr;
+    socklen_t len = sizeof(client_addr);
+    memset(&client_addr, 0, sizeof(client_addr));
+    getpeername(fd, (struct sockaddr*)&client_addr, &len);
+    setup_client((Listener*)ctx, fd, &client_addr);
+}
 
-    build_message(&msg, TRV_AUTH_OK, 0, "Welcome to the trivia game!");
-    send(client->socket, &msg, 4 + msg.payload_len, 0);
+// ---- io_uring: bytes (or EOF / error) from a multishot recv ----
+// Completions may still arrive after the client was dropped; the handle no
+// longer resolves then and they are ignored.
+int uring_received(ConnHandle h, const char* data, int len) {
+    Client* client = conn_get(h);
+    if (!client || client->state == CONN_CLOSED) return 0;
+    if (len <= 0 || frame_ring_write(&client->in, data, (uint32_t)len) < 0) {
+        drop_client(client);  // EOF, error, or more unparsed bytes than a frame can hold
+        return 0;
+    }
+    client->rx_ms = now_ms();
+    return process_frames(client, h);
+}
 
-    printf("✅ %s connected and verified.\n", client->nickname);
+// ---- Per-connection state machine: authentication, then keepalive & answers ----
+// qid and arg come from the frame header (v2) or were parsed from a v1 frame.
+void process_message(Client* client, TrvMessage* msg, uint32_t qid, int arg) {
+    TrvMessage reply;
+
+    if (client->state == CONN_AUTH_WAIT) {
+        // --- Verify token and nickname (code|nickname, then options: tcp, v2) ---
+        char* saveptr;
+        char* token = strtok_r(msg->payload, "|", &saveptr);
+        char* nickname = strtok_r(NULL, "|", &saveptr);
+        int wants_v2 = 0;
+        for (char* opt = strtok_r(NULL, "|", &saveptr); opt; opt = strtok_r(NULL, "|", &saveptr)) {
+            if (strcmp(opt, "tcp") == 0) client->tcp_questions = 1;
+            else if (strcmp(opt, "v2") == 0) wants_v2 = 1;
+        }
+        if (msg->type != TRV_AUTH_REPLY || !token || !nickname ||
+            !cookie_check(&client->addr, (uint32_t)strtoul(token, NULL, 10), now_ms())) {
+            trace_event(TRACE_AUTH_FAIL, conn_index(client->handle), 0, 0, 0, 0);
+            build_message(&reply, TRV_AUTH_FAIL, 0, "Invalid code or nickname.");
+            conn_send(client, &reply, 4 + reply.payload_len);
+            drop_client(client);
+            return;
+        }
 
-    // --- Main per-client message loop: keepalive & answer handling ---
-    while (1) {
-        n = recv_full(client->socket, &msg, 4);
-        if (n <= 0) break;
-        if (msg.payload_len > 0) {
-            n = recv_full(client->socket, msg.payload, msg.payload_len);
-            if (n <= 0) break;
+        strncpy(client->nickname, nickname, sizeof(client->nickname));
+        client->nickname[sizeof(client->nickname) - 1] = '\0';
+
+        // --- Seat the player in an open lobby ---
+        Room* room = room_join(client);
+        if (!room) {
+            trace_event(TRACE_AUTH_FAIL, conn_index(client->handle), 1, 0, 0, 0);
+            build_message(&reply, TRV_AUTH_FAIL, 0, "All game rooms are busy.");
+            conn_send(client, &reply, 4 + reply.payload_len);
+            drop_client(client);
+            return;
         }
-        msg.payload[msg.payload_len] = '\0';
-
-        if (msg.type == TRV_KEEPALIVE) {
-            client->last_keepalive = time(NULL);
-            printf("🔄 KEEPALIVE received from %s (%s)\n",
-                   client->nickname, inet_ntoa(client->addr.sin_addr));
-        } else if (msg.type == TRV_ANSWER) {
-            int qid = msg.question_id;
-            int ans = atoi(msg.payload);
-            if (qid >= 0 && qid < 6) {
-                if (ans == questions[qid].correct_index + 1) {
-                    client->score++;
-                    printf("✅ %s answered question %d correctly. Score: %d\n",
-                           client->nickname, qid + 1, client->score);
-                } else {
-                    printf("❌ %s answered question %d incorrectly.\n",
-                           client->nickname, qid + 1);
-                }
-            }
+        client->state = CONN_PLAYING;
+        client->verified = 1;
+        __atomic_sub_fetch(&handshakes, 1, __ATOMIC_RELAXED);
+        event_loop_timer(client->ev.loop, &client->keepalive, KEEPALIVE_TIMEOUT_MS);
+
+        // The client reads its room's multicast group (or "tcp") from the "Room"
+        // line. A v2 client also gets the game id, and v2 framing from here on.
+        char welcome[160], group[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &room->mcast_addr.sin_addr, group, sizeof(group));
+        int len;
+        if (room->tcp_only || client->tcp_questions) {
+            len = snprintf(welcome, sizeof(welcome), "Welcome to the trivia game!\nRoom %d, tcp", room->id);
+        } else {
+            len = snprintf(welcome, sizeof(welcome), "Welcome to the trivia game!\nRoom %d, multicast %s:%d",
+                           room->id, group, ntohs(room->mcast_addr.sin_port));
         }
+        if (wants_v2) snprintf(welcome + len, sizeof(welcome) - len, "\nv2 game %u", room->game_id);
+        build_message(&reply, TRV_AUTH_OK, 0, welcome);
+        conn_send(client, &reply, 4 + reply.payload_len);
+        if (wants_v2) client->wire = TRV_WIRE_V2;
+
+        trace_event_text(TRACE_AUTH, conn_index(client->handle), room->id, client->nickname);
+        return;
     }
 
-    close(client->socket);
-    pthread_exit(NULL);
+    // --- CONN_PLAYING: keepalive & answer handling ---
+    // Any frame proves the player is alive; clients skip keepalives while they send other frames
+    event_loop_timer(client->ev.loop, &client->keepalive, KEEPALIVE_TIMEOUT_MS);
+    if (msg->type == TRV_KEEPALIVE) {
+        trace_event(TRACE_KEEPALIVE, conn_index(client->handle), 0, 0, 0, 0);
+    } else if (msg->type == TRV_ANSWER) {
+        room_answer(client, qid, arg);
+    } else if (msg->type == TRV_ACK) {
+        room_ack(client, qid);
+    } else if (msg->type == TRV_NACK) {
+        trace_event(TRACE_NACK, conn_index(client->handle), qid, 0, 0, 0);
+        room_nack(client, qid);
+    }
 }
 
-// ---- Thread: handles lobby timer, then starts the game ----
-void* game_lobby_timer(void* arg) {
-    printf("Lobby open for %d seconds...\n", GAME_LOBBY_TIME);
-    sleep(GAME_LOBBY_TIME);
-    game_started = 1;
-    printf("Lobby closed. Starting game!\n");
-    start_game();
-    return NULL;
+// ---- Close a connection from its own event loop thread ----
+// The player leaves its room first so no room worker still references the socket,
+// then the object goes back to the pool.
+void drop_client(Client* client) {
+    if (client->state == CONN_CLOSED) return;
+    if (client->state == CONN_AUTH_WAIT) __atomic_sub_fetch(&handshakes, 1, __ATOMIC_RELAXED);
+    timer_cancel(&client->keepalive);
+    room_leave(client);
+    trace_event(TRACE_CLOSE, conn_index(client->handle), client->out_peak, client->out_shed, 0, 0);
+    capture_event(CAPTURE_CLOSE, client->handle, client->wire, NULL, 0);
+
+    if (use_uring) {
+        // Submit queued sends first, then end the multishot recv, which holds
+        // its own reference to the socket and would otherwise keep it open
+        uring_flush(client->ev.loop->uring);
+        shutdown(client->socket, SHUT_RDWR);
+    } else if (client->ev.loop) {
+        event_loop_del(client->ev.loop, client->socket);
+    }
+    close(client->socket);
+    sendq_release(&client->out);
+    if (client->owed) bcast_unref(client->owed);
+    client->owed = NULL;
+    client->verified = 0;
+    conn_free(client);
 }
 
-// ---- Main function to multicast questions and collect answers ----
-void start_game() {
-    // --- Prepare UDP socket for multicast ---
-    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    struct in_addr localInterface;
-    localInterface.s_addr = inet_addr("192.3.1.1"); // Interface for multicast
-    setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_IF, (char *)&localInterface, sizeof(localInterface));
-    unsigned char ttl = 10;
-    setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
-
-    struct sockaddr_in mcast_addr;
-    memset(&mcast_addr, 0, sizeof(mcast_addr));
-    mcast_addr.sin_family = AF_INET;
-    mcast_addr.sin_addr.s_addr = inet_addr(MULTICAST_IP);
-    mcast_addr.sin_port = htons(MULTICAST_PORT);
-
-    // Send dummy data to help clients join group early
-    char dummy_data[1] = {0};
-    sendto(sockfd, dummy_data, sizeof(dummy_data), 0,
-           (struct sockaddr*)&mcast_addr, sizeof(mcast_addr));
-
-    printf("⌛ Waiting 2 seconds before sending questions...\n");
-    sleep(2);
-
-    // --- Send each question as a multicast UDP packet ---
-    TrvMessage question;
-    for (int i = 0; i < 6; i++) {
-        char q_text[512];
-        snprintf(q_text, sizeof(q_text), "Question #%d:\n%s\n1. %s\n2. %s\n3. %s\n4. %s",
-                 i + 1,
-                 questions[i].question,
-                 questions[i].options[0],
-                 questions[i].options[1],
-                 questions[i].options[2],
-                 questions[i].options[3]);
-
-        build_message(&question, TRV_QUESTION, i, q_text);
-        int res = sendto(sockfd, &question, 4 + question.payload_len, 0,
-                         (struct sockaddr*)&mcast_addr, sizeof(mcast_addr));
-        if (res < 0) perror("sendto failed");
-
-        printf("📨 Sent question %d. Waiting for answers...\n", i + 1);
-        sleep(ANSWER_TIMEOUT); // Wait before next question
-    }
-
-    close(sockfd);
-    announce_winner_and_close();
+// ---- Keepalive timer: no frame within KEEPALIVE_TIMEOUT_MS, or no auth within AUTH_TIMEOUT_MS ----
+void keepalive_expired(void* arg) {
+    Client* client = (Client*)arg;
+    trace_event(TRACE_TIMEOUT, conn_index(client->handle), client->state == CONN_AUTH_WAIT, 0, 0, 0);
+    drop_client(client);
 }
 
-// ---- Announce winner to all clients and close server ----
-void announce_winner_and_close() {
-    int highest = -1;
-    for (int i = 0; i < client_count; i++) {
-        if (clients[i].verified && clients[i].score > highest) {
-            highest = clients[i].score;
-        }
+// ---- Hot restart, old server: a new server connected to the handover socket ----
+// Runs on loop 0 with every other loop parked, so nothing changes while the
+// state is copied. Fan-outs in flight exist only in loop queues, so the copy
+// waits for a moment with none. Nothing is torn down: unless the new server
+// confirms it has taken everything, the loops just carry on.
+void handover_give(int sock) {
+    if (use_uring) {
+        // Multishot recvs keep buffered bytes and socket references in the kernel
+        fprintf(stderr, "Hot restart is not supported with -u.\n");
+        close(sock);
+        return;
     }
+    if (successor >= 0 && successor != sock) close(successor);  // Only the newest server gets the state
+    successor = -1;
+
+    handover_pause();
+    if (bcast_jobs_pending() > 0) {
+        handover_resume();
+        successor = sock;
+        event_loop_timer(&loops[0], &handover_retry, HANDOVER_RETRY_MS);
+        return;
+    }
+    journal_sync();                 // The new server appends after everything journaled here
+    int clients = handover_save(sock);
+    char ack;
+    if (clients >= 0 && recv(sock, &ack, 1, 0) == 1) {
+        printf("Handed %d connection(s) over to the new server. Exiting.\n", clients);
+        exit(0);
+    }
+    handover_resume();
+    close(sock);
+    fprintf(stderr, "Hot restart failed; this server carries on.\n");
+}
 
-    char message[1024];
-    strcpy(message, "\n\n=== Final Scores ===\n");
-    for (int i = 0; i < client_count; i++) {
-        if (clients[i].verified) {
-            char line[128];
-            snprintf(line, sizeof(line), "%s: %d\n", clients[i].nickname, clients[i].score);
-            strcat(message, line);
-        }
+void handover_retried(void* arg) {
+    (void)arg;
+    if (successor >= 0) handover_give(successor);
+}
+
+// ---- Send every record: server, listeners, coordinator link, clients, rooms ----
+// Returns the number of connections sent, or -1 if the new server went away.
+int handover_save(int sock) {
+    static char bytes[HANDOVER_MAX_RECORD] __attribute__((aligned(64)));
+    static HandoverRoom room;
+    struct iovec iov[2];
+
+    HandoverServer hs;
+    memset(&hs, 0, sizeof(hs));
+    hs.version = HANDOVER_VERSION;
+    cookie_export(hs.cookie_key);
+    hs.next_game_id = next_game_id;
+    iov[0].iov_base = &hs;
+    iov[0].iov_len = sizeof(hs);
+    if (handover_send(sock, HANDOVER_SERVER, iov, 1, -1) < 0) return -1;
+
+    for (int i = 0; i < num_listeners; i++) {
+        if (handover_send(sock, HANDOVER_LISTENER, NULL, 0, listeners[i].socket) < 0) return -1;
     }
 
-    strcat(message, "\n");
-    int winners = 0;
-    char winner_name[32];
-    for (int i = 0; i < client_count; i++) {
-        if (clients[i].verified && clients[i].score == highest) {
-            winners++;
-            strcpy(winner_name, clients[i].nickname);
+    uint32_t len;
+    int coord = cluster_handover(bytes, &len);
+    iov[0].iov_base = bytes;
+    iov[0].iov_len = len;
+    if (coord >= 0 && handover_send(sock, HANDOVER_CLUSTER, iov, 1, coord) < 0) return -1;
+
+    // --- Connections, with the bytes they had not parsed or sent yet ---
+    int clients = 0;
+    for (uint32_t i = 0; i < MAX_CLIENTS; i++) {
+        Client* c = conn_slot(i);
+        if (!c) continue;
+        HandoverClient hc;
+        memset(&hc, 0, sizeof(hc));
+        hc.handle = c->handle;
+        hc.addr = c->addr;
+        hc.state = c->state;
+        hc.started = !__atomic_load_n(&c->start.queued, __ATOMIC_ACQUIRE);
+        hc.wire = c->wire;
+        hc.tcp_questions = c->tcp_questions;
+        memcpy(hc.nickname, c->nickname, sizeof(hc.nickname));
+        hc.loop = c->ev.loop->index;
+        room_save_seat(c, &hc);
+        hc.repaired = c->repaired;
+        hc.keepalive = timer_pending(&c->keepalive) ? c->keepalive.expires : 0;
+        hc.shutdown_pending = c->shutdown_pending;
+        hc.in_len = frame_ring_peek(&c->in, bytes);
+        hc.out_len = sendq_peek(&c->out, bytes + hc.in_len);
+        if (c->owed && hc.out_len + c->owed->len <= SENDQ_SIZE) {
+            // The coalesced question goes out after the backlog, as it would have here
+            memcpy(bytes + hc.in_len + hc.out_len, c->owed->data, c->owed->len);
+            hc.out_len += c->owed->len;
         }
+        iov[0].iov_base = &hc;
+        iov[0].iov_len = sizeof(hc);
+        iov[1].iov_base = bytes;
+        iov[1].iov_len = hc.in_len + hc.out_len;
+        if (handover_send(sock, HANDOVER_CLIENT, iov, 2, c->socket) < 0) return -1;
+        clients++;
     }
 
-    if (winners == 0) {
-        strcat(message, "No one answered any questions correctly.\n");
-    } else if (winners == 1) {
-        strcat(message, "\n🏆 Winner: ");
-        strcat(message, winner_name);
-        strcat(message, "!\n");
-    } else {
-        strcat(message, "\n⚔️ It's a tie between multiple players!\n");
+    HandoverReturning* ret = (HandoverReturning*)bytes;
+    int per_record = (sizeof(bytes) - sizeof(*ret)) / sizeof(JournalPlayer);
+    for (int id = 0; id < MAX_ROOMS; id++) {
+        if (room_save(id, &room) < 0) continue;
+        iov[0].iov_base = &room;
+        iov[0].iov_len = sizeof(room);
+        if (handover_send(sock, HANDOVER_ROOM, iov, 1, -1) < 0) return -1;
+        ret->room = id;
+        for (ret->first = 0; ret->first < room.num_returning; ret->first += per_record) {
+            int n = room_save_returning(id, ret->first, ret->players, per_record);
+            iov[0].iov_base = ret;
+            iov[0].iov_len = sizeof(*ret) + n * sizeof(JournalPlayer);
+            if (handover_send(sock, HANDOVER_RETURNING, iov, 1, -1) < 0) return -1;
+        }
     }
+    if (handover_send(sock, HANDOVER_END, NULL, 0, -1) < 0) return -1;
+    return clients;
+}
 
-    TrvMessage winmsg;
-    build_message(&winmsg, TRV_WINNER, 0, message);
+// ---- Hot restart, new server: take everything over (before the loops run) ----
+// Returns 0 once the old server has been told to exit, or -1 if it is still
+// in charge. Scoreboard entries name players by handle, so each room's
+// entries are renamed to the handles its players got here.
+int handover_take(int sock) {
+    static char buf[HANDOVER_MAX_RECORD] __attribute__((aligned(64)));
+    static ConnHandle moved[MAX_CLIENTS][2];  // By old slot: old handle, new handle
+    int clients = 0, rooms_taken = 0;
 
-    // Send to all clients (TCP)
-    for (int i = 0; i < client_count; i++) {
-        if (clients[i].verified) {
-            send(clients[i].socket, &winmsg, 4 + winmsg.payload_len, 0);
-            close(clients[i].socket);
+    while (1) {
+        uint32_t type;
+        int fd;
+        int len = handover_recv(sock, &type, buf, sizeof(buf), &fd);
+        if (len < 0) {
+            perror("Hot restart: handover record");
+            return -1;
+        }
+        if (type == HANDOVER_SERVER && len == sizeof(HandoverServer)) {
+            HandoverServer* hs = (HandoverServer*)buf;
+            if (hs->version != HANDOVER_VERSION) {
+                fprintf(stderr, "Hot restart: old server sends handover version %u, not %d\n",
+                        hs->version, HANDOVER_VERSION);
+                return -1;
+            }
+            cookie_import(hs->cookie_key);
+            next_game_id = hs->next_game_id;
+        } else if (type == HANDOVER_LISTENER && fd >= 0 && num_listeners < MAX_LOOPS) {
+            EventLoop* loop = &loops[sharded_accept ? num_listeners % num_loops : 0];
+            start_listener(&listeners[num_listeners], fd, loop);
+            num_listeners++;
+        } else if (type == HANDOVER_CLUSTER && fd >= 0) {
+            if (cluster_adopt(fd, buf, len) < 0) return -1;
+        } else if (type == HANDOVER_CLIENT && fd >= 0 && len >= (int)sizeof(HandoverClient)) {
+            HandoverClient* hc = (HandoverClient*)buf;
+            Client* c = take_client(fd, hc, buf + sizeof(*hc));
+            if (!c) continue;
+            moved[conn_index(hc->handle)][0] = hc->handle;
+            moved[conn_index(hc->handle)][1] = c->handle;
+            clients++;
+        } else if (type == HANDOVER_ROOM && len == sizeof(HandoverRoom)) {
+            HandoverRoom* hr = (HandoverRoom*)buf;
+            for (int i = 0; i < hr->num_scores; i++) {
+                uint32_t* player = &hr->scores[i].entry.player;
+                uint32_t slot = conn_index(*player);
+                // A player who left keeps a slot number no connection has
+                *player = slot < MAX_CLIENTS && moved[slot][0] == *player ? moved[slot][1] : (uint32_t)(MAX_CLIENTS + i);
+            }
+            room_restore(hr);
+            rooms_taken++;
+        } else if (type == HANDOVER_RETURNING && len >= (int)sizeof(HandoverReturning)) {
+            HandoverReturning* ret = (HandoverReturning*)buf;
+            int n = (len - sizeof(*ret)) / sizeof(JournalPlayer);
+            if (ret->room < 0 || ret->room >= MAX_ROOMS || room_restore_returning(ret->room, ret->first, ret->players, n) < 0) {
+                fprintf(stderr, "Hot restart: bad returning players record\n");
+                return -1;
+            }
+        } else if (type == HANDOVER_END) {
+            char ack = 1;
+            if (send(sock, &ack, 1, MSG_NOSIGNAL) != 1) return -1;
+            break;
+        } else {
+            if (fd >= 0) close(fd);
+            fprintf(stderr, "Hot restart: unexpected handover record %u\n", type);
+            return -1;
         }
     }
-
-    // Also announce result via multicast
-    send_multicast_message(&winmsg);
-
-    printf("%s", message);
-    printf("\nGame over. Shutting down server.\n");
-    exit(0);
+    close(sock);
+    printf("Took over %d connection(s) and %d room(s) from the old server.\n", clients, rooms_taken);
+    return 0;
 }
 
-// ---- Helper: send a message via UDP multicast ----
-void send_multicast_message(TrvMessage* msg) {
-    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    struct in_addr localInterface;
-    localInterface.s_addr = inet_addr("192.3.1.1");
-    setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_IF, (char *)&localInterface, sizeof(localInterface));
-
-    struct sockaddr_in mcast_addr;
-    memset(&mcast_addr, 0, sizeof(mcast_addr));
-    mcast_addr.sin_family = AF_INET;
-    mcast_addr.sin_addr.s_addr = inet_addr(MULTICAST_IP);
-    mcast_addr.sin_port = htons(MULTICAST_PORT);
-
-    sendto(sockfd, msg, 4 + msg->payload_len, 0, (struct sockaddr*)&mcast_addr, sizeof(mcast_addr));
-    close(sockfd);
-}
+// ---- Rebuild one handed-over connection ----
+// Nothing is sent yet: queued output goes out once the loop runs, so the
+// streams are untouched if the takeover fails part way.
+Client* take_client(int fd, const HandoverClient* hc, const char* bytes) {
+    Client* client = conn_alloc();
+    if (!client) {
+        close(fd);
+        return NULL;
+    }
+    client->socket = fd;
+    client->addr = hc->addr;
+    client->state = hc->state;
+    client->wire = hc->wire;
+    client->verified = hc->state == CONN_PLAYING;
+    client->tcp_questions = hc->tcp_questions;
+    memcpy(client->nickname, hc->nickname, sizeof(client->nickname));
+    client->nickname[sizeof(client->nickname) - 1] = '\0';
+    client->repaired = hc->repaired;
+    client->ev.on_event = handle_client;
+    client->ev.loop = &loops[hc->loop % num_loops];
+    timer_init(&client->keepalive, keepalive_expired, client);
+    frame_ring_init(&client->in);
+    frame_ring_write(&client->in, bytes, hc->in_len);
+    if (hc->room >= 0 && room_restore_seat(client, hc) < 0) {
+        close(fd);
+        conn_free(client);
+        return NULL;
+    }
+    if (client->state == CONN_AUTH_WAIT) __atomic_add_fetch(&handshakes, 1, __ATOMIC_RELAXED);
 
-// ---- Thread: checks client keepalives, removes dead clients ----
-void* keepalive_checker(void* arg) {
-    while (1) {
-        sleep(5); // Check every 5 seconds
-        time_t now = time(NULL);
-        for (int i = 0; i < client_count; i++) {
-            if (clients[i].verified &&
-                difftime(now, clients[i].last_keepalive) > KEEPALIVE_TIMEOUT) {
-                printf("⚠️  %s timed out.\n", clients[i].nickname);
-                close(clients[i].socket);
-                clients[i].verified = 0;
-            }
+    // Accepted but not started when the old server paused: start it here
+    if (!hc->started) {
+        loop_task_init(&client->start, start_client, client);
+        event_loop_post(client->ev.loop, &client->start);
+        return client;
+    }
+    if (watch_client(client) < 0) return NULL;
+    if (hc->keepalive) timer_add(&client->ev.loop->timers, &client->keepalive, hc->keepalive);
+    if (hc->out_len) {
+        if (use_uring) {
+            client->in_flight = hc->out_len;
+            uring_send(client->ev.loop->uring, fd, client->handle, bytes + hc->in_len, hc->out_len,
+                       hc->shutdown_pending);
+        } else {
+            sendq_push(&client->out, bytes + hc->in_len, hc->out_len);
+            client->shutdown_pending = hc->shutdown_pending;
         }
     }
-    return NULL;
+    return client;
 }
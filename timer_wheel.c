@@ -0,0 +1,128 @@
+#include <string.h>
+#include "timer_wheel.h"
+
+#define LEVEL_SHIFT(l) (TIMER_SLOT_BITS * (l))
+#define SLOT_MASK (TIMER_SLOTS - 1)
+#define WHEEL_SPAN (1ULL << LEVEL_SHIFT(TIMER_LEVELS))
+
+// ---- Rotate a 64-slot occupancy mask right so slot idx lands on bit 0 ----
+static inline uint64_t rotate_mask(uint64_t m, unsigned idx) {
+    idx &= SLOT_MASK;
+    return idx ? (m >> idx) | (m << (64 - idx)) : m;
+}
+
+// ---- Put an armed timer in the slot matching its distance from w->now ----
+static void wheel_insert(TimerWheel* w, Timer* t) {
+    uint64_t expires = t->expires < w->now ? w->now : t->expires;
+    uint64_t delta = expires - w->now;
+    if (delta >= WHEEL_SPAN) expires = w->now + WHEEL_SPAN - 1;  // Cascades again later
+
+    int level = 0;
+    while (level < TIMER_LEVELS - 1 && delta >= (1ULL << LEVEL_SHIFT(level + 1))) level++;
+    unsigned slot = (expires >> LEVEL_SHIFT(level)) & SLOT_MASK;
+
+    Timer** head = &w->slots[level][slot];
+    t->next = *head;
+    if (t->next) t->next->pprev = &t->next;
+    t->pprev = head;
+    *head = t;
+    w->occupied[level] |= 1ULL << slot;
+}
+
+void timer_wheel_init(TimerWheel* w, uint64_t now) {
+    memset(w, 0, sizeof(*w));
+    w->now = now;
+}
+
+void timer_add(TimerWheel* w, Timer* t, uint64_t expires) {
+    timer_cancel(t);
+    t->expires = expires;
+    wheel_insert(w, t);
+}
+
+// Bits of emptied slots are cleared lazily when the slot is next processed
+void timer_cancel(Timer* t) {
+    if (!t->pprev) return;
+    *t->pprev = t->next;
+    if (t->next) t->next->pprev = t->pprev;
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+// ---- Earliest tick >= w->now that has timers to fire or a slot to cascade ----
+static uint64_t wheel_next_tick(const TimerWheel* w) {
+    uint64_t best = UINT64_MAX;
+
+    // Level 0 holds timers for the next 64 ticks, starting at now's slot
+    if (w->occupied[0]) {
+        best = w->now + __builtin_ctzll(rotate_mask(w->occupied[0], w->now));
+    }
+
+    // Level l slots are cascaded when the tick crosses a multiple of 64^l
+    for (int l = 1; l < TIMER_LEVELS; l++) {
+        uint64_t m = w->occupied[l];
+        if (!m) continue;
+        uint64_t block = w->now >> LEVEL_SHIFT(l);
+        uint64_t k;
+        if ((w->now & ((1ULL << LEVEL_SHIFT(l)) - 1)) == 0) {
+            k = __builtin_ctzll(rotate_mask(m, block));           // Current slot still due
+        } else {
+            k = 1 + __builtin_ctzll(rotate_mask(m, block + 1));
+        }
+        uint64_t tick = (block + k) << LEVEL_SHIFT(l);
+        if (tick < best) best = tick;
+    }
+    return best;
+}
+
+// ---- Move every timer of one slot down to the level it now belongs to ----
+static void wheel_cascade(TimerWheel* w, int level, unsigned slot) {
+    Timer* t = w->slots[level][slot];
+    w->slots[level][slot] = NULL;
+    w->occupied[level] &= ~(1ULL << slot);
+    while (t) {
+        Timer* next = t->next;
+        wheel_insert(w, t);
+        t = next;
+    }
+}
+
+// ---- Process tick: cascade higher levels, then fire level-0 slot ----
+static void wheel_process(TimerWheel* w, uint64_t tick) {
+    w->now = tick;
+    for (int l = 1; l < TIMER_LEVELS; l++) {
+        if (tick & ((1ULL << LEVEL_SHIFT(l)) - 1)) break;
+        wheel_cascade(w, l, (tick >> LEVEL_SHIFT(l)) & SLOT_MASK);
+    }
+
+    // Detach the due slot so callbacks that re-arm timers land in later slots
+    unsigned slot = tick & SLOT_MASK;
+    Timer* expired = w->slots[0][slot];
+    w->slots[0][slot] = NULL;
+    w->occupied[0] &= ~(1ULL << slot);
+    if (expired) expired->pprev = &expired;
+    w->now = tick + 1;
+
+    while (expired) {
+        Timer* t = expired;
+        timer_cancel(t);  // Advances expired to the next timer
+        t->fire(t->arg);
+    }
+}
+
+void timer_wheel_advance(TimerWheel* w, uint64_t now) {
+    while (w->now <= now) {
+        uint64_t tick = wheel_next_tick(w);
+        if (tick > now) {
+            w->now = now + 1;  // Nothing due: skip the idle ticks
+            break;
+        }
+        wheel_process(w, tick);
+    }
+}
+
+int64_t timer_wheel_timeout(const TimerWheel* w, uint64_t now) {
+    uint64_t tick = wheel_next_tick(w);
+    if (tick == UINT64_MAX) return -1;
+    return tick <= now ? 0 : (int64_t)(tick - now);
+}
@@ -0,0 +1,66 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <time.h>
+
+// ---- Hierarchical timer wheel (millisecond ticks) ----
+// TIMER_LEVELS levels of 64 slots each. Level l holds timers expiring within
+// 64^(l+1) ms; they cascade down a level as the wheel turns. Adding, cancelling
+// and re-arming a timer are O(1). A 64-bit occupancy mask per level lets the
+// wheel find its next due tick, and skip idle time, without scanning slots.
+
+#define TIMER_SLOT_BITS 6
+#define TIMER_SLOTS (1 << TIMER_SLOT_BITS)
+#define TIMER_LEVELS 5              // 64^5 ms ≈ 12 days
+
+typedef struct Timer {
+    struct Timer* next;             // Next timer in the same slot
+    struct Timer** pprev;           // Link pointing at this timer; NULL when not armed
+    uint64_t expires;               // Absolute expiry time (ms)
+    void (*fire)(void* arg);        // Callback, run on the wheel's thread
+    void* arg;                      // Callback argument
+} Timer;
+
+typedef struct TimerWheel {
+    uint64_t now;                   // Next tick (ms) that has not been processed
+    uint64_t occupied[TIMER_LEVELS];  // Bit s set if slot s of the level may hold timers
+    Timer* slots[TIMER_LEVELS][TIMER_SLOTS];
+} TimerWheel;
+
+// Monotonic clock in milliseconds
+static inline uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Prepare a timer with its callback (not armed)
+static inline void timer_init(Timer* t, void (*fire)(void* arg), void* arg) {
+    t->next = NULL;
+    t->pprev = NULL;
+    t->expires = 0;
+    t->fire = fire;
+    t->arg = arg;
+}
+
+static inline int timer_pending(const Timer* t) {
+    return t->pprev != NULL;
+}
+
+// Start an empty wheel at time now
+void timer_wheel_init(TimerWheel* w, uint64_t now);
+
+// Arm (or re-arm) t to fire at absolute time expires
+void timer_add(TimerWheel* w, Timer* t, uint64_t expires);
+
+// Disarm t (no-op if it is not armed)
+void timer_cancel(Timer* t);
+
+// Fire every timer that expires at or before now
+void timer_wheel_advance(TimerWheel* w, uint64_t now);
+
+// Milliseconds until the wheel next has work, or -1 if it is empty
+int64_t timer_wheel_timeout(const TimerWheel* w, uint64_t now);
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "trace.h"
+
+// ---- Single-producer / single-consumer ring of one thread ----
+// head is written only by the owning thread, tail only by the drainer; each
+// sits on its own cache line so the two sides don't contend.
+typedef struct {
+    uint64_t head __attribute__((aligned(64)));  // Next record to write
+    uint64_t dropped;                             // Records lost while the ring was full
+    uint64_t tail __attribute__((aligned(64)));  // Next record to drain
+    uint16_t index;                               // Position in trace_rings[]
+    TraceRecord records[TRACE_RING_RECORDS] __attribute__((aligned(64)));
+} TraceRing;
+
+int trace_enabled = 0;
+
+static TraceRing* trace_rings[TRACE_MAX_THREADS];
+static int trace_ring_count = 0;
+static FILE* trace_file;            // NULL once closed
+static pthread_t trace_thread;
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;  // Drainer against trace_close()
+static uint64_t reported_drops[TRACE_MAX_THREADS];
+static __thread TraceRing* my_ring = NULL;
+
+static uint64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// ---- First record from a thread: give it a ring ----
+static TraceRing* trace_register(void) {
+    int i = __atomic_fetch_add(&trace_ring_count, 1, __ATOMIC_RELAXED);
+    if (i >= TRACE_MAX_THREADS) return NULL;
+    TraceRing* ring = aligned_alloc(64, sizeof(TraceRing));
+    if (!ring) return NULL;
+    memset(ring, 0, sizeof(*ring));
+    ring->index = (uint16_t)i;
+    __atomic_store_n(&trace_rings[i], ring, __ATOMIC_RELEASE);
+    return ring;
+}
+
+// Claim the next slot of this thread's ring, or NULL if it is full
+static TraceRecord* trace_slot(uint16_t event, uint32_t client) {
+    TraceRing* ring = my_ring;
+    if (!ring && !(ring = my_ring = trace_register())) return NULL;
+
+    uint64_t head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= TRACE_RING_RECORDS) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    TraceRecord* rec = &ring->records[head & (TRACE_RING_RECORDS - 1)];
+    rec->ts_ns = clock_ns(CLOCK_MONOTONIC);
+    rec->event = event;
+    rec->thread = ring->index;
+    rec->client = client;
+    return rec;
+}
+
+// Publish the slot claimed by trace_slot()
+static void trace_commit(void) {
+    __atomic_store_n(&my_ring->head, my_ring->head + 1, __ATOMIC_RELEASE);
+}
+
+void trace_write(uint16_t event, uint32_t client, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {
+    TraceRecord* rec = trace_slot(event, client);
+    if (!rec) return;
+    rec->u.a[0] = a0;
+    rec->u.a[1] = a1;
+    rec->u.a[2] = a2;
+    rec->u.a[3] = a3;
+    trace_commit();
+}
+
+void trace_write_text(uint16_t event, uint32_t client, uint32_t a0, const char* text) {
+    TraceRecord* rec = trace_slot(event, client);
+    if (!rec) return;
+    rec->u.s.a0 = a0;
+    size_t len = strnlen(text, sizeof(rec->u.s.text));
+    memset(rec->u.s.text, 0, sizeof(rec->u.s.text));
+    memcpy(rec->u.s.text, text, len);
+    trace_commit();
+}
+
+// ---- Drainer: copy every ring to the file, oldest records first ----
+static void trace_drain(void) {
+    int count = __atomic_load_n(&trace_ring_count, __ATOMIC_RELAXED);
+    if (count > TRACE_MAX_THREADS) count = TRACE_MAX_THREADS;
+    for (int i = 0; i < count; i++) {
+        TraceRing* ring = __atomic_load_n(&trace_rings[i], __ATOMIC_ACQUIRE);
+        if (!ring) continue;  // Still being registered
+
+        uint64_t tail = ring->tail;
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        while (tail != head) {
+            // Write the contiguous run up to the end of the ring in one go
+            uint64_t pos = tail & (TRACE_RING_RECORDS - 1);
+            uint64_t n = head - tail;
+            if (n > TRACE_RING_RECORDS - pos) n = TRACE_RING_RECORDS - pos;
+            fwrite(&ring->records[pos], sizeof(TraceRecord), n, trace_file);
+            tail += n;
+            __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+        }
+
+        uint64_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+        if (dropped != reported_drops[i]) {
+            TraceRecord rec;
+            memset(&rec, 0, sizeof(rec));
+            rec.ts_ns = clock_ns(CLOCK_MONOTONIC);
+            rec.event = TRACE_DROPPED;
+            rec.thread = ring->index;
+            rec.u.a[0] = (uint32_t)(dropped - reported_drops[i]);
+            fwrite(&rec, sizeof(rec), 1, trace_file);
+            reported_drops[i] = dropped;
+        }
+    }
+    fflush(trace_file);
+}
+
+static void* trace_drainer(void* arg) {
+    struct timespec period = { 0, TRACE_DRAIN_MS * 1000000L };
+    (void)arg;
+    while (1) {
+        nanosleep(&period, NULL);
+        pthread_mutex_lock(&drain_lock);
+        if (trace_file) trace_drain();
+        pthread_mutex_unlock(&drain_lock);
+    }
+    return NULL;
+}
+
+void trace_close(void) {
+    pthread_mutex_lock(&drain_lock);
+    if (trace_file) {
+        trace_enabled = 0;
+        trace_drain();
+        fclose(trace_file);
+        trace_file = NULL;
+    }
+    pthread_mutex_unlock(&drain_lock);
+}
+
+// ---- Open the file and start draining ----
+int trace_open(const char* path) {
+    trace_file = fopen(path, "wb");
+    if (!trace_file) {
+        perror("Trace file open failed");
+        return -1;
+    }
+
+    TraceFileHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_MAGIC, 4);
+    hdr.version = TRACE_VERSION;
+    hdr.record_size = sizeof(TraceRecord);
+    hdr.start_mono_ns = clock_ns(CLOCK_MONOTONIC);
+    hdr.start_real_ns = clock_ns(CLOCK_REALTIME);
+    fwrite(&hdr, sizeof(hdr), 1, trace_file);
+    fflush(trace_file);
+
+    if (pthread_create(&trace_thread, NULL, trace_drainer, NULL) != 0) {
+        perror("Trace thread failed");
+        fclose(trace_file);
+        trace_file = NULL;
+        return -1;
+    }
+    pthread_detach(trace_thread);
+    atexit(trace_close);            // exit() after a hot restart hand-over
+    trace_enabled = 1;
+    return 0;
+}
@@ -0,0 +1,84 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// ---- Binary trace log ----
+// Hot paths append fixed-size records to a ring owned by the calling thread
+// (single producer, no locks, no syscalls). A background thread drains every
+// ring into the trace file, and trace_decode turns the file into text.
+// When a ring is full the record is dropped and counted, never blocking.
+
+#define TRACE_MAGIC "TRVT"
+#define TRACE_VERSION 1
+#define TRACE_RING_RECORDS 8192     // Per thread (power of two)
+#define TRACE_MAX_THREADS 64
+#define TRACE_DRAIN_MS 50           // Drainer wakeup period
+
+// ---- Events and their arguments (client is the connection slot) ----
+enum {
+    TRACE_CONNECT = 1,              // a0 = IPv4 address (network order), a1 = port
+    TRACE_AUTH,                     // a0 = room, text = nickname (first 12 bytes)
+    TRACE_AUTH_FAIL,                // a0 = 0 bad code/nickname, 1 all rooms busy
+    TRACE_KEEPALIVE,
+    TRACE_ANSWER,                   // a0 = question, a1 = answer, a2 = 1 if correct, a3 = latency (ms)
+    TRACE_ANSWER_LATE,              // a0 = question
+    TRACE_ANSWER_DUP,               // a0 = question
+    TRACE_NACK,                     // a0 = question
+    TRACE_REPAIR,                   // a0 = question resent over TCP
+    TRACE_TIMEOUT,                  // Keepalive or handshake deadline expired (a0 = 1: handshake)
+    TRACE_BAD_FRAME,                // Oversized frame, connection dropped
+    TRACE_CLOSE,                    // a0 = peak send queue (bytes), a1 = frames shed
+    TRACE_DROPPED,                  // Written by the drainer: a0 = records lost to full rings
+    TRACE_SLOW,                     // Send queue backed up: a0 = bytes queued, a1 = SLOW_* action
+    TRACE_NUM_EVENTS
+};
+
+// ---- One record (32 bytes on disk and in the rings) ----
+typedef struct {
+    uint64_t ts_ns;                 // CLOCK_MONOTONIC
+    uint16_t event;                 // TRACE_* event
+    uint16_t thread;                // Ring (thread) that wrote the record
+    uint32_t client;
+    union {
+        uint32_t a[4];
+        struct {
+            uint32_t a0;
+            char text[12];          // Not NUL-terminated when all 12 bytes are used
+        } s;
+    } u;
+} TraceRecord;
+
+// ---- File header, followed by records ----
+typedef struct {
+    char magic[4];                  // TRACE_MAGIC
+    uint32_t version;               // TRACE_VERSION
+    uint32_t record_size;           // sizeof(TraceRecord)
+    uint32_t reserved;
+    uint64_t start_mono_ns;         // CLOCK_MONOTONIC and CLOCK_REALTIME at the same
+    uint64_t start_real_ns;         // instant, to print records with wall-clock times
+} TraceFileHeader;
+
+extern int trace_enabled;
+
+// Create the trace file and start the drainer thread. Returns 0 or -1.
+int trace_open(const char* path);
+
+// Write out everything traced so far and close the file (idempotent)
+void trace_close(void);
+
+// Append a record from the calling thread (slow path of the inline helpers)
+void trace_write(uint16_t event, uint32_t client, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+void trace_write_text(uint16_t event, uint32_t client, uint32_t a0, const char* text);
+
+// Record an event; a single predictable branch when tracing is off
+static inline void trace_event(uint16_t event, uint32_t client, uint32_t a0, uint32_t a1,
+                               uint32_t a2, uint32_t a3) {
+    if (trace_enabled) trace_write(event, client, a0, a1, a2, a3);
+}
+
+static inline void trace_event_text(uint16_t event, uint32_t client, uint32_t a0, const char* text) {
+    if (trace_enabled) trace_write_text(event, client, a0, text);
+}
+
+#endif // TRACE_H
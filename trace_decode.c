@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include "trace.h"
+
+// ---- Offline decoder for the server's binary trace log ----
+// Usage: ./trace_decode server.trace
+// Records are merged across threads by timestamp and printed one per line.
+
+typedef struct {
+    TraceRecord rec;
+    size_t order;                   // Position in the file, to keep same-time records stable
+} Entry;
+
+static int by_time(const void* a, const void* b) {
+    const Entry* x = a;
+    const Entry* y = b;
+    if (x->rec.ts_ns != y->rec.ts_ns) return x->rec.ts_ns < y->rec.ts_ns ? -1 : 1;
+    return x->order < y->order ? -1 : x->order > y->order;
+}
+
+// Nickname of each connection slot, from its latest TRACE_AUTH record
+static char (*names)[13];
+static size_t num_names;
+
+static const char* name_of(uint32_t client) {
+    return client < num_names && names[client][0] ? names[client] : "?";
+}
+
+static void set_name(uint32_t client, const char* text) {
+    if (client >= num_names) {
+        size_t n = num_names ? num_names : 1024;
+        while (n <= client) n *= 2;
+        names = realloc(names, n * sizeof(*names));
+        if (!names) {
+            perror("realloc failed");
+            exit(1);
+        }
+        memset(names + num_names, 0, (n - num_names) * sizeof(*names));
+        num_names = n;
+    }
+    memset(names[client], 0, sizeof(names[client]));
+    memcpy(names[client], text, strnlen(text, 12));
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s trace_file\n", argv[0]);
+        return 1;
+    }
+    FILE* f = fopen(argv[1], "rb");
+    if (!f) {
+        perror("Trace file open failed");
+        return 1;
+    }
+
+    TraceFileHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr.magic, TRACE_MAGIC, 4) != 0 ||
+        hdr.version != TRACE_VERSION || hdr.record_size != sizeof(TraceRecord)) {
+        fprintf(stderr, "%s is not a version %d trace file\n", argv[1], TRACE_VERSION);
+        return 1;
+    }
+
+    // --- Load every record (a partial record at the end is ignored) ---
+    size_t count = 0, cap = 4096;
+    Entry* entries = malloc(cap * sizeof(Entry));
+    while (entries && fread(&entries[count].rec, sizeof(TraceRecord), 1, f) == 1) {
+        entries[count].order = count;
+        if (++count == cap) {
+            cap *= 2;
+            entries = realloc(entries, cap * sizeof(Entry));
+        }
+    }
+    fclose(f);
+    if (!entries) {
+        perror("malloc failed");
+        return 1;
+    }
+    qsort(entries, count, sizeof(Entry), by_time);
+
+    for (size_t i = 0; i < count; i++) {
+        TraceRecord* r = &entries[i].rec;
+
+        // Wall-clock time of the record
+        uint64_t real = hdr.start_real_ns + (r->ts_ns - hdr.start_mono_ns);
+        time_t secs = (time_t)(real / 1000000000ULL);
+        struct tm tm;
+        localtime_r(&secs, &tm);
+        char when[16];
+        strftime(when, sizeof(when), "%H:%M:%S", &tm);
+        printf("%s.%06llu [t%u] ", when, (unsigned long long)(real % 1000000000ULL / 1000), r->thread);
+
+        if (r->event == TRACE_AUTH) set_name(r->client, r->u.s.text);
+        if (r->event == TRACE_CONNECT) set_name(r->client, "");  // Slot reused by a new connection
+        const char* who = name_of(r->client);
+        uint32_t* a = r->u.a;
+
+        switch (r->event) {
+            case TRACE_CONNECT: {
+                char ip[INET_ADDRSTRLEN];
+                struct in_addr addr = { a[0] };
+                inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+                printf("client %u connected from %s:%u\n", r->client, ip, a[1]);
+                break;
+            }
+            case TRACE_AUTH:
+                printf("client %u (%s) verified, room %u\n", r->client, who, r->u.s.a0);
+                break;
+            case TRACE_AUTH_FAIL:
+                printf("client %u auth failed: %s\n", r->client, a[0] ? "all rooms busy" : "bad code or nickname");
+                break;
+            case TRACE_KEEPALIVE:
+                printf("client %u (%s) keepalive\n", r->client, who);
+                break;
+            case TRACE_ANSWER:
+                printf("client %u (%s) answered question %u with %u: %s in %u ms\n", r->client, who,
+                       a[0] + 1, a[1], a[2] ? "correct" : "wrong", a[3]);
+                break;
+            case TRACE_ANSWER_LATE:
+                printf("client %u (%s) answered question %u after it closed\n", r->client, who, a[0] + 1);
+                break;
+            case TRACE_ANSWER_DUP:
+                printf("client %u (%s) answered question %u again\n", r->client, who, a[0] + 1);
+                break;
+            case TRACE_NACK:
+                printf("client %u (%s) NACK question %u\n", r->client, who, a[0] + 1);
+                break;
+            case TRACE_REPAIR:
+                printf("client %u (%s) repaired question %u over TCP\n", r->client, who, a[0] + 1);
+                break;
+            case TRACE_TIMEOUT:
+                printf("client %u (%s) timed out%s\n", r->client, who, a[0] ? " before authenticating" : "");
+                break;
+            case TRACE_BAD_FRAME:
+                printf("client %u (%s) sent an oversized frame\n", r->client, who);
+                break;
+            case TRACE_CLOSE:
+                if (a[0] || a[1]) {
+                    printf("client %u (%s) closed, send queue peaked at %u bytes, %u frames shed\n",
+                           r->client, who, a[0], a[1]);
+                } else {
+                    printf("client %u (%s) closed\n", r->client, who);
+                }
+                break;
+            case TRACE_SLOW: {
+                static const char* actions[] = { "coalesced a question", "dropped a question", "disconnected" };
+                printf("client %u (%s) slow, %u bytes queued: %s\n", r->client, who, a[0],
+                       a[1] < 3 ? actions[a[1]] : "?");
+                break;
+            }
+            case TRACE_DROPPED:
+                printf("%u records lost (ring full)\n", a[0]);
+                break;
+            default:
+                printf("unknown event %u\n", r->event);
+        }
+    }
+    free(entries);
+    return 0;
+}
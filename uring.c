@@ -0,0 +1,447 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "uring.h"
+
+#define URING_BGID 0                // Buffer group of the provided receive buffers
+
+// ---- user_data tags (low 3 bits; pointers are to malloc()ed memory, so 8-aligned) ----
+enum {
+    TAG_NONE,                       // Completion needs no handling (linked shutdown)
+    TAG_ACCEPT,                     // Pointer to an Acceptor
+    TAG_RECV,                       // fd << 35 | handle << 3
+    TAG_SEND,                       // Pointer to a SendBuf
+    TAG_SEND_BCAST                  // Pointer to a SendRef (one Bcast reference per send)
+};
+#define TAG_BITS 3
+#define TAG_MASK 7ULL
+
+typedef struct {
+    int fd;
+    void* ctx;
+} Acceptor;
+
+typedef struct {
+    ConnHandle h;                   // Connection the bytes are for
+    int len;
+    char data[];
+} SendBuf;
+
+// ---- A broadcast send in flight; kept on the ring's free list once done ----
+typedef struct SendRef {
+    struct SendRef* next;           // Next free one
+    ConnHandle h;
+    Bcast* b;
+} SendRef;
+
+#define SENDREF_CHUNK 1024          // SendRefs allocated at a time (never freed)
+
+struct Uring {
+    int fd;
+    EventHandler ev;                // Ring fd in the loop's epoll set (must be first)
+    UringCallbacks cb;
+
+    // Submission queue
+    uint32_t* sq_head;
+    uint32_t* sq_tail;
+    uint32_t* sq_flags;
+    uint32_t* sq_array;
+    uint32_t sq_mask;
+    uint32_t sq_entries;
+    uint32_t sq_local_tail;         // Queued but not yet published to the kernel
+    struct io_uring_sqe* sqes;
+
+    // Completion queue
+    uint32_t* cq_head;
+    uint32_t* cq_tail;
+    uint32_t cq_mask;
+    struct io_uring_cqe* cqes;
+
+    // Provided receive buffers
+    struct io_uring_buf_ring* br;
+    char* bufs;
+    uint16_t br_tail;
+
+    SendRef* free_refs;             // Broadcast send records to reuse
+    uint32_t batch_count;           // Sends queued by uring_batch_add()
+    uint32_t batch_gen;             // Batch number, in the high half of user_data
+    uint64_t batch_reaped[URING_ENTRIES / 64];  // Entries of this batch with a result
+};
+
+static int sys_enter(int fd, unsigned submit, unsigned wait, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+// ---- Give buffer bid back to the kernel (published by uring_recycle_done) ----
+static void buf_recycle(Uring* u, uint16_t bid) {
+    struct io_uring_buf* b = &u->br->bufs[u->br_tail & (URING_BUFS - 1)];
+    b->addr = (uint64_t)(uintptr_t)(u->bufs + (size_t)bid * URING_BUF_SIZE);
+    b->len = URING_BUF_SIZE;
+    b->bid = bid;
+    u->br_tail++;
+}
+
+static void buf_publish(Uring* u) {
+    __atomic_store_n(&u->br->tail, u->br_tail, __ATOMIC_RELEASE);
+}
+
+// ---- Next free SQE, submitting first if the queue is full ----
+static struct io_uring_sqe* get_sqe(Uring* u) {
+    uint32_t head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    if (u->sq_local_tail - head >= u->sq_entries) {
+        uring_flush(u);
+        head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+        if (u->sq_local_tail - head >= u->sq_entries) return NULL;
+    }
+    uint32_t idx = u->sq_local_tail & u->sq_mask;
+    struct io_uring_sqe* sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sq_array[idx] = idx;
+    u->sq_local_tail++;
+    return sqe;
+}
+
+void uring_flush(Uring* u) {
+    uint32_t tail = *u->sq_tail;
+    uint32_t n = u->sq_local_tail - tail;
+    if (n == 0) return;
+    __atomic_store_n(u->sq_tail, u->sq_local_tail, __ATOMIC_RELEASE);
+    while (n > 0) {
+        int ret = sys_enter(u->fd, n, 0, 0);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EBUSY) perror("io_uring_enter failed");
+            break;
+        }
+        n -= ret;
+        if (ret == 0) break;
+    }
+}
+
+int uring_accept(Uring* u, int listen_fd, void* ctx) {
+    Acceptor* a = malloc(sizeof(Acceptor));
+    if (!a) return -1;
+    a->fd = listen_fd;
+    a->ctx = ctx;
+    struct io_uring_sqe* sqe = get_sqe(u);
+    if (!sqe) {
+        free(a);
+        return -1;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = (uint64_t)(uintptr_t)a | TAG_ACCEPT;
+    return 0;
+}
+
+int uring_recv(Uring* u, int fd, ConnHandle h) {
+    struct io_uring_sqe* sqe = get_sqe(u);
+    if (!sqe) return -1;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = (uint64_t)fd << 35 | (uint64_t)h << TAG_BITS | TAG_RECV;
+    return 0;
+}
+
+// ---- Queue a send of buf (kept alive by the caller until its completion) ----
+static int queue_send(Uring* u, int fd, const void* buf, int len, uint64_t user_data, int shutdown_after) {
+    // A linked pair must land in the same submission
+    uint32_t head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    if (u->sq_local_tail - head + 2 > u->sq_entries) uring_flush(u);
+
+    struct io_uring_sqe* sqe = get_sqe(u);
+    if (!sqe) return -1;
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = user_data;
+    if (shutdown_after) {
+        sqe->flags |= IOSQE_IO_HARDLINK;  // Shut down even if the send failed
+        sqe = get_sqe(u);
+        sqe->opcode = IORING_OP_SHUTDOWN;
+        sqe->fd = fd;
+        sqe->len = SHUT_RDWR;
+        sqe->user_data = TAG_NONE;
+    }
+    return len;
+}
+
+int uring_send(Uring* u, int fd, ConnHandle h, const void* buf, int len, int shutdown_after) {
+    SendBuf* sb = malloc(sizeof(SendBuf) + len);
+    if (!sb) return -1;
+    sb->h = h;
+    sb->len = len;
+    memcpy(sb->data, buf, len);
+    if (queue_send(u, fd, sb->data, len, (uint64_t)(uintptr_t)sb | TAG_SEND, shutdown_after) < 0) {
+        free(sb);
+        return -1;
+    }
+    return len;
+}
+
+int uring_send_bcast(Uring* u, int fd, ConnHandle h, Bcast* b, int shutdown_after) {
+    if (!u->free_refs) {
+        SendRef* chunk = calloc(SENDREF_CHUNK, sizeof(SendRef));
+        if (!chunk) return -1;
+        for (int i = 0; i < SENDREF_CHUNK; i++) {
+            chunk[i].next = u->free_refs;
+            u->free_refs = &chunk[i];
+        }
+    }
+    SendRef* r = u->free_refs;
+    u->free_refs = r->next;
+    r->h = h;
+    r->b = b;
+    bcast_ref(b);
+    if (queue_send(u, fd, b->data, b->len, (uint64_t)(uintptr_t)r | TAG_SEND_BCAST, shutdown_after) < 0) {
+        bcast_unref(b);
+        r->next = u->free_refs;
+        u->free_refs = r;
+        return -1;
+    }
+    return b->len;
+}
+
+// ---- One completion ----
+static void handle_cqe(Uring* u, struct io_uring_cqe* cqe) {
+    uint64_t data = cqe->user_data;
+    int more = cqe->flags & IORING_CQE_F_MORE;
+
+    switch (data & TAG_MASK) {
+        case TAG_ACCEPT: {
+            Acceptor* a = (Acceptor*)(uintptr_t)(data & ~TAG_MASK);
+            if (cqe->res >= 0) u->cb.on_accept(a->ctx, cqe->res);
+            else if (cqe->res != -EAGAIN && cqe->res != -EINTR && cqe->res != -ECONNABORTED) {
+                fprintf(stderr, "accept failed: %s\n", strerror(-cqe->res));
+            }
+            if (!more) {
+                // Multishot stopped (e.g. out of fds): arm it again
+                uring_accept(u, a->fd, a->ctx);
+                free(a);
+            }
+            break;
+        }
+        case TAG_RECV: {
+            int fd = (int)(data >> 35);
+            ConnHandle h = (ConnHandle)(data >> TAG_BITS);
+            int alive;
+            if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+                uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                alive = u->cb.on_recv(h, u->bufs + (size_t)bid * URING_BUF_SIZE, cqe->res);
+                buf_recycle(u, bid);
+            } else if (cqe->res == -ENOBUFS) {
+                alive = 1;          // Buffers run dry; they are recycled below
+            } else {
+                alive = u->cb.on_recv(h, NULL, cqe->res);
+                more = 1;           // EOF or error ends the request for good
+            }
+            if (alive && !more) uring_recv(u, fd, h);
+            break;
+        }
+        case TAG_SEND: {
+            SendBuf* sb = (SendBuf*)(uintptr_t)(data & ~TAG_MASK);
+            u->cb.on_sent(sb->h, sb->len);
+            free(sb);
+            break;
+        }
+        case TAG_SEND_BCAST: {
+            SendRef* r = (SendRef*)(uintptr_t)(data & ~TAG_MASK);
+            u->cb.on_sent(r->h, r->b->len);
+            bcast_unref(r->b);
+            r->next = u->free_refs;
+            u->free_refs = r;
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// ---- Ring fd readable: drain completions, then submit what they queued ----
+static void uring_on_event(EventHandler* h, uint32_t events) {
+    Uring* u = (Uring*)((char*)h - offsetof(Uring, ev));
+    (void)events;
+    while (1) {
+        uint32_t head = *u->cq_head;
+        uint32_t tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            // Completions the kernel could not post are flushed by entering it
+            if (!(__atomic_load_n(u->sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW)) break;
+            sys_enter(u->fd, 0, 0, IORING_ENTER_GETEVENTS);
+            continue;
+        }
+        while (head != tail) {
+            handle_cqe(u, &u->cqes[head & u->cq_mask]);
+            head++;
+        }
+        __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+    }
+    buf_publish(u);
+    uring_flush(u);
+}
+
+// ---- Create a ring and map its queues ----
+static Uring* ring_create(void) {
+    Uring* u = calloc(1, sizeof(Uring));
+    if (!u) return NULL;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    u->fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (u->fd < 0) {
+        perror("io_uring_setup failed");
+        free(u);
+        return NULL;
+    }
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+    char* sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    char* cq = sq;
+    if (sq != MAP_FAILED && !(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+    }
+    u->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || u->sqes == MAP_FAILED) {
+        perror("io_uring mmap failed");
+        close(u->fd);
+        free(u);
+        return NULL;
+    }
+    u->sq_head = (uint32_t*)(sq + p.sq_off.head);
+    u->sq_tail = (uint32_t*)(sq + p.sq_off.tail);
+    u->sq_flags = (uint32_t*)(sq + p.sq_off.flags);
+    u->sq_array = (uint32_t*)(sq + p.sq_off.array);
+    u->sq_mask = *(uint32_t*)(sq + p.sq_off.ring_mask);
+    u->sq_entries = *(uint32_t*)(sq + p.sq_off.ring_entries);
+    u->sq_local_tail = *u->sq_tail;
+    u->cq_head = (uint32_t*)(cq + p.cq_off.head);
+    u->cq_tail = (uint32_t*)(cq + p.cq_off.tail);
+    u->cq_mask = *(uint32_t*)(cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return u;
+}
+
+// ---- Set up the ring, its mappings and the provided buffer ring ----
+int uring_init(EventLoop* loop, const UringCallbacks* cb) {
+    Uring* u = ring_create();
+    if (!u) return -1;
+    u->cb = *cb;
+
+    // --- Provided buffer ring for multishot recv ---
+    u->br = mmap(NULL, URING_BUFS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    u->bufs = mmap(NULL, (size_t)URING_BUFS * URING_BUF_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)u->br;
+    reg.ring_entries = URING_BUFS;
+    reg.bgid = URING_BGID;
+    if (u->br == MAP_FAILED || u->bufs == MAP_FAILED ||
+        syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        perror("io_uring buffer ring failed");
+        close(u->fd);
+        free(u);
+        return -1;
+    }
+    for (int i = 0; i < URING_BUFS; i++) buf_recycle(u, (uint16_t)i);
+    buf_publish(u);
+
+    u->ev.on_event = uring_on_event;
+    if (event_loop_add(loop, u->fd, &u->ev, EPOLLIN) < 0) {
+        perror("epoll_ctl failed");
+        close(u->fd);
+        free(u);
+        return -1;
+    }
+    loop->uring = u;
+    return 0;
+}
+
+// ---- Batched sends for the epoll path ----
+Uring* uring_batch_create(void) {
+    return ring_create();
+}
+
+int uring_batch_add(Uring* u, int fd, const void* buf, int len) {
+    if (u->batch_count == u->sq_entries || u->batch_count == URING_ENTRIES) return -1;
+    struct io_uring_sqe* sqe = get_sqe(u);
+    if (!sqe) return -1;
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_DONTWAIT;  // Completes at submission, never waits for space
+    sqe->user_data = (uint64_t)u->batch_gen << 32 | u->batch_count;
+    return (int)u->batch_count++;
+}
+
+// Hand the results waiting in the completion queue to done(). Completions of an
+// earlier, abandoned batch carry another generation and are skipped.
+static uint32_t batch_reap(Uring* u, void (*done)(int entry, int res, void* arg), void* arg) {
+    uint32_t reaped = 0;
+    uint32_t head = *u->cq_head;
+    uint32_t tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        struct io_uring_cqe* cqe = &u->cqes[head & u->cq_mask];
+        uint32_t entry = (uint32_t)cqe->user_data;
+        if ((uint32_t)(cqe->user_data >> 32) != u->batch_gen || entry >= u->batch_count) continue;
+        u->batch_reaped[entry / 64] |= 1ULL << (entry % 64);
+        done((int)entry, cqe->res, arg);
+        reaped++;
+    }
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+    return reaped;
+}
+
+void uring_batch_submit(Uring* u, void (*done)(int entry, int res, void* arg), void* arg) {
+    uint32_t n = u->batch_count;
+    if (n == 0) return;
+    memset(u->batch_reaped, 0, sizeof(u->batch_reaped));
+    __atomic_store_n(u->sq_tail, u->sq_local_tail, __ATOMIC_RELEASE);
+    uint32_t reaped = 0;
+    while (reaped < n) {
+        // Every send is non-blocking, so waiting for all of them returns at once.
+        // The kernel does not wait at all if it could not submit everything.
+        uint32_t unsubmitted = u->sq_local_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+        int ret = sys_enter(u->fd, unsubmitted, n - reaped, IORING_ENTER_GETEVENTS);
+        if (ret < 0 && errno != EINTR) {
+            perror("io_uring_enter failed");
+            break;
+        }
+        reaped += batch_reap(u, done, arg);
+        if (ret == 0 && unsubmitted > 0) break;  // The kernel takes no more of the batch
+    }
+
+    if (reaped < n) {
+        // Withdraw what the kernel has not taken, so the next batch does not
+        // submit it, and report every send without a result as not sent: the
+        // caller queues it as after EAGAIN. Sends were submitted non-blocking,
+        // so any taken by the kernel have already posted their results.
+        reaped += batch_reap(u, done, arg);
+        uint32_t head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+        u->sq_local_tail = head;
+        __atomic_store_n(u->sq_tail, head, __ATOMIC_RELEASE);
+        for (uint32_t i = 0; i < n; i++) {
+            if (!(u->batch_reaped[i / 64] & (1ULL << (i % 64)))) done((int)i, -EAGAIN, arg);
+        }
+    }
+    u->batch_count = 0;
+    u->batch_gen++;
+}
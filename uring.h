@@ -0,0 +1,75 @@
+#ifndef URING_H
+#define URING_H
+
+#include "server.h"
+#include "broadcast.h"
+
+// ---- io_uring backend (one ring per event loop) ----
+// Listening sockets use multishot accept and client sockets use multishot recv
+// into a ring of provided buffers, so a busy connection needs no syscall per
+// read. Sends are queued as SQEs and submitted together once the current batch
+// of completions has been handled. The ring's fd sits in the loop's epoll set,
+// so timers and cross-thread tasks keep working as before.
+// Needs Linux 6.0+ (multishot recv, provided buffer rings).
+
+#define URING_ENTRIES 1024          // Submission queue size
+#define URING_BUFS 512              // Provided receive buffers per loop (power of two)
+#define URING_BUF_SIZE 1024         // Receive buffer size; fits in a FrameRing beside one partial frame
+
+_Static_assert(URING_BUF_SIZE + TRV_MAX_PAYLOAD + FRAME_HEADER_LEN <= FRAME_RING_SIZE,
+               "a receive buffer must always fit in the frame ring");
+
+typedef struct Uring Uring;
+
+// Completion callbacks, run on the ring's loop thread
+typedef struct {
+    void (*on_accept)(void* ctx, int fd);                      // ctx as given to uring_accept()
+    // len 0 = EOF, < 0 = -errno. Returns 0 once the connection is gone, so
+    // its recv is not re-armed on a closed (possibly reused) fd.
+    int (*on_recv)(ConnHandle h, const char* data, int len);
+    // A send queued for h completed; len is the length it was queued with
+    void (*on_sent)(ConnHandle h, int len);
+} UringCallbacks;
+
+// Create the loop's ring and buffer ring and add it to the loop's epoll set.
+// Returns 0, or -1 if io_uring (or a needed feature) is unavailable.
+int uring_init(EventLoop* loop, const UringCallbacks* cb);
+
+// Arm a multishot accept on a listening socket (loop thread only)
+int uring_accept(Uring* u, int listen_fd, void* ctx);
+
+// Arm a multishot recv on a connection (loop thread only)
+int uring_recv(Uring* u, int fd, ConnHandle h);
+
+// Queue a copy of buf for sending on fd, connection h. With shutdown_after, the
+// socket is shut down once the send has finished (linked, so ordering is kept).
+int uring_send(Uring* u, int fd, ConnHandle h, const void* buf, int len, int shutdown_after);
+
+// Queue a send of a shared broadcast buffer without copying it; the send
+// holds a reference until it completes.
+int uring_send_bcast(Uring* u, int fd, ConnHandle h, Bcast* b, int shutdown_after);
+
+// Submit everything queued so far. Call before closing an fd that has queued
+// sends, and after queueing outside a completion callback.
+void uring_flush(Uring* u);
+
+// ---- Batched sends for the epoll path (no -u) ----
+// A fan-out still goes out through a ring: every send is queued with
+// MSG_DONTWAIT, so none waits for socket space, and one io_uring_enter()
+// submits the whole batch and collects the results. Whatever a socket did not
+// take is left to the caller, as after a short send().
+
+// Create a send-only ring, or return NULL if io_uring is unavailable
+Uring* uring_batch_create(void);
+
+// Queue a send of buf (kept valid until uring_batch_submit() returns). Returns
+// its entry number in the batch (0, 1, ...), or -1 if the batch is full
+// (URING_ENTRIES).
+int uring_batch_add(Uring* u, int fd, const void* buf, int len);
+
+// Submit the batch and wait for it; done() gets each entry's result exactly
+// once (bytes sent or -errno). If io_uring_enter() fails, the sends the kernel
+// did not take are withdrawn and reported as -EAGAIN.
+void uring_batch_submit(Uring* u, void (*done)(int entry, int res, void* arg), void* arg);
+
+#endif // URING_H